@@ -0,0 +1,370 @@
+#if USE_MPI
+# include <mpi.h>
+#endif
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "lulesh.h"
+
+/*
+   EOS load balancing between ranks.
+
+   The expensive regions (-c, -b) make the EOS the dominant and most
+   uneven phase: ranks whose subdomain holds more of the costly regions
+   run late, and everybody else waits for them in the next exchange.
+   Rather than migrating elements, and with them the mesh, halos and
+   node data, between ranks, an overloaded rank hands a batch of its
+   elements' EOS inputs to an underloaded one, which evaluates them with
+   the same kernel and sends the results back.  The EOS of an element
+   only reads its own state, so the answers are bitwise the same
+   wherever they are computed.
+
+   Every -L cycles the ranks share the time they spent on their own EOS
+   work per weighted element (the flops of EvalEOSForElems) and how much
+   weighted work they own, and deterministically pair the most loaded
+   rank with the least loaded one until every estimate is within
+   EOS_BALANCE_TOLERANCE of the mean.  A sender serves a pairing from
+   its most expensive regions first, as the tail of each region list.
+   Senders and receivers are disjoint, so no rank waits on a rank that
+   waits on it.  Until the next plan the same counts are shipped every
+   cycle, clamped to the current region sizes when regions migrate.
+*/
+
+// A plan stops once the most loaded rank is this close to the mean
+#define EOS_BALANCE_TOLERANCE 0.02
+
+/******************************************/
+
+void SetupEOSBalance(Domain& domain, Int_t interval)
+{
+   if ((interval <= 0) || (domain.numRanks() <= 1)) {
+      return ;
+   }
+
+   EOSBalance& bal = domain.eosBalance() ;
+   bal.interval = interval ;
+   bal.shipped.assign(domain.numReg(), 0) ;
+}
+
+/******************************************/
+
+/* Collective: max/mean of the EOS time accumulated since the last
+ * plan, or 0 when there was none */
+static double EOSImbalance(Domain& domain)
+{
+#if USE_MPI
+   EOSBalance& bal = domain.eosBalance() ;
+   double maxTime, sumTime ;
+   MPI_Allreduce(&bal.eosTime, &maxTime, 1, MPI_DOUBLE, MPI_MAX,
+                 MPI_COMM_WORLD) ;
+   MPI_Allreduce(&bal.eosTime, &sumTime, 1, MPI_DOUBLE, MPI_SUM,
+                 MPI_COMM_WORLD) ;
+   return (sumTime > 0.0) ? maxTime*domain.numRanks()/sumTime : 0.0 ;
+#else
+   (void) domain ;
+   return 0.0 ;
+#endif
+}
+
+/******************************************/
+
+void ReportEOSBalance(Domain& domain, Int_t myRank, bool report)
+{
+   EOSBalance& bal = domain.eosBalance() ;
+   if (bal.interval == 0) {
+      return ;
+   }
+
+   // The cycles after the last plan run with its assignment too
+   double imbalance = EOSImbalance(domain) ;
+   if (imbalance > 0.0) {
+      if (bal.plans == 0) {
+         bal.imbalanceFirst = imbalance ;
+      }
+      else {
+         bal.imbalanceLast = imbalance ;
+      }
+   }
+
+   if (report && (myRank == 0)) {
+      if (bal.plans == 0) {
+         printf("EOS balance: no plan within the run, EOS time max/mean %.3f\n\n",
+                bal.imbalanceFirst) ;
+      }
+      else {
+         printf("EOS balance: %d plans, EOS time max/mean %.3f before, "
+                "%.3f after\n\n",
+                bal.plans, bal.imbalanceFirst, bal.imbalanceLast) ;
+      }
+   }
+}
+
+#if USE_MPI
+
+/******************************************/
+
+static MPI_Datatype RealType()
+{
+   return (sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE ;
+}
+
+/******************************************/
+
+/* Turn a share of weighted work into elements per region, taking the
+ * most expensive regions first; avail holds what is left to give */
+static void PlanEOSWork(EOSWork& work, double units, Int_t numReg,
+                        const double *regionWeight,
+                        const std::vector<Int_t>& byCost,
+                        std::vector<Index_t>& avail)
+{
+   work.plan.assign(numReg, 0) ;
+   for (Int_t k=0 ; k<numReg ; ++k) {
+      Int_t r = byCost[k] ;
+      if (regionWeight[r] <= 0.0) {
+         continue ;
+      }
+      Index_t n = Index_t(MIN(double(avail[r]), units/regionWeight[r])) ;
+      work.plan[r] = n ;
+      avail[r] -= n ;
+      units -= double(n)*regionWeight[r] ;
+   }
+}
+
+/******************************************/
+
+struct HeavierRegion {
+   HeavierRegion(const double *weight) : m_weight(weight) {}
+   bool operator()(Int_t a, Int_t b) const {
+      return m_weight[a] > m_weight[b] ;
+   }
+   const double *m_weight ;
+} ;
+
+/******************************************/
+
+void PlanEOSBalance(Domain& domain, const double *regionWeight)
+{
+   EOSBalance& bal = domain.eosBalance() ;
+   Int_t numRanks = domain.numRanks() ;
+   Int_t numReg = domain.numReg() ;
+   Int_t myRank ;
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank) ;
+
+   double imbalance = EOSImbalance(domain) ;
+   if (bal.plans == 0) {
+      bal.imbalanceFirst = imbalance ;
+   }
+   bal.imbalanceLast = imbalance ;
+   ++bal.plans ;
+
+   // Seconds per unit of own work, and the work owned
+   double units = 0.0 ;
+   for (Int_t r=0 ; r<numReg ; ++r) {
+      units += double(domain.regElemSize(r))*regionWeight[r] ;
+   }
+   double mine[2] = { (bal.localUnits > 0.0) ? bal.localTime/bal.localUnits : 0.0,
+                      units } ;
+   std::vector<double> all(2*numRanks) ;
+   MPI_Allgather(mine, 2, MPI_DOUBLE, &all[0], 2, MPI_DOUBLE, MPI_COMM_WORLD) ;
+
+   bal.localTime = 0.0 ;
+   bal.localUnits = 0.0 ;
+   bal.eosTime = 0.0 ;
+   bal.sends.clear() ;
+   bal.serves.clear() ;
+
+   // Ranks that had no work of their own to time run at the mean rate
+   double rateSum = 0.0 ;
+   Int_t rateCount = 0 ;
+   for (Int_t i=0 ; i<numRanks ; ++i) {
+      if (all[2*i] > 0.0) {
+         rateSum += all[2*i] ;
+         ++rateCount ;
+      }
+   }
+   if (rateCount == 0) {
+      return ;
+   }
+   std::vector<double> rate(numRanks), load(numRanks) ;
+   double avg = 0.0 ;
+   for (Int_t i=0 ; i<numRanks ; ++i) {
+      rate[i] = (all[2*i] > 0.0) ? all[2*i] : rateSum/rateCount ;
+      load[i] = rate[i]*all[2*i+1] ;
+      avg += load[i] ;
+   }
+   avg /= numRanks ;
+
+   std::vector<Int_t> byCost(numReg) ;
+   for (Int_t r=0 ; r<numReg ; ++r) {
+      byCost[r] = r ;
+   }
+   std::stable_sort(byCost.begin(), byCost.end(), HeavierRegion(regionWeight)) ;
+   std::vector<Index_t> avail(numReg) ;
+   for (Int_t r=0 ; r<numReg ; ++r) {
+      avail[r] = domain.regElemSize(r) ;
+   }
+
+   // Every pairing brings the sender or the receiver to the mean and
+   // retires it, so no pair comes up twice and numRanks pairings always
+   // suffice.  All ranks run the same loop on the same data and agree
+   // on the plan.
+   std::vector<char> settled(numRanks, 0) ;
+   for (Int_t step=0 ; step<numRanks ; ++step) {
+      Int_t from = -1, to = -1 ;
+      for (Int_t i=0 ; i<numRanks ; ++i) {
+         if (settled[i]) continue ;
+         if ((from < 0) || (load[i] > load[from])) from = i ;
+         if ((to < 0)   || (load[i] < load[to]))   to = i ;
+      }
+      // Moving work between ranks of different speed changes the total,
+      // so the receivers can run out before the senders do
+      if ((from < 0) || (load[from] - avg <= EOS_BALANCE_TOLERANCE*avg) ||
+          (load[to] >= avg)) {
+         break ;
+      }
+      double give = (load[from] - avg)/rate[from] ;
+      if ((avg - load[to])/rate[to] < give) {
+         give = (avg - load[to])/rate[to] ;
+         settled[to] = 1 ;
+      }
+      else {
+         settled[from] = 1 ;
+      }
+      load[from] -= give*rate[from] ;
+      load[to]   += give*rate[to] ;
+
+      EOSWork work ;
+      work.size = 0 ;
+      if (from == myRank) {
+         work.rank = to ;
+         PlanEOSWork(work, give, numReg, regionWeight, byCost, avail) ;
+         bal.sends.push_back(work) ;
+      }
+      else if (to == myRank) {
+         work.rank = from ;
+         work.count.resize(numReg) ;
+         bal.serves.push_back(work) ;
+      }
+   }
+}
+
+/******************************************/
+
+/* Clamp the counts of a send to the current region sizes and find where
+ * its elements start in each region list, after those of earlier sends */
+static void ShippedRange(Domain& domain, EOSWork& work,
+                         std::vector<Index_t>& shipped)
+{
+   work.count.resize(domain.numReg()) ;
+   work.first.resize(domain.numReg()) ;
+   work.size = 0 ;
+   for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+      work.count[r] = MIN(work.plan[r], domain.regElemSize(r) - shipped[r]) ;
+      shipped[r] += work.count[r] ;
+      work.first[r] = domain.regElemSize(r) - shipped[r] ;
+      work.size += work.count[r] ;
+   }
+}
+
+/******************************************/
+
+/* Size this cycle's sends and post the receives for the work served
+ * here.  The team packs the sends (PackEOSWork) before SendEOSWork */
+void PrepareEOSWork(Domain& domain)
+{
+   EOSBalance& bal = domain.eosBalance() ;
+   Int_t numReg = domain.numReg() ;
+
+   std::fill(bal.shipped.begin(), bal.shipped.end(), 0) ;
+
+   for (size_t k=0 ; k<bal.sends.size() ; ++k) {
+      EOSWork& work = bal.sends[k] ;
+      ShippedRange(domain, work, bal.shipped) ;
+      work.buf.resize(EOSNumFields*work.size) ;
+   }
+
+   for (size_t k=0 ; k<bal.serves.size() ; ++k) {
+      EOSWork& work = bal.serves[k] ;
+      MPI_Irecv(&work.count[0], numReg, MPI_INT, work.rank, MSG_EOS_WORK,
+                MPI_COMM_WORLD, &work.req[0]) ;
+      work.req[1] = MPI_REQUEST_NULL ;
+   }
+}
+
+/******************************************/
+
+void SendEOSWork(Domain& domain)
+{
+   EOSBalance& bal = domain.eosBalance() ;
+   Int_t numReg = domain.numReg() ;
+
+   for (size_t k=0 ; k<bal.sends.size() ; ++k) {
+      EOSWork& work = bal.sends[k] ;
+      // Same tag for both; MPI keeps them in order
+      MPI_Isend(&work.count[0], numReg, MPI_INT, work.rank, MSG_EOS_WORK,
+                MPI_COMM_WORLD, &work.req[0]) ;
+      if (work.size > 0) {
+         MPI_Isend(&work.buf[0], EOS_WORK_IN*work.size, RealType(),
+                   work.rank, MSG_EOS_WORK, MPI_COMM_WORLD, &work.req[1]) ;
+      }
+      else {
+         work.req[1] = MPI_REQUEST_NULL ;
+      }
+   }
+}
+
+/******************************************/
+
+void ReceiveEOSWork(Domain& domain, size_t k)
+{
+   EOSWork& work = domain.eosBalance().serves[k] ;
+   MPI_Wait(&work.req[0], MPI_STATUS_IGNORE) ;
+
+   work.size = 0 ;
+   for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+      work.size += work.count[r] ;
+   }
+   work.buf.resize(EOSNumFields*work.size) ;
+   if (work.size > 0) {
+      MPI_Recv(&work.buf[0], EOS_WORK_IN*work.size, RealType(), work.rank,
+               MSG_EOS_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE) ;
+   }
+}
+
+/******************************************/
+
+void ReturnEOSWork(Domain& domain, size_t k)
+{
+   EOSWork& work = domain.eosBalance().serves[k] ;
+   if (work.size > 0) {
+      MPI_Isend(work.field(EOSE), EOS_WORK_OUT*work.size, RealType(),
+                work.rank, MSG_EOS_RESULT, MPI_COMM_WORLD, &work.req[1]) ;
+   }
+}
+
+/******************************************/
+
+/* Wait for the results of the sends, which the team then unpacks
+ * (UnpackEOSWork), and for the results returned to other ranks */
+void FinishEOSWork(Domain& domain)
+{
+   EOSBalance& bal = domain.eosBalance() ;
+
+   for (size_t k=0 ; k<bal.sends.size() ; ++k) {
+      EOSWork& work = bal.sends[k] ;
+
+      // The results land on the inputs, so the send must be done first
+      MPI_Waitall(2, work.req, MPI_STATUSES_IGNORE) ;
+      if (work.size > 0) {
+         MPI_Recv(work.field(EOSE), EOS_WORK_OUT*work.size, RealType(),
+                  work.rank, MSG_EOS_RESULT, MPI_COMM_WORLD,
+                  MPI_STATUS_IGNORE) ;
+      }
+   }
+
+   for (size_t k=0 ; k<bal.serves.size() ; ++k) {
+      MPI_Wait(&bal.serves[k].req[1], MPI_STATUS_IGNORE) ;
+   }
+}
+
+#endif
@@ -0,0 +1,565 @@
+/*
+   lulesh-bench: times individual LULESH kernels in isolation.
+
+   The problem is set up exactly as for a full run (all of the usual
+   options apply, e.g. -s, -r, -R, -t) and advanced -i cycles (def: 10)
+   so the kernels see a developed Sedov state rather than the initial
+   one.  Each kernel is then run repeatedly on that state; anything a
+   kernel overwrites that would change the next repetition is restored
+   outside the timed region.
+
+   Results are reported per item (element, or face node for the comm
+   pack/unpack loops).  Bytes/item is the footprint of the arrays the
+   kernel touches divided by the number of items, i.e. the compulsory
+   memory traffic of one pass with perfect cache reuse.
+
+   Extra options:
+    --kernel <name>   : only run kernels whose name contains <name>
+    --min-time <s>    : time each kernel for at least <s> seconds (def: 0.5)
+
+   The kernels are static in lulesh.cc, so that file is compiled into
+   this one with its main() left out.
+*/
+
+#define LULESH_BENCH 1
+#include "lulesh.cc"
+
+#include <algorithm>
+
+/******************************************/
+
+/* Inputs and outputs shared by the kernels, set up once */
+struct BenchScratch {
+   std::vector<Real_t> elemOut ;
+   std::vector<Real_t> sigxx, sigyy, sigzz, determ ;
+   std::vector<Real_t> hgfx, hgfy, hgfz ;
+   std::vector<Real_t> vnewc ;
+   std::vector<Real_t> e0, p0, q0 ;
+   std::vector<Real_t> commBuf ;
+} ;
+
+struct BenchKernel {
+   const char *name ;
+   const char *unit ;
+   void (*run)(Domain& domain, BenchScratch& s) ;
+   void (*reset)(Domain& domain, BenchScratch& s) ;    // may be NULL
+   double (*footprint)(Domain& domain, Index_t *items) ;
+} ;
+
+static const double realBytes  = double(sizeof(Real_t)) ;
+static const double indexBytes = double(sizeof(Index_t)) ;
+
+static inline double BenchNow()
+{
+   timespec ts ;
+   clock_gettime(CLOCK_MONOTONIC, &ts) ;
+   return double(ts.tv_sec) + 1.0e-9*double(ts.tv_nsec) ;
+}
+
+/******************************************/
+
+static void BenchElemVolume(Domain& domain, BenchScratch& s)
+{
+   Index_t numElem = domain.numElem() ;
+   Real_t *out = &s.elemOut[0] ;
+
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t k=0 ; k<numElem ; ++k) {
+      Real_t x_local[8], y_local[8], z_local[8] ;
+      CollectDomainNodesToElemNodes(domain, domain.nodelist(k),
+                                    x_local, y_local, z_local) ;
+      out[k] = CalcElemVolume(x_local, y_local, z_local) ;
+   }
+}
+
+/* Element gathers of the coordinates plus one result per element */
+static double FootprintElemGather(Domain& domain, Index_t *items)
+{
+   *items = domain.numElem() ;
+   return double(domain.numElem())*(8*indexBytes + realBytes) +
+          double(domain.numNode())*3*realBytes ;
+}
+
+/******************************************/
+
+static void BenchShapeFunctionDerivatives(Domain& domain, BenchScratch& s)
+{
+   Index_t numElem = domain.numElem() ;
+   Real_t *out = &s.elemOut[0] ;
+
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t k=0 ; k<numElem ; ++k) {
+      Real_t B[3][8] ;
+      Real_t x_local[8], y_local[8], z_local[8] ;
+      CollectDomainNodesToElemNodes(domain, domain.nodelist(k),
+                                    x_local, y_local, z_local) ;
+      CalcElemShapeFunctionDerivatives(x_local, y_local, z_local,
+                                       B, &out[k]) ;
+   }
+}
+
+/******************************************/
+
+/* The hourglass modes are projected against the element geometry in
+   CalcFBHourglassForceForElems; that projection is not part of this
+   kernel, so the bare gamma vectors stand in for it here */
+static void BenchFBHourglassForce(Domain& domain, BenchScratch& s)
+{
+   static const Real_t gamma[4][8] = {
+      {  1.,  1., -1., -1., -1., -1.,  1.,  1. },
+      {  1., -1., -1.,  1., -1.,  1.,  1., -1. },
+      {  1., -1.,  1., -1.,  1., -1.,  1., -1. },
+      { -1.,  1., -1.,  1.,  1., -1.,  1., -1. }
+   } ;
+   Index_t numElem = domain.numElem() ;
+   Real_t hourg = domain.hgcoef() ;
+
+#pragma omp parallel for firstprivate(numElem, hourg)
+   for (Index_t k=0 ; k<numElem ; ++k) {
+      const Index_t *elemToNode = domain.nodelist(k) ;
+      Real_t hourgam[8][4] ;
+      Real_t xd1[8], yd1[8], zd1[8] ;
+
+      for (Index_t i=0 ; i<8 ; ++i) {
+         for (Index_t j=0 ; j<4 ; ++j) {
+            hourgam[i][j] = gamma[j][i] ;
+         }
+         xd1[i] = domain.xd(elemToNode[i]) ;
+         yd1[i] = domain.yd(elemToNode[i]) ;
+         zd1[i] = domain.zd(elemToNode[i]) ;
+      }
+
+      Real_t coefficient = - hourg * Real_t(0.01) * domain.ss(k) *
+                           domain.elemMass(k) ;
+      CalcElemFBHourglassForce(xd1, yd1, zd1, hourgam, coefficient,
+                               &s.hgfx[8*k], &s.hgfy[8*k], &s.hgfz[8*k]) ;
+   }
+}
+
+/* Velocity gathers, sound speed and mass in, eight corner forces out */
+static double FootprintFBHourglassForce(Domain& domain, Index_t *items)
+{
+   *items = domain.numElem() ;
+   return double(domain.numElem())*(8*indexBytes + 26*realBytes) +
+          double(domain.numNode())*3*realBytes ;
+}
+
+/******************************************/
+
+/* With LULESH_PERSISTENT_OMP the kernels only share out their loops,
+   so the bench opens the parallel region LagrangeLeapFrog would */
+static void BenchIntegrateStress(Domain& domain, BenchScratch& s)
+{
+#if LULESH_PERSISTENT_OMP
+#pragma omp parallel
+#endif
+   if (domain.latticeNodes()) {
+      IntegrateStressForElems(domain, LatticeNodes(domain),
+                              &s.sigxx[0], &s.sigyy[0], &s.sigzz[0],
+                              &s.determ[0], domain.numElem(), domain.numNode()) ;
+   }
+   else {
+      IntegrateStressForElems(domain, NodeList(domain),
+                              &s.sigxx[0], &s.sigyy[0], &s.sigzz[0],
+                              &s.determ[0], domain.numElem(), domain.numNode()) ;
+   }
+}
+
+/* Forces are accumulated, so start each repetition from zero */
+static void ResetNodalForces(Domain& domain, BenchScratch&)
+{
+   Index_t numNode = domain.numNode() ;
+
+#pragma omp parallel for firstprivate(numNode)
+   for (Index_t i=0 ; i<numNode ; ++i) {
+      domain.fx(i) = Real_t(0.0) ;
+      domain.fy(i) = Real_t(0.0) ;
+      domain.fz(i) = Real_t(0.0) ;
+   }
+}
+
+static double FootprintIntegrateStress(Domain& domain, Index_t *items)
+{
+   Index_t numElem = domain.numElem() ;
+   double bytes = double(numElem)*(8*indexBytes + 4*realBytes) +
+                  double(domain.numNode())*6*realBytes ;
+#if _OPENMP
+   if (omp_get_max_threads() > 1) {
+      // per corner forces and the corner lists used to sum them
+      bytes += double(numElem)*8*(3*realBytes + indexBytes) ;
+   }
+#endif
+   *items = numElem ;
+   return bytes ;
+}
+
+/******************************************/
+
+static void BenchMonotonicQ(Domain& domain, BenchScratch&)
+{
+   // The uniform bench mesh never trips the q limit, so err is not read
+   ElemError err = { 0, -1 } ;
+#if LULESH_PERSISTENT_OMP
+#pragma omp parallel
+#endif
+   CalcMonotonicQForElems(domain, err) ;
+}
+
+/* Six neighbor indices, the BC mask and the region list per element;
+   gradients of the element and its neighbors, and the terms of q */
+static double FootprintMonotonicQ(Domain& domain, Index_t *items)
+{
+   *items = domain.numElem() ;
+   return double(domain.numElem())*(7*indexBytes + sizeof(Int_t) +
+                                    12*realBytes) ;
+}
+
+/******************************************/
+
+static void BenchEvalEOS(Domain& domain, BenchScratch& s)
+{
+#if LULESH_PERSISTENT_OMP
+#pragma omp parallel
+#endif
+   for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+      Index_t numElemReg = domain.regElemSize(r) ;
+      Index_t *regElemList = domain.regElemlist(r) ;
+      if (domain.regionSorted()) {
+         EvalEOSForElems(domain, domain, &s.vnewc[0], numElemReg,
+                         ElemRange((numElemReg > 0) ? regElemList[0] : 0),
+                         1, EOSBilinear) ;
+      }
+      else {
+         EvalEOSForElems(domain, domain, &s.vnewc[0], numElemReg,
+                         ElemList(regElemList), 1, EOSBilinear) ;
+      }
+   }
+}
+
+/* The EOS updates e, p and q from their old values */
+static void ResetEOSState(Domain& domain, BenchScratch& s)
+{
+   Index_t numElem = domain.numElem() ;
+
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      domain.e(i) = s.e0[i] ;
+      domain.p(i) = s.p0[i] ;
+      domain.q(i) = s.q0[i] ;
+   }
+}
+
+/* e, delv, p, q, qq, ql and vnew in, p, e, q and ss out, the region
+   list, and the fifteen per region temporaries */
+static double FootprintEvalEOS(Domain& domain, Index_t *items)
+{
+   *items = domain.numElem() ;
+   return double(domain.numElem())*(indexBytes + 26*realBytes) ;
+}
+
+/******************************************/
+
+/* The face loops of CommSend and CommSBN, without the messages: the
+   six faces of the node block, with contiguous (plane), pencil (row)
+   and strided (col) access */
+static void PackFaces(Domain& domain, Index_t xferFields,
+                      Domain_member *fieldData, Real_t *destAddr,
+                      Index_t dx, Index_t dy, Index_t dz)
+{
+   Index_t plane = xferFields*dx*dy ;
+   Index_t row = xferFields*dx*dz ;
+   Index_t col = xferFields*dy*dz ;
+
+   CommPackFace(domain, xferFields, fieldData, destAddr,
+                0, dy, dx, dx, 1, false) ;
+   CommPackFace(domain, xferFields, fieldData, destAddr + plane,
+                dx*dy*(dz - 1), dy, dx, dx, 1, false) ;
+   destAddr += 2*plane ;
+   CommPackFace(domain, xferFields, fieldData, destAddr,
+                0, dz, dx*dy, dx, 1, false) ;
+   CommPackFace(domain, xferFields, fieldData, destAddr + row,
+                dx*(dy - 1), dz, dx*dy, dx, 1, false) ;
+   destAddr += 2*row ;
+   CommPackFace(domain, xferFields, fieldData, destAddr,
+                0, dz, dx*dy, dy, dx, false) ;
+   CommPackFace(domain, xferFields, fieldData, destAddr + col,
+                dx - 1, dz, dx*dy, dy, dx, false) ;
+}
+
+static void UnpackFaces(Domain& domain, Index_t xferFields,
+                        Domain_member *fieldData, const Real_t *srcAddr,
+                        Index_t dx, Index_t dy, Index_t dz)
+{
+   Index_t plane = xferFields*dx*dy ;
+   Index_t row = xferFields*dx*dz ;
+   Index_t col = xferFields*dy*dz ;
+
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                     0, dy, dx, dx, 1) ;
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr + plane,
+                     dx*dy*(dz - 1), dy, dx, dx, 1) ;
+   srcAddr += 2*plane ;
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                     0, dz, dx*dy, dx, 1) ;
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr + row,
+                     dx*(dy - 1), dz, dx*dy, dx, 1) ;
+   srcAddr += 2*row ;
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                     0, dz, dx*dy, dy, dx) ;
+   CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr + col,
+                     dx - 1, dz, dx*dy, dy, dx) ;
+}
+
+/* Position and velocity, as in CommSyncPosVel */
+static void BenchCommPack(Domain& domain, BenchScratch& s)
+{
+   Domain_member fieldData[6] = { &Domain::x, &Domain::y, &Domain::z,
+                                  &Domain::xd, &Domain::yd, &Domain::zd } ;
+   Index_t dn = domain.sizeX() + 1 ;
+   PackFaces(domain, 6, fieldData, &s.commBuf[0], dn, dn, dn) ;
+}
+
+/* Forces, as in the CommSBN after CalcForceForNodes */
+static void BenchCommUnpack(Domain& domain, BenchScratch& s)
+{
+   Domain_member fieldData[3] = { &Domain::fx, &Domain::fy, &Domain::fz } ;
+   Index_t dn = domain.sizeX() + 1 ;
+   UnpackFaces(domain, 3, fieldData, &s.commBuf[0], dn, dn, dn) ;
+}
+
+static Index_t FaceNodes(Domain& domain)
+{
+   Index_t dn = domain.sizeX() + 1 ;
+   return 6*dn*dn ;
+}
+
+static double FootprintCommPack(Domain& domain, Index_t *items)
+{
+   *items = FaceNodes(domain) ;
+   return double(*items)*2*6*realBytes ;
+}
+
+static double FootprintCommUnpack(Domain& domain, Index_t *items)
+{
+   *items = FaceNodes(domain) ;
+   return double(*items)*3*3*realBytes ;
+}
+
+/******************************************/
+
+static const BenchKernel benchKernels[] = {
+   { "CalcElemVolume", "elem",
+     BenchElemVolume, NULL, FootprintElemGather },
+   { "CalcElemShapeFunctionDerivatives", "elem",
+     BenchShapeFunctionDerivatives, NULL, FootprintElemGather },
+   { "CalcElemFBHourglassForce", "elem",
+     BenchFBHourglassForce, NULL, FootprintFBHourglassForce },
+   { "IntegrateStressForElems", "elem",
+     BenchIntegrateStress, ResetNodalForces, FootprintIntegrateStress },
+   { "CalcMonotonicQForElems", "elem",
+     BenchMonotonicQ, NULL, FootprintMonotonicQ },
+   { "EvalEOSForElems", "elem",
+     BenchEvalEOS, ResetEOSState, FootprintEvalEOS },
+   { "CommPack (6 fields)", "node",
+     BenchCommPack, NULL, FootprintCommPack },
+   { "CommUnpack (3 fields)", "node",
+     BenchCommUnpack, ResetNodalForces, FootprintCommUnpack }
+} ;
+
+/******************************************/
+
+static void SetupScratch(Domain& domain, BenchScratch& s)
+{
+   Index_t numElem = domain.numElem() ;
+   Real_t eosvmin = domain.eosvmin() ;
+   Real_t eosvmax = domain.eosvmax() ;
+   Index_t dn = domain.sizeX() + 1 ;
+
+   s.elemOut.resize(numElem) ;
+   s.sigxx.resize(numElem) ;
+   s.sigyy.resize(numElem) ;
+   s.sigzz.resize(numElem) ;
+   s.determ.resize(numElem) ;
+   s.hgfx.resize(8*numElem) ;
+   s.hgfy.resize(8*numElem) ;
+   s.hgfz.resize(8*numElem) ;
+   s.vnewc.resize(numElem) ;
+   s.e0.resize(numElem) ;
+   s.p0.resize(numElem) ;
+   s.q0.resize(numElem) ;
+   s.commBuf.resize(6*6*dn*dn) ;
+
+   InitStressTermsForElems(domain, &s.sigxx[0], &s.sigyy[0], &s.sigzz[0],
+                           numElem) ;
+
+   // Same clamping of the new volumes as ApplyMaterialPropertiesForElems
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      Real_t vc = domain.vnew(i) ;
+      if (eosvmin != Real_t(0.) && vc < eosvmin) {
+         vc = eosvmin ;
+      }
+      if (eosvmax != Real_t(0.) && vc > eosvmax) {
+         vc = eosvmax ;
+      }
+      s.vnewc[i] = vc ;
+      s.e0[i] = domain.e(i) ;
+      s.p0[i] = domain.p(i) ;
+      s.q0[i] = domain.q(i) ;
+   }
+
+   // Monotonic q works from the velocity gradients
+   Int_t allElem = numElem +
+         2*domain.sizeX()*domain.sizeY() +
+         2*domain.sizeX()*domain.sizeZ() +
+         2*domain.sizeY()*domain.sizeZ() ;
+   domain.AllocateGradients(numElem, allElem) ;
+   CalcMonotonicQGradientsForElems(domain, NodeList(domain)) ;
+}
+
+/******************************************/
+
+static void RunBenchKernel(const BenchKernel& kernel, Domain& domain,
+                           BenchScratch& s, double minTime)
+{
+   std::vector<double> times ;
+   double total = 0.0 ;
+
+   // untimed first pass to warm caches and the scratch pool
+   if (kernel.reset != NULL) {
+      kernel.reset(domain, s) ;
+   }
+   kernel.run(domain, s) ;
+
+   while (total < minTime || times.size() < 3) {
+      if (kernel.reset != NULL) {
+         kernel.reset(domain, s) ;
+      }
+      double start = BenchNow() ;
+      kernel.run(domain, s) ;
+      double t = BenchNow() - start ;
+      times.push_back(t) ;
+      total += t ;
+   }
+   if (kernel.reset != NULL) {
+      kernel.reset(domain, s) ;
+   }
+
+   std::sort(times.begin(), times.end()) ;
+   double best = times[0] ;
+   double median = times[times.size()/2] ;
+
+   Index_t items ;
+   double bytes = kernel.footprint(domain, &items) ;
+
+   printf("   %-34s %5s %10ld %7ld %10.4f %10.4f %10.2f %10.1f %8.2f\n",
+          kernel.name, kernel.unit, long(items), long(times.size()),
+          1.0e3*best, 1.0e3*median,
+          1.0e-6*double(items)/best,
+          bytes/double(items),
+          1.0e-9*bytes/best) ;
+}
+
+/******************************************/
+
+int main(int argc, char *argv[])
+{
+   int numRanks ;
+   int myRank ;
+   struct cmdLineOpts opts ;
+   const char *kernelFilter = NULL ;
+   double minTime = 0.5 ;
+
+#if USE_MPI
+   MPI_Init(&argc, &argv) ;
+   MPI_Comm_size(MPI_COMM_WORLD, &numRanks) ;
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank) ;
+   if (numRanks != 1) {
+      if (myRank == 0) {
+         printf("lulesh-bench runs on a single rank\n") ;
+      }
+      MPI_Abort(MPI_COMM_WORLD, -1) ;
+   }
+#else
+   numRanks = 1 ;
+   myRank = 0 ;
+#endif
+
+   // Take out the bench options, the rest are the usual LULESH ones
+   int nargs = 1 ;
+   for (int i=1 ; i<argc ; ++i) {
+      if (strcmp(argv[i], "--kernel") == 0 && i+1 < argc) {
+         kernelFilter = argv[++i] ;
+      }
+      else if (strcmp(argv[i], "--min-time") == 0 && i+1 < argc) {
+         char *end ;
+         minTime = strtod(argv[++i], &end) ;
+         if (*end != '\0' || minTime < 0.0) {
+            printf("Parse Error on option --min-time: non-negative value required\n") ;
+#if USE_MPI
+            MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+            exit(-1) ;
+#endif
+         }
+      }
+      else {
+         if (strcmp(argv[i], "-h") == 0) {
+            printf("Usage: %s [--kernel <name>] [--min-time <s>] [opts]\n", argv[0]) ;
+            printf(" --kernel <name> : only run kernels whose name contains <name>\n") ;
+            printf(" --min-time <s>  : time each kernel for at least <s> seconds (def: 0.5)\n") ;
+            printf(" -i <cycles>     : cycles to advance the problem first (def: 10)\n\n") ;
+         }
+         argv[nargs++] = argv[i] ;
+      }
+   }
+   argc = nargs ;
+
+   InitCmdLineOpts(&opts, numRanks) ;
+   opts.its = 10;  // advance the problem a little, not to completion
+
+   ParseCommandLineOptions(argc, argv, myRank, &opts);
+
+   Int_t col, row, plane, side;
+   InitMeshDecomp(numRanks, myRank, &col, &row, &plane, &side);
+   TimerInit(opts.numReg, false, myRank) ;
+
+   SetFieldMemPolicy(opts.memPolicy) ;
+   Domain *locDom = BuildDomain(opts, numRanks, myRank, col, row, plane, side) ;
+
+   while ((locDom->time() < locDom->stoptime()) && (locDom->cycle() < opts.its)) {
+      TimeIncrement(*locDom) ;
+      LagrangeLeapFrog(*locDom) ;
+   }
+
+   BenchScratch scratch ;
+   SetupScratch(*locDom, scratch) ;
+
+#if _OPENMP
+   int numThreads = omp_get_max_threads() ;
+#else
+   int numThreads = 1 ;
+#endif
+   printf("Kernel benchmarks: %d^3 elements, %d regions, %d threads, after %d cycles\n",
+          int(opts.nx), int(opts.numReg), numThreads, int(locDom->cycle())) ;
+   printf("   %-34s %5s %10s %7s %10s %10s %10s %10s %8s\n",
+          "kernel", "item", "items", "reps", "best ms", "median ms",
+          "Mitems/s", "bytes/item", "GB/s") ;
+
+   Int_t numKernels = sizeof(benchKernels)/sizeof(benchKernels[0]) ;
+   for (Int_t k=0 ; k<numKernels ; ++k) {
+      if (kernelFilter != NULL && strstr(benchKernels[k].name, kernelFilter) == NULL) {
+         continue ;
+      }
+      RunBenchKernel(benchKernels[k], *locDom, scratch, minTime) ;
+   }
+
+   locDom->DeallocateGradients() ;
+   delete locDom ;
+   ReleaseScratchPool() ;
+
+#if USE_MPI
+   MPI_Finalize() ;
+#endif
+
+   return 0 ;
+}
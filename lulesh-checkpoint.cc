@@ -0,0 +1,719 @@
+#if USE_MPI
+# include <mpi.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <time.h>
+#if LULESH_ZLIB
+# include <zlib.h>
+#endif
+#include "lulesh.h"
+
+/*
+   Checkpoint/restart of the persistent Domain state.
+
+   Every rank writes its own file, <base>.<rank>, laid out as
+
+      header block   : CheckpointHeader, then the raw and the stored byte
+                       length of every section as a pair of Int8_t
+      sections       : the field arrays, each starting on a
+                       CHECKPOINT_ALIGN boundary; a section whose stored
+                       length differs from its raw length is zlib
+                       compressed
+
+   A blocking checkpoint writes each field as one large aligned write
+   straight from the Domain arrays.  An asynchronous checkpoint copies
+   the fields into one of two staging arenas laid out exactly like the
+   file, in parallel, and hands the arena to an I/O thread that
+   compresses (when built with LULESH_ZLIB) and writes it while the
+   timestep loop carries on.
+
+   The mesh, connectivity and boundary conditions are rebuilt from the
+   command line as usual and only the state that evolves is read back,
+   which makes a restarted run bitwise identical to an uninterrupted one
+   given the same options and thread count.  A restart maps the file
+   (prefaulted with MAP_POPULATE where available) and copies the
+   page-aligned sections into the Domain arrays with every thread, so it
+   runs at page cache or disk speed rather than one read() at a time.
+*/
+
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_ALIGN   4096
+
+// Chunk size of the parallel snapshot copy
+#define CHECKPOINT_COPY_CHUNK (size_t(1) << 20)
+
+static const char checkpointMagic[8] = { 'L','U','L','E','S','H','C','K' } ;
+
+struct CheckpointHeader {
+   char    magic[8] ;
+   Int_t   version ;
+   Int_t   realBytes ;
+   Int_t   indexBytes ;
+   Int_t   numRanks ;
+   Int_t   rank ;
+   Int_t   numReg ;
+   Int_t   migrate ;        // region lists and positions are dynamic
+   Int_t   numSections ;
+   Index_t numElem ;
+   Index_t numNode ;
+   Int_t   cycle ;
+   Real_t  time ;
+   Real_t  deltatime ;
+   Real_t  deltatimemultlb ;
+   Real_t  deltatimemultub ;
+   Real_t  stoptime ;
+   Real_t  dtcourant ;
+   Real_t  dthydro ;
+   Real_t  dtmax ;
+   Real_t  dtfixed ;
+} ;
+
+struct CheckpointSection {
+   void   *data ;
+   size_t  bytes ;
+} ;
+
+// A staging arena holds one snapshot, laid out like the file
+struct CheckpointArena {
+   char    *data ;
+   size_t   capacity ;
+   size_t   size ;
+   Int_t    numSections ;
+   Int_t    myRank ;
+   bool     busy ;       // snapshot taken, not yet on disk
+} ;
+
+// Totals of this rank, reported by FinishCheckpoints
+struct CheckpointStats {
+   Int_t   count ;
+   double  visible ;     // time the timestep loop spent in WriteCheckpoint
+   double  wait ;        // part of it spent waiting for a free arena
+   double  background ;  // time the I/O thread spent compressing and writing
+   double  rawBytes ;
+   double  storedBytes ;
+} ;
+
+static CheckpointStats checkpointStats = { 0, 0.0, 0.0, 0.0, 0.0, 0.0 } ;
+
+// Asynchronous writer: two arenas written in order by one I/O thread
+static CheckpointArena checkpointArena[2] ;
+static Int_t           checkpointQueue[2] ;
+static Int_t           checkpointQueued = 0 ;
+static Int_t           checkpointNext = 0 ;
+static bool            checkpointThreadRunning = false ;
+static bool            checkpointQuit = false ;
+static char            checkpointBase[1024] ;
+static pthread_t       checkpointThread ;
+static pthread_mutex_t checkpointLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  checkpointCond = PTHREAD_COND_INITIALIZER ;
+
+/******************************************/
+
+static inline size_t AlignCheckpoint(size_t offset)
+{
+   return (offset + CHECKPOINT_ALIGN - 1) & ~size_t(CHECKPOINT_ALIGN - 1) ;
+}
+
+/******************************************/
+
+static inline double CheckpointClock()
+{
+   timespec ts ;
+   clock_gettime(CLOCK_MONOTONIC, &ts) ;
+   return double(ts.tv_sec) + 1.0e-9*double(ts.tv_nsec) ;
+}
+
+/******************************************/
+
+static void CheckpointAbort(const char *message, const char *fname)
+{
+   fprintf(stderr, "%s %s\n", message, fname) ;
+#if USE_MPI
+   MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+   exit(-1) ;
+#endif
+}
+
+/******************************************/
+
+static void CheckpointFileName(char *name, size_t len, const char *base, Int_t myRank)
+{
+   int n = snprintf(name, len, "%s.%05d", base, myRank) ;
+   if ((n < 0) || (size_t(n) >= len)) {
+      CheckpointAbort("Checkpoint file name too long:", base) ;
+   }
+}
+
+/******************************************/
+
+// Region lists come last, sized by regElemSize, so a reader can restore
+// the sizes before it knows how long the lists are
+static void CheckpointSections(Domain& domain, std::vector<CheckpointSection>& sections)
+{
+   static Domain_member const nodeFields[] = {
+      &Domain::x,  &Domain::y,  &Domain::z,
+      &Domain::xd, &Domain::yd, &Domain::zd,
+      &Domain::fx, &Domain::fy, &Domain::fz,
+      &Domain::nodalMass
+   } ;
+   static Domain_member const elemFields[] = {
+      &Domain::e, &Domain::p, &Domain::q, &Domain::ql, &Domain::qq,
+      &Domain::v, &Domain::volo, &Domain::delv, &Domain::vdov,
+      &Domain::arealg, &Domain::ss, &Domain::elemMass
+   } ;
+   Index_t numNode = domain.numNode() ;
+   Index_t numElem = domain.numElem() ;
+
+   sections.clear() ;
+   for (size_t i=0 ; i<sizeof(nodeFields)/sizeof(nodeFields[0]) ; ++i) {
+      CheckpointSection s = { &(domain.*nodeFields[i])(0), numNode*sizeof(Real_t) } ;
+      sections.push_back(s) ;
+   }
+   for (size_t i=0 ; i<sizeof(elemFields)/sizeof(elemFields[0]) ; ++i) {
+      CheckpointSection s = { &(domain.*elemFields[i])(0), numElem*sizeof(Real_t) } ;
+      sections.push_back(s) ;
+   }
+
+   CheckpointSection regNum = { domain.regNumList(), numElem*sizeof(Index_t) } ;
+   sections.push_back(regNum) ;
+   if (domain.regMigrateInterval() > 0) {
+      CheckpointSection regPos = { &domain.regElemPos(0), numElem*sizeof(Index_t) } ;
+      sections.push_back(regPos) ;
+   }
+   CheckpointSection regSize = { &domain.regElemSize(0), domain.numReg()*sizeof(Index_t) } ;
+   sections.push_back(regSize) ;
+
+   for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+      CheckpointSection s = { domain.regElemlist(r), domain.regElemSize(r)*sizeof(Index_t) } ;
+      sections.push_back(s) ;
+   }
+}
+
+/******************************************/
+
+static bool WriteFully(int fd, const void *buf, size_t bytes, off_t offset)
+{
+   const char *p = static_cast<const char *>(buf) ;
+   while (bytes > 0) {
+      ssize_t n = pwrite(fd, p, bytes, offset) ;
+      if (n < 0 && errno == EINTR) {
+         continue ;
+      }
+      if (n <= 0) {
+         return false ;
+      }
+      p += n ;
+      bytes -= size_t(n) ;
+      offset += n ;
+   }
+   return true ;
+}
+
+/******************************************/
+
+// Header block: the header followed by the {raw, stored} length pairs,
+// with stored == raw until a section is compressed
+static size_t BuildCheckpointHeader(Domain& domain,
+                                    const std::vector<CheckpointSection>& sections,
+                                    Int_t myRank, Int_t numRanks,
+                                    std::vector<char>& headerBlock)
+{
+   CheckpointHeader header ;
+   memset(&header, 0, sizeof(header)) ;
+   memcpy(header.magic, checkpointMagic, 8) ;
+   header.version         = CHECKPOINT_VERSION ;
+   header.realBytes       = sizeof(Real_t) ;
+   header.indexBytes      = sizeof(Index_t) ;
+   header.numRanks        = numRanks ;
+   header.rank            = myRank ;
+   header.numReg          = domain.numReg() ;
+   header.migrate         = (domain.regMigrateInterval() > 0) ? 1 : 0 ;
+   header.numSections     = Int_t(sections.size()) ;
+   header.numElem         = domain.numElem() ;
+   header.numNode         = domain.numNode() ;
+   header.cycle           = domain.cycle() ;
+   header.time            = domain.time() ;
+   header.deltatime       = domain.deltatime() ;
+   header.deltatimemultlb = domain.deltatimemultlb() ;
+   header.deltatimemultub = domain.deltatimemultub() ;
+   header.stoptime        = domain.stoptime() ;
+   header.dtcourant       = domain.dtcourant() ;
+   header.dthydro         = domain.dthydro() ;
+   header.dtmax           = domain.dtmax() ;
+   header.dtfixed         = domain.dtfixed() ;
+
+   size_t headerBytes = AlignCheckpoint(sizeof(header) + 2*sections.size()*sizeof(Int8_t)) ;
+   headerBlock.assign(headerBytes, 0) ;
+   memcpy(&headerBlock[0], &header, sizeof(header)) ;
+   Int8_t *sectionBytes = reinterpret_cast<Int8_t *>(&headerBlock[sizeof(header)]) ;
+   for (size_t i=0 ; i<sections.size() ; ++i) {
+      sectionBytes[2*i]   = Int8_t(sections[i].bytes) ;
+      sectionBytes[2*i+1] = Int8_t(sections[i].bytes) ;
+   }
+   return headerBytes ;
+}
+
+/******************************************/
+
+// Write to a temporary name and rename, so an interrupted write never
+// clobbers the previous checkpoint
+static int OpenCheckpointTemp(const char *base, Int_t myRank,
+                              char *fname, char *tmpname)
+{
+   CheckpointFileName(fname, 1024, base, myRank) ;
+   snprintf(tmpname, 1040, "%s.tmp", fname) ;
+
+   int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+   if (fd < 0) {
+      fprintf(stderr, "Unable to open %s to write checkpoint\n", tmpname) ;
+   }
+   return fd ;
+}
+
+/******************************************/
+
+static void CloseCheckpointTemp(int fd, bool ok, off_t length,
+                                const char *fname, const char *tmpname)
+{
+   // Pad the last section so the file length is a whole number of blocks
+   ok = ok && (ftruncate(fd, length) == 0) ;
+   ok = (close(fd) == 0) && ok ;
+
+   if (!ok || (rename(tmpname, fname) != 0)) {
+      fprintf(stderr, "Error writing checkpoint to %s\n", fname) ;
+      unlink(tmpname) ;
+   }
+}
+
+/******************************************/
+
+static void WriteCheckpointBlocking(Domain& domain, const char *base,
+                                    Int_t myRank, Int_t numRanks)
+{
+   std::vector<CheckpointSection> sections ;
+   CheckpointSections(domain, sections) ;
+
+   std::vector<char> headerBlock ;
+   size_t headerBytes = BuildCheckpointHeader(domain, sections, myRank, numRanks,
+                                              headerBlock) ;
+
+   char fname[1024], tmpname[1040] ;
+   int fd = OpenCheckpointTemp(base, myRank, fname, tmpname) ;
+   if (fd < 0) {
+      return ;
+   }
+
+   bool ok = WriteFully(fd, &headerBlock[0], headerBytes, 0) ;
+   off_t offset = off_t(headerBytes) ;
+   for (size_t i=0 ; ok && i<sections.size() ; ++i) {
+      ok = WriteFully(fd, sections[i].data, sections[i].bytes, offset) ;
+      offset = off_t(AlignCheckpoint(size_t(offset) + sections[i].bytes)) ;
+      checkpointStats.rawBytes += double(sections[i].bytes) ;
+   }
+   checkpointStats.storedBytes += double(offset) ;
+   CloseCheckpointTemp(fd, ok, offset, fname, tmpname) ;
+}
+
+/******************************************/
+
+// Runs on the I/O thread; touches nothing but the arena
+static void WriteCheckpointArena(CheckpointArena& arena, const char *base)
+{
+   char fname[1024], tmpname[1040] ;
+   int fd = OpenCheckpointTemp(base, arena.myRank, fname, tmpname) ;
+   if (fd < 0) {
+      return ;
+   }
+
+   Int8_t *sectionBytes =
+      reinterpret_cast<Int8_t *>(arena.data + sizeof(CheckpointHeader)) ;
+   size_t headerBytes =
+      AlignCheckpoint(sizeof(CheckpointHeader) + 2*arena.numSections*sizeof(Int8_t)) ;
+   bool ok = true ;
+   off_t offset ;
+
+#if LULESH_ZLIB
+   // Sections are compressed one at a time into a scratch buffer; a
+   // section that does not shrink is stored raw
+   std::vector<Bytef> packed ;
+   size_t src = headerBytes ;
+   offset = off_t(headerBytes) ;
+   for (Int_t i=0 ; ok && i<arena.numSections ; ++i) {
+      size_t raw = size_t(sectionBytes[2*i]) ;
+      uLongf stored = compressBound(uLong(raw)) ;
+      packed.resize(stored > 0 ? stored : 1) ;
+      const char *out = arena.data + src ;
+      if ((raw > 0) &&
+          (compress2(&packed[0], &stored, reinterpret_cast<const Bytef *>(out),
+                     uLong(raw), 1) == Z_OK) &&
+          (size_t(stored) < raw)) {
+         out = reinterpret_cast<const char *>(&packed[0]) ;
+      }
+      else {
+         stored = uLongf(raw) ;
+      }
+      sectionBytes[2*i+1] = Int8_t(stored) ;
+      ok = WriteFully(fd, out, size_t(stored), offset) ;
+      offset = off_t(AlignCheckpoint(size_t(offset) + size_t(stored))) ;
+      src = AlignCheckpoint(src + raw) ;
+   }
+   // The header goes last, once the stored lengths are known
+   ok = ok && WriteFully(fd, arena.data, headerBytes, 0) ;
+#else
+   // The arena is the file image: one write
+   (void) sectionBytes ;
+   (void) headerBytes ;
+   ok = WriteFully(fd, arena.data, arena.size, 0) ;
+   offset = off_t(arena.size) ;
+#endif
+
+   CloseCheckpointTemp(fd, ok, offset, fname, tmpname) ;
+
+   pthread_mutex_lock(&checkpointLock) ;
+   checkpointStats.storedBytes += double(offset) ;
+   pthread_mutex_unlock(&checkpointLock) ;
+}
+
+/******************************************/
+
+static void *CheckpointWriterThread(void *)
+{
+   pthread_mutex_lock(&checkpointLock) ;
+   for (;;) {
+      while ((checkpointQueued == 0) && !checkpointQuit) {
+         pthread_cond_wait(&checkpointCond, &checkpointLock) ;
+      }
+      if (checkpointQueued == 0) {
+         break ;
+      }
+      Int_t a = checkpointQueue[0] ;
+      pthread_mutex_unlock(&checkpointLock) ;
+
+      double start = CheckpointClock() ;
+      WriteCheckpointArena(checkpointArena[a], checkpointBase) ;
+      double elapsed = CheckpointClock() - start ;
+
+      pthread_mutex_lock(&checkpointLock) ;
+      checkpointStats.background += elapsed ;
+      checkpointQueue[0] = checkpointQueue[1] ;
+      --checkpointQueued ;
+      checkpointArena[a].busy = false ;
+      pthread_cond_broadcast(&checkpointCond) ;
+   }
+   pthread_mutex_unlock(&checkpointLock) ;
+   return NULL ;
+}
+
+/******************************************/
+
+// Large copies are split in fixed chunks over the threads
+static void CopyCheckpointSection(char *dst, const char *src, size_t bytes)
+{
+   Int8_t numChunks = Int8_t((bytes + CHECKPOINT_COPY_CHUNK - 1)/CHECKPOINT_COPY_CHUNK) ;
+#pragma omp parallel for firstprivate(dst, src, bytes) if (numChunks > 1)
+   for (Int8_t c=0 ; c<numChunks ; ++c) {
+      size_t begin = size_t(c)*CHECKPOINT_COPY_CHUNK ;
+      size_t len = MIN(CHECKPOINT_COPY_CHUNK, bytes - begin) ;
+      memcpy(dst + begin, src + begin, len) ;
+   }
+}
+
+/******************************************/
+
+// Copy the sections into the arena with every thread, zeroing the
+// alignment padding so the image matches a blocking write byte for byte
+static void SnapshotCheckpoint(CheckpointArena& arena,
+                               const std::vector<CheckpointSection>& sections,
+                               const std::vector<char>& headerBlock)
+{
+   size_t size = headerBlock.size() ;
+   for (size_t i=0 ; i<sections.size() ; ++i) {
+      size = AlignCheckpoint(size + sections[i].bytes) ;
+   }
+
+   if (size > arena.capacity) {
+      free(arena.data) ;
+      if (posix_memalign(reinterpret_cast<void **>(&arena.data),
+                         CHECKPOINT_ALIGN, size) != 0) {
+         fprintf(stderr, "Unable to allocate %zu byte checkpoint arena\n", size) ;
+#if USE_MPI
+         MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+         exit(-1) ;
+#endif
+      }
+      arena.capacity = size ;
+   }
+   arena.size = size ;
+   arena.numSections = Int_t(sections.size()) ;
+
+   memcpy(arena.data, &headerBlock[0], headerBlock.size()) ;
+   size_t offset = headerBlock.size() ;
+   for (size_t i=0 ; i<sections.size() ; ++i) {
+      char *dst = arena.data + offset ;
+      const char *src = static_cast<const char *>(sections[i].data) ;
+      size_t bytes = sections[i].bytes ;
+      CopyCheckpointSection(dst, src, bytes) ;
+      offset = AlignCheckpoint(offset + bytes) ;
+      memset(dst + bytes, 0, offset - (size_t(dst - arena.data) + bytes)) ;
+      checkpointStats.rawBytes += double(bytes) ;
+   }
+}
+
+/******************************************/
+
+static void WriteCheckpointAsync(Domain& domain, const char *base,
+                                 Int_t myRank, Int_t numRanks)
+{
+   if (!checkpointThreadRunning) {
+      snprintf(checkpointBase, sizeof(checkpointBase), "%s", base) ;
+      checkpointQuit = false ;
+      if (pthread_create(&checkpointThread, NULL, CheckpointWriterThread, NULL) != 0) {
+         fprintf(stderr, "Unable to start checkpoint thread, writing in place\n") ;
+         WriteCheckpointBlocking(domain, base, myRank, numRanks) ;
+         return ;
+      }
+      checkpointThreadRunning = true ;
+   }
+
+   // Double buffering: wait only if the arena taken two checkpoints ago
+   // is still being written
+   CheckpointArena& arena = checkpointArena[checkpointNext] ;
+   double start = CheckpointClock() ;
+   pthread_mutex_lock(&checkpointLock) ;
+   while (arena.busy) {
+      pthread_cond_wait(&checkpointCond, &checkpointLock) ;
+   }
+   pthread_mutex_unlock(&checkpointLock) ;
+   checkpointStats.wait += CheckpointClock() - start ;
+
+   std::vector<CheckpointSection> sections ;
+   CheckpointSections(domain, sections) ;
+   std::vector<char> headerBlock ;
+   BuildCheckpointHeader(domain, sections, myRank, numRanks, headerBlock) ;
+   arena.myRank = myRank ;
+   SnapshotCheckpoint(arena, sections, headerBlock) ;
+
+   pthread_mutex_lock(&checkpointLock) ;
+   arena.busy = true ;
+   checkpointQueue[checkpointQueued++] = checkpointNext ;
+   pthread_cond_broadcast(&checkpointCond) ;
+   pthread_mutex_unlock(&checkpointLock) ;
+
+   checkpointNext = 1 - checkpointNext ;
+}
+
+/******************************************/
+
+void WriteCheckpoint(Domain& domain, const char *base, Int_t myRank,
+                     Int_t numRanks, bool async)
+{
+   SCOPED_TIMER(TimerCheckpoint) ;
+
+   double start = CheckpointClock() ;
+   if (async) {
+      WriteCheckpointAsync(domain, base, myRank, numRanks) ;
+   }
+   else {
+      WriteCheckpointBlocking(domain, base, myRank, numRanks) ;
+   }
+   checkpointStats.visible += CheckpointClock() - start ;
+   ++checkpointStats.count ;
+}
+
+/******************************************/
+
+void FinishCheckpoints(Int_t myRank, Int_t numRanks, bool report)
+{
+   if (checkpointThreadRunning) {
+      pthread_mutex_lock(&checkpointLock) ;
+      checkpointQuit = true ;
+      pthread_cond_broadcast(&checkpointCond) ;
+      pthread_mutex_unlock(&checkpointLock) ;
+      pthread_join(checkpointThread, NULL) ;
+      checkpointThreadRunning = false ;
+   }
+   for (Int_t a=0 ; a<2 ; ++a) {
+      free(checkpointArena[a].data) ;
+      checkpointArena[a].data = NULL ;
+      checkpointArena[a].capacity = 0 ;
+   }
+
+   if (!report || (checkpointStats.count == 0)) {
+      return ;
+   }
+
+   // Times are the slowest rank's, volumes the sum over ranks
+   double times[3] = { checkpointStats.visible, checkpointStats.wait,
+                       checkpointStats.background } ;
+   double bytes[2] = { checkpointStats.rawBytes, checkpointStats.storedBytes } ;
+#if USE_MPI
+   double timesMax[3], bytesSum[2] ;
+   MPI_Reduce(times, timesMax, 3, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(bytes, bytesSum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) ;
+   memcpy(times, timesMax, sizeof(times)) ;
+   memcpy(bytes, bytesSum, sizeof(bytes)) ;
+#endif
+
+   if (myRank == 0) {
+      printf("Checkpoints: %d written by %d ranks\n", checkpointStats.count, numRanks) ;
+      printf("   Visible to timestep loop = %10.4f s (waiting for buffer %.4f s)\n",
+             times[0], times[1]) ;
+      if (times[2] > 0.0) {
+         printf("   Background write         = %10.4f s\n", times[2]) ;
+      }
+      printf("   State %.1f MB, on disk %.1f MB\n\n",
+             bytes[0]/1.0e6, bytes[1]/1.0e6) ;
+   }
+}
+
+/******************************************/
+
+void ReadCheckpoint(Domain& domain, const char *base, Int_t myRank, Int_t numRanks,
+                    bool report)
+{
+   char fname[1024] ;
+   CheckpointFileName(fname, sizeof(fname), base, myRank) ;
+   double start = CheckpointClock() ;
+
+   int fd = open(fname, O_RDONLY) ;
+   struct stat st ;
+   if ((fd < 0) || (fstat(fd, &st) != 0)) {
+      CheckpointAbort("Unable to open checkpoint", fname) ;
+   }
+   size_t fileBytes = size_t(st.st_size) ;
+   if (fileBytes < sizeof(CheckpointHeader)) {
+      CheckpointAbort("Not a LULESH checkpoint:", fname) ;
+   }
+
+   int mapFlags = MAP_PRIVATE ;
+#ifdef MAP_POPULATE
+   mapFlags |= MAP_POPULATE ;
+#endif
+   void *map = mmap(NULL, fileBytes, PROT_READ, mapFlags, fd, 0) ;
+   close(fd) ;
+   if (map == MAP_FAILED) {
+      CheckpointAbort("Unable to map checkpoint", fname) ;
+   }
+   const char *image = static_cast<const char *>(map) ;
+
+   CheckpointHeader header ;
+   memcpy(&header, image, sizeof(header)) ;
+   if ((memcmp(header.magic, checkpointMagic, 8) != 0) ||
+       (header.version != CHECKPOINT_VERSION)) {
+      CheckpointAbort("Not a LULESH checkpoint:", fname) ;
+   }
+   if ((header.realBytes != Int_t(sizeof(Real_t))) ||
+       (header.indexBytes != Int_t(sizeof(Index_t))) ||
+       (header.numRanks != numRanks) || (header.rank != myRank) ||
+       (header.numReg != domain.numReg()) ||
+       (header.migrate != ((domain.regMigrateInterval() > 0) ? 1 : 0)) ||
+       (header.numElem != domain.numElem()) ||
+       (header.numNode != domain.numNode())) {
+      CheckpointAbort("Checkpoint was written with different -s, -r, -a or rank count:", fname) ;
+   }
+
+   size_t headerBytes = AlignCheckpoint(sizeof(header) + 2*header.numSections*sizeof(Int8_t)) ;
+   if ((header.numSections < 0) || (headerBytes > fileBytes)) {
+      CheckpointAbort("Truncated checkpoint", fname) ;
+   }
+   std::vector<Int8_t> sectionBytes(2*header.numSections) ;
+   memcpy(&sectionBytes[0], image + sizeof(header), 2*header.numSections*sizeof(Int8_t)) ;
+
+   // Without migration the region lists keep the sizes the domain was
+   // built with; with it a region may hold up to every element
+   std::vector<Index_t> capacity(domain.numReg()) ;
+   for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+      capacity[r] = (header.migrate != 0) ? domain.numElem() : domain.regElemSize(r) ;
+   }
+
+   std::vector<CheckpointSection> sections ;
+   CheckpointSections(domain, sections) ;
+   size_t numFixed = sections.size() - domain.numReg() ;
+   if (size_t(header.numSections) != sections.size()) {
+      CheckpointAbort("Corrupt checkpoint section table in", fname) ;
+   }
+
+   size_t offset = headerBytes ;
+   for (size_t i=0 ; i<sections.size() ; ++i) {
+      if (i == numFixed) {
+         // regElemSize has been restored; size the region lists from it
+         for (Int_t r=0 ; r<domain.numReg() ; ++r) {
+            if ((domain.regElemSize(r) < 0) || (domain.regElemSize(r) > capacity[r])) {
+               CheckpointAbort("Corrupt checkpoint region sizes in", fname) ;
+            }
+            if (header.migrate != 0) {
+               domain.ReserveRegionElems(r, domain.regElemSize(r)) ;
+            }
+         }
+         CheckpointSections(domain, sections) ;
+      }
+      size_t stored = size_t(sectionBytes[2*i+1]) ;
+      if (Int8_t(sections[i].bytes) != sectionBytes[2*i]) {
+         CheckpointAbort("Mismatched checkpoint section in", fname) ;
+      }
+      if ((stored > fileBytes) || (offset > fileBytes - stored)) {
+         CheckpointAbort("Truncated checkpoint", fname) ;
+      }
+      if (stored == sections[i].bytes) {
+         CopyCheckpointSection(static_cast<char *>(sections[i].data),
+                               image + offset, stored) ;
+      }
+      else {
+#if LULESH_ZLIB
+         // Compressed sections inflate straight from the mapping
+         uLongf raw = uLongf(sections[i].bytes) ;
+         if ((uncompress(static_cast<Bytef *>(sections[i].data), &raw,
+                         reinterpret_cast<const Bytef *>(image + offset),
+                         uLong(stored)) != Z_OK) ||
+             (size_t(raw) != sections[i].bytes)) {
+            CheckpointAbort("Corrupt compressed checkpoint", fname) ;
+         }
+#else
+         CheckpointAbort("Reading a compressed checkpoint requires compiling with -DLULESH_ZLIB:", fname) ;
+#endif
+      }
+      offset = AlignCheckpoint(offset + stored) ;
+   }
+   munmap(map, fileBytes) ;
+
+   domain.cycle()           = header.cycle ;
+   domain.time()            = header.time ;
+   domain.deltatime()       = header.deltatime ;
+   domain.deltatimemultlb() = header.deltatimemultlb ;
+   domain.deltatimemultub() = header.deltatimemultub ;
+   domain.stoptime()        = header.stoptime ;
+   domain.dtcourant()       = header.dtcourant ;
+   domain.dthydro()         = header.dthydro ;
+   domain.dtmax()           = header.dtmax ;
+   domain.dtfixed()         = header.dtfixed ;
+
+   if (!report) {
+      return ;
+   }
+
+   // Slowest rank's time, total volume
+   double elapsed = CheckpointClock() - start ;
+   double bytes = double(fileBytes) ;
+#if USE_MPI
+   double elapsedMax, bytesSum ;
+   MPI_Reduce(&elapsed, &elapsedMax, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(&bytes, &bytesSum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) ;
+   elapsed = elapsedMax ;
+   bytes = bytesSum ;
+#endif
+   if (myRank == 0) {
+      printf("Restart: cycle %d, %.1f MB read in %.4f s (%.2f GB/s)\n\n",
+             int(header.cycle), bytes/1.0e6, elapsed,
+             (elapsed > 0.0) ? bytes/elapsed/1.0e9 : 0.0) ;
+   }
+}
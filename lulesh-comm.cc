@@ -1,6 +1,54 @@
 #include "lulesh.h"
 
-// If no MPI, then this whole file is stubbed out
+/* Element fields (planeOnly messages) are packed in lattice order,
+   which differs from storage order when elements are region-sorted */
+static inline
+Index_t SendIndex(Domain& domain, bool elemData, Index_t idx)
+{
+   return elemData ? domain.spatialElem(idx) : idx ;
+}
+
+/******************************************/
+
+/* One face of the block is an n0 x n1 grid of points at
+   base + i*stride0 + j*stride1.  These copy xferFields fields over it
+   to and from a message, field after field.  They need no MPI, so
+   lulesh-bench times them in serial builds too */
+
+void CommPackFace(Domain& domain, Index_t xferFields,
+                  Domain_member *fieldData, Real_t *destAddr,
+                  Index_t base, Index_t n0, Index_t stride0,
+                  Index_t n1, Index_t stride1, bool elemData)
+{
+   for (Index_t fi=0 ; fi<xferFields; ++fi) {
+      Domain_member src = fieldData[fi] ;
+      for (Index_t i=0; i<n0; ++i) {
+         for (Index_t j=0; j<n1; ++j) {
+            destAddr[i*n1 + j] = (domain.*src)(SendIndex(domain, elemData,
+                                    base + i*stride0 + j*stride1)) ;
+         }
+      }
+      destAddr += n0*n1 ;
+   }
+}
+
+void CommUnpackFaceSum(Domain& domain, Index_t xferFields,
+                       Domain_member *fieldData, const Real_t *srcAddr,
+                       Index_t base, Index_t n0, Index_t stride0,
+                       Index_t n1, Index_t stride1)
+{
+   for (Index_t fi=0 ; fi<xferFields; ++fi) {
+      Domain_member dest = fieldData[fi] ;
+      for (Index_t i=0; i<n0; ++i) {
+         for (Index_t j=0; j<n1; ++j) {
+            (domain.*dest)(base + i*stride0 + j*stride1) += srcAddr[i*n1 + j] ;
+         }
+      }
+      srcAddr += n0*n1 ;
+   }
+}
+
+// If no MPI, then the rest of this file is stubbed out
 #if USE_MPI
 
 #include <mpi.h>
@@ -55,11 +103,139 @@
 /******************************************/
 
 
+/* Halo exchanges of a file mesh.  The lists built with the mesh pair
+   up by position, so messages are packed in list order with no
+   addressing.  Shared node values are summed over all owners in
+   ascending rank order, which gives every owner the same bits */
+
+static void CommHaloSum(Domain& domain, Int_t xferFields,
+                        Domain_member *fieldData)
+{
+   int myRank ;
+   Int_t numNbr = Int_t(domain.haloRanks.size()) ;
+   Index_t numHalo = Index_t(domain.haloNodes.size()) ;
+   Index_t numMsg = domain.haloNodeStart[numNbr] ;
+   MPI_Datatype baseType = ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE) ;
+   std::vector<Real_t> own(numHalo*xferFields) ;
+   std::vector<Real_t> sum(numHalo*xferFields, Real_t(0.0)) ;
+   std::vector<Real_t> sendBuf(numMsg*xferFields) ;
+   std::vector<Real_t> recvBuf(numMsg*xferFields) ;
+   std::vector<MPI_Request> request(2*numNbr) ;
+
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank) ;
+
+   for (Index_t k=0 ; k<numHalo ; ++k) {
+      for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+         own[k*xferFields + fi] = (domain.*fieldData[fi])(domain.haloNodes[k]) ;
+      }
+   }
+
+   for (Int_t n=0 ; n<numNbr ; ++n) {
+      Index_t start = domain.haloNodeStart[n] ;
+      Index_t count = domain.haloNodeStart[n+1] - start ;
+      MPI_Irecv(&recvBuf[start*xferFields], count*xferFields, baseType,
+                domain.haloRanks[n], MSG_COMM_SBN, MPI_COMM_WORLD,
+                &request[n]) ;
+   }
+   for (Int_t n=0 ; n<numNbr ; ++n) {
+      Index_t start = domain.haloNodeStart[n] ;
+      Index_t count = domain.haloNodeStart[n+1] - start ;
+      for (Index_t k=start ; k<start+count ; ++k) {
+         Index_t pos = domain.haloNodePos[k] ;
+         for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+            sendBuf[k*xferFields + fi] = own[pos*xferFields + fi] ;
+         }
+      }
+      MPI_Isend(&sendBuf[start*xferFields], count*xferFields, baseType,
+                domain.haloRanks[n], MSG_COMM_SBN, MPI_COMM_WORLD,
+                &request[numNbr + n]) ;
+   }
+   MPI_Waitall(numNbr, &request[0], MPI_STATUSES_IGNORE) ;
+
+   bool ownAdded = false ;
+   for (Int_t n=0 ; n<=numNbr ; ++n) {
+      if (!ownAdded && ((n == numNbr) || (domain.haloRanks[n] > myRank))) {
+         for (Index_t k=0 ; k<numHalo*xferFields ; ++k) {
+            sum[k] += own[k] ;
+         }
+         ownAdded = true ;
+      }
+      if (n == numNbr) {
+         break ;
+      }
+      for (Index_t k=domain.haloNodeStart[n] ; k<domain.haloNodeStart[n+1] ; ++k) {
+         Index_t pos = domain.haloNodePos[k] ;
+         for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+            sum[pos*xferFields + fi] += recvBuf[k*xferFields + fi] ;
+         }
+      }
+   }
+
+   for (Index_t k=0 ; k<numHalo ; ++k) {
+      for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+         (domain.*fieldData[fi])(domain.haloNodes[k]) = sum[k*xferFields + fi] ;
+      }
+   }
+
+   MPI_Waitall(numNbr, &request[numNbr], MPI_STATUSES_IGNORE) ;
+}
+
+/******************************************/
+
+/* Element values read across a face land in the ghost slots past
+   numElem, grouped by neighbor rank */
+static void CommHaloElem(Domain& domain, Int_t xferFields,
+                         Domain_member *fieldData)
+{
+   Int_t numNbr = Int_t(domain.haloRanks.size()) ;
+   Index_t numElem = domain.numElem() ;
+   Index_t numSend = domain.haloSendStart[numNbr] ;
+   Index_t numRecv = domain.haloRecvStart[numNbr] ;
+   MPI_Datatype baseType = ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE) ;
+   std::vector<Real_t> sendBuf(numSend*xferFields) ;
+   std::vector<Real_t> recvBuf(numRecv*xferFields) ;
+   std::vector<MPI_Request> request(2*numNbr) ;
+
+   for (Int_t n=0 ; n<numNbr ; ++n) {
+      Index_t start = domain.haloRecvStart[n] ;
+      Index_t count = domain.haloRecvStart[n+1] - start ;
+      MPI_Irecv(&recvBuf[start*xferFields], count*xferFields, baseType,
+                domain.haloRanks[n], MSG_MONOQ, MPI_COMM_WORLD,
+                &request[n]) ;
+   }
+   for (Int_t n=0 ; n<numNbr ; ++n) {
+      Index_t start = domain.haloSendStart[n] ;
+      Index_t count = domain.haloSendStart[n+1] - start ;
+      for (Index_t k=start ; k<start+count ; ++k) {
+         Index_t elem = domain.haloSendElem[k] ;
+         for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+            sendBuf[k*xferFields + fi] = (domain.*fieldData[fi])(elem) ;
+         }
+      }
+      MPI_Isend(&sendBuf[start*xferFields], count*xferFields, baseType,
+                domain.haloRanks[n], MSG_MONOQ, MPI_COMM_WORLD,
+                &request[numNbr + n]) ;
+   }
+   MPI_Waitall(numNbr, &request[0], MPI_STATUSES_IGNORE) ;
+
+   for (Index_t k=0 ; k<numRecv ; ++k) {
+      for (Int_t fi=0 ; fi<xferFields ; ++fi) {
+         (domain.*fieldData[fi])(numElem + k) = recvBuf[k*xferFields + fi] ;
+      }
+   }
+
+   MPI_Waitall(numNbr, &request[numNbr], MPI_STATUSES_IGNORE) ;
+}
+
+/******************************************/
+
 /* doRecv flag only works with regular block structure */
 void CommRecv(Domain& domain, Int_t msgType, Index_t xferFields,
               Index_t dx, Index_t dy, Index_t dz, bool doRecv, bool planeOnly) {
+   SCOPED_TIMER(TimerCommRecv) ;
 
-   if (domain.numRanks() == 1)
+   /* file meshes exchange through their halo lists in CommSBN and CommMonoQ */
+   if ((domain.numRanks() == 1) || domain.unstructured())
       return ;
 
    /* post recieve buffers for all incoming messages */
@@ -358,8 +534,9 @@ void CommSend(Domain& domain, Int_t msgType,
               Index_t xferFields, Domain_member *fieldData,
               Index_t dx, Index_t dy, Index_t dz, bool doSend, bool planeOnly)
 {
+   SCOPED_TIMER(TimerCommSend) ;
 
-   if (domain.numRanks() == 1)
+   if ((domain.numRanks() == 1) || domain.unstructured())
       return ;
 
    /* post recieve buffers for all incoming messages */
@@ -408,14 +585,8 @@ void CommSend(Domain& domain, Int_t msgType,
 
       if (planeMin) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<sendCount; ++i) {
-               destAddr[i] = (domain.*src)(i) ;
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      0, dy, dx, dx, 1, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank - domain.tp()*domain.tp(), msgType,
@@ -424,14 +595,8 @@ void CommSend(Domain& domain, Int_t msgType,
       }
       if (planeMax && doSend) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<sendCount; ++i) {
-               destAddr[i] = (domain.*src)(dx*dy*(dz - 1) + i) ;
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      dx*dy*(dz - 1), dy, dx, dx, 1, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank + domain.tp()*domain.tp(), msgType,
@@ -445,16 +610,8 @@ void CommSend(Domain& domain, Int_t msgType,
 
       if (rowMin) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dx; ++j) {
-                  destAddr[i*dx+j] = (domain.*src)(i*dx*dy + j) ;
-               }
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      0, dz, dx*dy, dx, 1, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank - domain.tp(), msgType,
@@ -463,16 +620,8 @@ void CommSend(Domain& domain, Int_t msgType,
       }
       if (rowMax && doSend) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dx; ++j) {
-                  destAddr[i*dx+j] = (domain.*src)(dx*(dy - 1) + i*dx*dy + j) ;
-               }
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      dx*(dy - 1), dz, dx*dy, dx, 1, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank + domain.tp(), msgType,
@@ -486,16 +635,8 @@ void CommSend(Domain& domain, Int_t msgType,
 
       if (colMin) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dy; ++j) {
-                  destAddr[i*dy + j] = (domain.*src)(i*dx*dy + j*dx) ;
-               }
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      0, dz, dx*dy, dy, dx, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank - 1, msgType,
@@ -504,16 +645,8 @@ void CommSend(Domain& domain, Int_t msgType,
       }
       if (colMax && doSend) {
          destAddr = &domain.commDataSend[pmsg * maxPlaneComm] ;
-         for (Index_t fi=0; fi<xferFields; ++fi) {
-            Domain_member src = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dy; ++j) {
-                  destAddr[i*dy + j] = (domain.*src)(dx - 1 + i*dx*dy + j*dx) ;
-               }
-            }
-            destAddr += sendCount ;
-         }
-         destAddr -= xferFields*sendCount ;
+         CommPackFace(domain, xferFields, fieldData, destAddr,
+                      dx - 1, dz, dx*dy, dy, dx, planeOnly) ;
 
          MPI_Isend(destAddr, xferFields*sendCount, baseType,
                    myRank + 1, msgType,
@@ -846,10 +979,16 @@ void CommSend(Domain& domain, Int_t msgType,
 /******************************************/
 
 void CommSBN(Domain& domain, Int_t xferFields, Domain_member *fieldData) {
+   SCOPED_TIMER(TimerCommSBN) ;
 
    if (domain.numRanks() == 1)
       return ;
 
+   if (domain.unstructured()) {
+      CommHaloSum(domain, xferFields, fieldData) ;
+      return ;
+   }
+
    /* summation order should be from smallest value to largest */
    /* or we could try out kahan summation! */
 
@@ -890,103 +1029,59 @@ void CommSBN(Domain& domain, Int_t xferFields, Domain_member *fieldData) {
 
    if (planeMin | planeMax) {
       /* ASSUMING ONE DOMAIN PER RANK, CONSTANT BLOCK SIZE HERE */
-      Index_t opCount = dx * dy ;
-
       if (planeMin) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<opCount; ++i) {
-               (domain.*dest)(i) += srcAddr[i] ;
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           0, dy, dx, dx, 1) ;
          ++pmsg ;
       }
       if (planeMax) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<opCount; ++i) {
-               (domain.*dest)(dx*dy*(dz - 1) + i) += srcAddr[i] ;
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           dx*dy*(dz - 1), dy, dx, dx, 1) ;
          ++pmsg ;
       }
    }
 
    if (rowMin | rowMax) {
       /* ASSUMING ONE DOMAIN PER RANK, CONSTANT BLOCK SIZE HERE */
-      Index_t opCount = dx * dz ;
-
       if (rowMin) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dx; ++j) {
-                  (domain.*dest)(i*dx*dy + j) += srcAddr[i*dx + j] ;
-               }
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           0, dz, dx*dy, dx, 1) ;
          ++pmsg ;
       }
       if (rowMax) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dx; ++j) {
-                  (domain.*dest)(dx*(dy - 1) + i*dx*dy + j) += srcAddr[i*dx + j] ;
-               }
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           dx*(dy - 1), dz, dx*dy, dx, 1) ;
          ++pmsg ;
       }
    }
    if (colMin | colMax) {
       /* ASSUMING ONE DOMAIN PER RANK, CONSTANT BLOCK SIZE HERE */
-      Index_t opCount = dy * dz ;
-
       if (colMin) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dy; ++j) {
-                  (domain.*dest)(i*dx*dy + j*dx) += srcAddr[i*dy + j] ;
-               }
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           0, dz, dx*dy, dy, dx) ;
          ++pmsg ;
       }
       if (colMax) {
          /* contiguous memory */
          srcAddr = &domain.commDataRecv[pmsg * maxPlaneComm] ;
          MPI_Wait(&domain.recvRequest[pmsg], &status) ;
-         for (Index_t fi=0 ; fi<xferFields; ++fi) {
-            Domain_member dest = fieldData[fi] ;
-            for (Index_t i=0; i<dz; ++i) {
-               for (Index_t j=0; j<dy; ++j) {
-                  (domain.*dest)(dx - 1 + i*dx*dy + j*dx) += srcAddr[i*dy + j] ;
-               }
-            }
-            srcAddr += opCount ;
-         }
+         CommUnpackFaceSum(domain, xferFields, fieldData, srcAddr,
+                           dx - 1, dz, dx*dy, dy, dx) ;
          ++pmsg ;
       }
    }
@@ -1259,8 +1354,11 @@ void CommSBN(Domain& domain, Int_t xferFields, Domain_member *fieldData) {
 /******************************************/
 
 void CommSyncPosVel(Domain& domain) {
+   SCOPED_TIMER(TimerCommSyncPosVel) ;
 
-   if (domain.numRanks() == 1)
+   /* shared nodes of a file mesh see identical summed forces on every
+      owner, so their positions already agree */
+   if ((domain.numRanks() == 1) || domain.unstructured())
       return ;
 
    int myRank ;
@@ -1683,9 +1781,18 @@ void CommSyncPosVel(Domain& domain) {
 
 void CommMonoQ(Domain& domain)
 {
+   SCOPED_TIMER(TimerCommMonoQ) ;
+
    if (domain.numRanks() == 1)
       return ;
 
+   if (domain.unstructured()) {
+      Domain_member haloData[3] = { &Domain::delv_xi, &Domain::delv_eta,
+                                    &Domain::delv_zeta } ;
+      CommHaloElem(domain, 3, haloData) ;
+      return ;
+   }
+
    int myRank ;
    Index_t xferFields = 3 ; /* delv_xi, delv_eta, delv_zeta */
    Domain_member fieldData[3] ;
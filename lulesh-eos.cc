@@ -0,0 +1,187 @@
+#include <math.h>
+#if USE_MPI
+# include <mpi.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lulesh.h"
+
+/*
+   Tabulated equation of state support.  The table holds p(rho,e) and
+   c^2(rho,e) on a grid that is log-spaced in both the relative density
+   and the specific internal energy.  Both quantities for one grid node
+   are stored next to each other, with energy varying fastest, so the
+   four (bilinear) or sixteen (bicubic) nodes touched by one lookup sit
+   in two or four short runs of cache lines.  The default grid is
+   128x128, i.e. 256KB, which stays resident in a typical L2.
+
+   File format (native endianness):
+
+      char    magic[8]      "LULEOS1\0"
+      Int_t   numRho, numE
+      Real_t  logRhoMin, logRhoMax, logEMin, logEMax
+      Real_t  data[numRho*numE*2]
+*/
+
+static const char eosMagic[8] = { 'L', 'U', 'L', 'E', 'O', 'S', '1', '\0' } ;
+
+/******************************************/
+
+static EOSTable *AllocateEOSTable(Int_t numRho, Int_t numE,
+                                  Real_t logRhoMin, Real_t logRhoMax,
+                                  Real_t logEMin, Real_t logEMax)
+{
+   EOSTable *table = new EOSTable ;
+
+   table->numRho = numRho ;
+   table->numE = numE ;
+   table->logRhoMin = logRhoMin ;
+   table->logRhoMax = logRhoMax ;
+   table->logEMin = logEMin ;
+   table->logEMax = logEMax ;
+   table->invDLogRho = Real_t(numRho-1) / (logRhoMax - logRhoMin) ;
+   table->invDLogE = Real_t(numE-1) / (logEMax - logEMin) ;
+
+   table->rho  = Allocate<Real_t>(numRho) ;
+   table->e    = Allocate<Real_t>(numE) ;
+   table->data = Allocate<Real_t>(Index_t(2)*numRho*numE) ;
+
+   // Node values are kept explicitly so the interpolation weights are
+   // computed in linear (not log) space.  This makes bilinear lookups
+   // exact for an ideal gas, where p is bilinear in rho and e.
+   for (Int_t i=0 ; i<numRho ; ++i) {
+      table->rho[i] = exp(logRhoMin + Real_t(i)/table->invDLogRho) ;
+   }
+   for (Int_t j=0 ; j<numE ; ++j) {
+      table->e[j] = exp(logEMin + Real_t(j)/table->invDLogE) ;
+   }
+
+   return table ;
+}
+
+/******************************************/
+
+EOSTable *CreateIdealGasEOSTable(Int_t numRho, Int_t numE, Real_t gamma)
+{
+   EOSTable *table = AllocateEOSTable(numRho, numE,
+                                      log(Real_t(1.0e-4)), log(Real_t(1.0e+4)),
+                                      log(Real_t(1.0e-6)), log(Real_t(1.0e+14))) ;
+
+   for (Int_t i=0 ; i<numRho ; ++i) {
+      for (Int_t j=0 ; j<numE ; ++j) {
+         Real_t *node = &table->data[2*(Index_t(i)*numE + j)] ;
+         node[0] = (gamma - Real_t(1.0)) * table->rho[i] * table->e[j] ;
+         node[1] = gamma * (gamma - Real_t(1.0)) * table->e[j] ;
+      }
+   }
+
+   return table ;
+}
+
+/******************************************/
+
+EOSTable *ReadEOSTable(const char *fname, Int_t myRank)
+{
+   Int_t   dims[2] = { 0, 0 } ;
+   Real_t  bounds[4] = { 0., 0., 0., 0. } ;
+   FILE   *fp = NULL ;
+   bool    ok = true ;
+
+   if (myRank == 0) {
+      char magic[8] ;
+      fp = fopen(fname, "rb") ;
+      ok = (fp != NULL) &&
+           (fread(magic, 1, 8, fp) == 8) &&
+           (memcmp(magic, eosMagic, 8) == 0) &&
+           (fread(dims, sizeof(Int_t), 2, fp) == 2) &&
+           (fread(bounds, sizeof(Real_t), 4, fp) == 4) &&
+           (dims[0] >= 4) && (dims[1] >= 4) ;
+   }
+
+#if USE_MPI
+   Int_t flag = ok ? 1 : 0 ;
+   MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD) ;
+   ok = (flag != 0) ;
+#endif
+
+   if (!ok) {
+      if (myRank == 0) {
+         fprintf(stderr, "Unable to read EOS table from %s\n", fname) ;
+      }
+#if USE_MPI
+      MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+      exit(-1) ;
+#endif
+   }
+
+#if USE_MPI
+   MPI_Bcast(dims, 2, MPI_INT, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(bounds, 4, ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE),
+             0, MPI_COMM_WORLD) ;
+#endif
+
+   EOSTable *table = AllocateEOSTable(dims[0], dims[1],
+                                      bounds[0], bounds[1],
+                                      bounds[2], bounds[3]) ;
+   size_t count = size_t(2)*dims[0]*dims[1] ;
+
+   if (myRank == 0) {
+      ok = (fread(table->data, sizeof(Real_t), count, fp) == count) ;
+      fclose(fp) ;
+      if (!ok) {
+         fprintf(stderr, "Truncated EOS table in %s\n", fname) ;
+#if USE_MPI
+         MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+         exit(-1) ;
+#endif
+      }
+   }
+
+#if USE_MPI
+   MPI_Bcast(table->data, int(count),
+             ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE),
+             0, MPI_COMM_WORLD) ;
+#endif
+
+   return table ;
+}
+
+/******************************************/
+
+void WriteEOSTable(const EOSTable *table, const char *fname)
+{
+   FILE *fp = fopen(fname, "wb") ;
+   if (fp == NULL) {
+      fprintf(stderr, "Unable to open %s to write EOS table\n", fname) ;
+      return ;
+   }
+
+   Int_t  dims[2] = { table->numRho, table->numE } ;
+   Real_t bounds[4] = { table->logRhoMin, table->logRhoMax,
+                        table->logEMin,   table->logEMax } ;
+   size_t count = size_t(2)*dims[0]*dims[1] ;
+
+   if ((fwrite(eosMagic, 1, 8, fp) != 8) ||
+       (fwrite(dims, sizeof(Int_t), 2, fp) != 2) ||
+       (fwrite(bounds, sizeof(Real_t), 4, fp) != 4) ||
+       (fwrite(table->data, sizeof(Real_t), count, fp) != count)) {
+      fprintf(stderr, "Error writing EOS table to %s\n", fname) ;
+   }
+   fclose(fp) ;
+}
+
+/******************************************/
+
+void ReleaseEOSTable(EOSTable **table)
+{
+   if (*table != NULL) {
+      Release(&(*table)->data) ;
+      Release(&(*table)->e) ;
+      Release(&(*table)->rho) ;
+      delete *table ;
+      *table = NULL ;
+   }
+}
@@ -12,10 +12,17 @@
 #include <cstdlib>
 #include "lulesh.h"
 
+// Elements per independently seeded block of the region assignment.
+// Fixed (not per thread) so the assignment is reproducible; it is
+// larger than the longest run of one region (2048 elements)
+#define REGION_INIT_CHUNK 16384
+
 /////////////////////////////////////////////////////////////////////
 Domain::Domain(Int_t numRanks, Index_t colLoc,
                Index_t rowLoc, Index_t planeLoc,
-               Index_t nx, Int_t tp, Int_t nr, Int_t balance, Int_t cost)
+               Index_t nx, Int_t tp, Int_t nr, Int_t balance, Int_t cost,
+               Int_t sortRegions, Int_t migrateInterval, Real_t migrateFraction,
+               const HexMesh *mesh)
    :
    m_e_cut(Real_t(1.0e-7)),
    m_p_cut(Real_t(1.0e-7)),
@@ -40,16 +47,27 @@ Domain::Domain(Int_t numRanks, Index_t colLoc,
 // set pointers to (potentially) "new'd" arrays to null to 
 // simplify deallocation.
 //
-   m_regNumList(0),
-   m_nodeElemStart(0),
-   m_nodeElemCornerList(0),
-   m_regElemSize(0),
-   m_regElemlist(0)
 #if USE_MPI
-   , 
    commDataSend(0),
-   commDataRecv(0)
+   commDataRecv(0),
 #endif
+   m_regElemSize(0),
+   m_regNumList(0),
+   m_regElemlist(0),
+   m_regElemCap(0),
+   m_regMigrateInterval(0),
+   m_regMaxMoves(0),
+   m_regElemPos(0),
+   m_regMoves(0),
+   m_eosTable(0),
+   m_delv_xi(0),
+   m_delv_eta(0),
+   m_delv_zeta(0),
+   m_delx_xi(0),
+   m_delx_eta(0),
+   m_delx_zeta(0),
+   m_nodeElemStart(0),
+   m_nodeElemCornerList(0)
 {
 
    Index_t edgeElems = nx ;
@@ -69,12 +87,21 @@ Domain::Domain(Int_t numRanks, Index_t colLoc,
    m_rowLoc   =   rowLoc ;
    m_planeLoc = planeLoc ;
    
-   m_sizeX = edgeElems ;
-   m_sizeY = edgeElems ;
-   m_sizeZ = edgeElems ;
-   m_numElem = edgeElems*edgeElems*edgeElems ;
-
-   m_numNode = edgeNodes*edgeNodes*edgeNodes ;
+   // A file mesh is cut into parts first; its rank is colLoc
+   std::vector<Int_t> meshPart ;
+   if (mesh != NULL) {
+      PartitionHexMesh(*mesh, colLoc, meshPart) ;
+   }
+   else {
+      m_sizeX = edgeElems ;
+      m_sizeY = edgeElems ;
+      m_sizeZ = edgeElems ;
+      m_numElem = edgeElems*edgeElems*edgeElems ;
+
+      m_numNode = edgeNodes*edgeNodes*edgeNodes ;
+      m_meshNumElem = m_numElem ;
+      m_numGhostElem = 2*(m_sizeX*m_sizeY + m_sizeX*m_sizeZ + m_sizeY*m_sizeZ) ;
+   }
 
    m_regNumList = new Index_t[numElem()] ;  // material indexset
 
@@ -84,56 +111,74 @@ Domain::Domain(Int_t numRanks, Index_t colLoc,
    // Node-centered 
    AllocateNodePersistent(numNode()) ;
 
-   SetupCommBuffers(edgeNodes);
+   if (mesh == NULL) {
+      SetupCommBuffers();
+   }
+
+   // Basic Field Initialization.  All setup loops use the same static
+   // partition as the kernels, so each thread touches its own slice first
+   Index_t numElem = this->numElem() ;
+   Index_t numNode = this->numNode() ;
 
-   // Basic Field Initialization 
-   for (Index_t i=0; i<numElem(); ++i) {
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0; i<numElem; ++i) {
       e(i) =  Real_t(0.0) ;
       p(i) =  Real_t(0.0) ;
       q(i) =  Real_t(0.0) ;
       ss(i) = Real_t(0.0) ;
-   }
-
-   // Note - v initializes to 1.0, not 0.0!
-   for (Index_t i=0; i<numElem(); ++i) {
+      // Note - v initializes to 1.0, not 0.0!
       v(i) = Real_t(1.0) ;
    }
 
-   for (Index_t i=0; i<numNode(); ++i) {
+#pragma omp parallel for firstprivate(numNode)
+   for (Index_t i=0; i<numNode; ++i) {
       xd(i) = Real_t(0.0) ;
       yd(i) = Real_t(0.0) ;
       zd(i) = Real_t(0.0) ;
-   }
 
-   for (Index_t i=0; i<numNode(); ++i) {
-      xdd(i) = Real_t(0.0) ;
-      ydd(i) = Real_t(0.0) ;
-      zdd(i) = Real_t(0.0) ;
-   }
-
-   for (Index_t i=0; i<numNode(); ++i) {
       nodalMass(i) = Real_t(0.0) ;
    }
 
-   BuildMesh(nx, edgeNodes, edgeElems);
-
-#if _OPENMP
-   SetupThreadSupportStructures();
-#endif
+   // A file mesh brings its own symmetry flags, face connectivity
+   // and boundary conditions
+   if (mesh != NULL) {
+      BuildHexMesh(*mesh, colLoc, meshPart);
+   }
+   else {
+      BuildMesh(nx, edgeNodes, edgeElems);
+   }
 
    // Setup region index sets. For now, these are constant sized
    // throughout the run, but could be changed every cycle to 
    // simulate effects of ALE on the lagrange solver
    CreateRegionIndexSets(nr, balance);
 
-   // Setup symmetry nodesets
-   SetupSymmetryPlanes(edgeNodes);
+   if (mesh == NULL) {
+      // Setup symmetry nodesets
+      SetupSymmetryPlanes(edgeNodes);
+
+      // Setup element connectivities
+      SetupElementConnectivities(edgeElems);
+
+      // Setup symmetry planes and free surface boundary arrays
+      SetupBoundaryConditions(edgeElems);
+   }
+
+   // Optionally renumber elements so each region is a contiguous range
+   if (sortRegions) {
+      SortElementsByRegion();
+   }
+
+   // Time-varying region membership works on the final region lists
+   SetupRegionMigration(migrateInterval, migrateFraction);
 
-   // Setup element connectivities
-   SetupElementConnectivities(edgeElems);
+   // Resolve the face boundary conditions of the monotonic q limiter
+   SetupMonoQNeighbors();
 
-   // Setup symmetry planes and free surface boundary arrays
-   SetupBoundaryConditions(edgeElems);
+   // Node to element corner lists must see the final element numbering
+#if _OPENMP
+   SetupThreadSupportStructures();
+#endif
 
 
    // Setup defaults
@@ -156,7 +201,8 @@ Domain::Domain(Int_t numRanks, Index_t colLoc,
    cycle()   = Int_t(0) ;
 
    // initialize field data 
-   for (Index_t i=0; i<numElem(); ++i) {
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0; i<numElem; ++i) {
       Real_t x_local[8], y_local[8], z_local[8] ;
       Index_t *elemToNode = nodelist(i) ;
       for( Index_t lnode=0 ; lnode<8 ; ++lnode )
@@ -171,25 +217,70 @@ Domain::Domain(Int_t numRanks, Index_t colLoc,
       Real_t volume = CalcElemVolume(x_local, y_local, z_local );
       volo(i) = volume ;
       elemMass(i) = volume ;
-      for (Index_t j=0; j<8; ++j) {
-         Index_t idx = elemToNode[j] ;
-         nodalMass(idx) += volume / Real_t(8.0) ;
+   }
+
+   // Nodal mass is gathered through the corner lists when they exist.
+   // Corners are sorted by element, so the sums are accumulated in the
+   // same order as the serial scatter and the result is bitwise identical
+   if (m_nodeElemStart != NULL) {
+#pragma omp parallel for firstprivate(numNode)
+      for (Index_t gnode=0; gnode<numNode; ++gnode) {
+         Index_t count = nodeElemCount(gnode) ;
+         Index_t *cornerList = nodeElemCornerList(gnode) ;
+         Real_t mass = Real_t(0.0) ;
+         for (Index_t i=0 ; i < count ; ++i) {
+            mass += volo(cornerList[i]/8) / Real_t(8.0) ;
+         }
+         nodalMass(gnode) = mass ;
+      }
+   }
+   else {
+      for (Index_t i=0; i<numElem; ++i) {
+         Index_t *elemToNode = nodelist(i) ;
+         for (Index_t j=0; j<8; ++j) {
+            Index_t idx = elemToNode[j] ;
+            nodalMass(idx) += volo(i) / Real_t(8.0) ;
+         }
       }
    }
 
    // deposit initial energy
-   // An energy of 3.948746e+7 is correct for a problem with
-   // 45 zones along a side - we need to scale it
-   const Real_t ebase = Real_t(3.948746e+7);
-   Real_t scale = (nx*m_tp)/Real_t(45.0);
-   Real_t einit = ebase*scale*scale*scale;
-   if (m_rowLoc + m_colLoc + m_planeLoc == 0) {
+   Real_t einit, originVolume ;
+   if (mesh != NULL) {
+      // The file names the element and energy; every rank needs the
+      // element's volume for the initial time step
+      Real_t x_local[8], y_local[8], z_local[8] ;
+      const Index_t *corner = &mesh->nodelist[size_t(8)*mesh->originElem] ;
+      for (Index_t lnode=0 ; lnode<8 ; ++lnode) {
+         x_local[lnode] = mesh->x[corner[lnode]] ;
+         y_local[lnode] = mesh->y[corner[lnode]] ;
+         z_local[lnode] = mesh->z[corner[lnode]] ;
+      }
+      originVolume = CalcElemVolume(x_local, y_local, z_local) ;
+      einit = mesh->originEnergy ;
+      m_originElem = -1 ;
+      for (Index_t i=0; i<numElem; ++i) {
+         if (m_meshElem[i] == mesh->originElem) {
+            m_originElem = i ;
+         }
+      }
+   }
+   else {
+      // An energy of 3.948746e+7 is correct for a problem with
+      // 45 zones along a side - we need to scale it
+      const Real_t ebase = Real_t(3.948746e+7);
+      Real_t scale = (nx*m_tp)/Real_t(45.0);
+      einit = ebase*scale*scale*scale;
+      originVolume = volo(spatialElem(0)) ;
       // Dump into the first zone (which we know is in the corner)
       // of the domain that sits at the origin
-      e(0) = einit;
+      m_originElem = (m_rowLoc + m_colLoc + m_planeLoc == 0) ? spatialElem(0) : -1 ;
+   }
+   if (m_originElem >= 0) {
+      e(m_originElem) = einit;
    }
    //set initial deltatime base on analytic CFL calculation
-   deltatime() = (Real_t(.5)*cbrt(volo(0)))/sqrt(Real_t(2.0)*einit);
+   deltatime() = (Real_t(.5)*cbrt(originVolume))/sqrt(Real_t(2.0)*einit);
 
 } // End constructor
 
@@ -205,6 +296,10 @@ Domain::~Domain()
      delete [] m_regElemlist[i];
    }
    delete [] m_regElemlist;
+   delete [] m_regElemCap;
+   delete [] m_regElemPos;
+   delete [] m_regMoves;
+   ReleaseEOSTable(&m_eosTable);
    
 #if USE_MPI
    delete [] commDataSend;
@@ -219,33 +314,31 @@ Domain::BuildMesh(Int_t nx, Int_t edgeNodes, Int_t edgeElems)
 {
   Index_t meshEdgeElems = m_tp*nx ;
 
-  // initialize nodal coordinates 
-  Index_t nidx = 0 ;
-  Real_t tz = Real_t(1.125)*Real_t(m_planeLoc*nx)/Real_t(meshEdgeElems) ;
+  // initialize nodal coordinates.  Every coordinate is computed from its
+  // lattice index rather than accumulated (which may accumulate roundoff),
+  // so planes can be filled independently
+#pragma omp parallel for firstprivate(edgeNodes, meshEdgeElems)
   for (Index_t plane=0; plane<edgeNodes; ++plane) {
-    Real_t ty = Real_t(1.125)*Real_t(m_rowLoc*nx)/Real_t(meshEdgeElems) ;
+    Index_t nidx = plane*edgeNodes*edgeNodes ;
+    Real_t tz = Real_t(1.125)*Real_t(m_planeLoc*nx+plane)/Real_t(meshEdgeElems) ;
     for (Index_t row=0; row<edgeNodes; ++row) {
-      Real_t tx = Real_t(1.125)*Real_t(m_colLoc*nx)/Real_t(meshEdgeElems) ;
+      Real_t ty = Real_t(1.125)*Real_t(m_rowLoc*nx+row)/Real_t(meshEdgeElems) ;
       for (Index_t col=0; col<edgeNodes; ++col) {
+	Real_t tx = Real_t(1.125)*Real_t(m_colLoc*nx+col)/Real_t(meshEdgeElems) ;
 	x(nidx) = tx ;
 	y(nidx) = ty ;
 	z(nidx) = tz ;
 	++nidx ;
-	// tx += ds ; // may accumulate roundoff... 
-	tx = Real_t(1.125)*Real_t(m_colLoc*nx+col+1)/Real_t(meshEdgeElems) ;
       }
-      // ty += ds ;  // may accumulate roundoff... 
-      ty = Real_t(1.125)*Real_t(m_rowLoc*nx+row+1)/Real_t(meshEdgeElems) ;
     }
-    // tz += ds ;  // may accumulate roundoff... 
-    tz = Real_t(1.125)*Real_t(m_planeLoc*nx+plane+1)/Real_t(meshEdgeElems) ;
   }
 
 
   // embed hexehedral elements in nodal point lattice 
-  Index_t zidx = 0 ;
-  nidx = 0 ;
+#pragma omp parallel for firstprivate(edgeNodes, edgeElems)
   for (Index_t plane=0; plane<edgeElems; ++plane) {
+    Index_t zidx = plane*edgeElems*edgeElems ;
+    Index_t nidx = plane*edgeNodes*edgeNodes ;
     for (Index_t row=0; row<edgeElems; ++row) {
       for (Index_t col=0; col<edgeElems; ++col) {
 	Index_t *localNode = nodelist(zidx) ;
@@ -262,8 +355,8 @@ Domain::BuildMesh(Int_t nx, Int_t edgeNodes, Int_t edgeElems)
       }
       ++nidx ;
     }
-    nidx += edgeNodes ;
   }
+  m_latticeNodes = true ;
 }
 
 
@@ -278,50 +371,79 @@ Domain::SetupThreadSupportStructures()
 #endif
 
   if (numthreads > 1) {
+    Index_t numElem = this->numElem() ;
+    Index_t numNode = this->numNode() ;
+
     // set up node-centered indexing of elements 
-    Index_t *nodeElemCount = new Index_t[numNode()] ;
+    Index_t *nodeElemCount = new Index_t[numNode] ;
 
-    for (Index_t i=0; i<numNode(); ++i) {
+#pragma omp parallel for firstprivate(numNode)
+    for (Index_t i=0; i<numNode; ++i) {
       nodeElemCount[i] = 0 ;
     }
 
-    for (Index_t i=0; i<numElem(); ++i) {
+#pragma omp parallel for firstprivate(numElem)
+    for (Index_t i=0; i<numElem; ++i) {
       Index_t *nl = nodelist(i) ;
       for (Index_t j=0; j < 8; ++j) {
+#pragma omp atomic
 	++(nodeElemCount[nl[j]] );
       }
     }
 
-    m_nodeElemStart = new Index_t[numNode()+1] ;
+    m_nodeElemStart = new Index_t[numNode+1] ;
 
     m_nodeElemStart[0] = 0;
 
-    for (Index_t i=1; i <= numNode(); ++i) {
+    for (Index_t i=1; i <= numNode; ++i) {
       m_nodeElemStart[i] =
 	m_nodeElemStart[i-1] + nodeElemCount[i-1] ;
     }
        
-    m_nodeElemCornerList = new Index_t[m_nodeElemStart[numNode()]];
+    m_nodeElemCornerList = new Index_t[m_nodeElemStart[numNode]];
 
-    for (Index_t i=0; i < numNode(); ++i) {
+#pragma omp parallel for firstprivate(numNode)
+    for (Index_t i=0; i < numNode; ++i) {
       nodeElemCount[i] = 0;
     }
 
-    for (Index_t i=0; i < numElem(); ++i) {
+#pragma omp parallel for firstprivate(numElem)
+    for (Index_t i=0; i < numElem; ++i) {
       Index_t *nl = nodelist(i) ;
       for (Index_t j=0; j < 8; ++j) {
 	Index_t m = nl[j];
 	Index_t k = i*8 + j ;
-	Index_t offset = m_nodeElemStart[m] + nodeElemCount[m] ;
-	m_nodeElemCornerList[offset] = k;
-	++(nodeElemCount[m]) ;
+	Index_t slot ;
+#pragma omp atomic capture
+	slot = nodeElemCount[m]++ ;
+	m_nodeElemCornerList[m_nodeElemStart[m] + slot] = k;
+      }
+    }
+
+    // Threads fill each list in arbitrary order; sorting the (at most
+    // eight) corners of a node restores the serial, ascending order
+    Int_t badEntry = 0 ;
+#pragma omp parallel for firstprivate(numNode) reduction(+:badEntry)
+    for (Index_t i=0; i < numNode; ++i) {
+      Index_t *cl = &m_nodeElemCornerList[m_nodeElemStart[i]] ;
+      Index_t count = nodeElemCount[i] ;
+      for (Index_t j=1; j < count; ++j) {
+	Index_t clv = cl[j] ;
+	Index_t k = j ;
+	while ((k > 0) && (cl[k-1] > clv)) {
+	  cl[k] = cl[k-1] ;
+	  --k ;
+	}
+	cl[k] = clv ;
+      }
+      for (Index_t j=0; j < count; ++j) {
+	if ((cl[j] < 0) || (cl[j] > numElem*8)) {
+	  ++badEntry ;
+	}
       }
     }
 
-    Index_t clSize = m_nodeElemStart[numNode()] ;
-    for (Index_t i=0; i < clSize; ++i) {
-      Index_t clv = m_nodeElemCornerList[i] ;
-      if ((clv < 0) || (clv > numElem()*8)) {
+    if (badEntry != 0) {
 	fprintf(stderr,
 		"AllocateNodeElemIndexes(): nodeElemCornerList entry out of range!\n");
 #if USE_MPI
@@ -329,7 +451,6 @@ Domain::SetupThreadSupportStructures()
 #else
 	exit(-1);
 #endif
-      }
     }
 
     delete [] nodeElemCount ;
@@ -339,7 +460,7 @@ Domain::SetupThreadSupportStructures()
 
 ////////////////////////////////////////////////////////////////////////////////
 void
-Domain::SetupCommBuffers(Int_t edgeNodes)
+Domain::SetupCommBuffers()
 {
   // allocate a buffer large enough for nodal ghost data 
   Index_t maxEdgeSize = MAX(this->sizeX(), MAX(this->sizeY(), this->sizeZ()))+1 ;
@@ -385,16 +506,77 @@ Domain::SetupCommBuffers(Int_t edgeNodes)
   memset(this->commDataSend, 0, comBufSize*sizeof(Real_t)) ;
   memset(this->commDataRecv, 0, comBufSize*sizeof(Real_t)) ;
 #endif   
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11).  A draw
+// depends only on (key, counter), so any thread can produce any part
+// of the stream without sharing generator state.
+
+struct PhiloxStream {
+   uint32_t key[2] ;
+   uint32_t ctr[4] ;
+   uint32_t out[4] ;
+   Int_t    next ;
+} ;
+
+static inline
+void PhiloxRound(uint32_t *ctr, const uint32_t *key)
+{
+   uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0] ;
+   uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2] ;
+   uint32_t c1 = ctr[1] ;
+   uint32_t c3 = ctr[3] ;
+   ctr[0] = uint32_t(p1 >> 32) ^ c1 ^ key[0] ;
+   ctr[1] = uint32_t(p1) ;
+   ctr[2] = uint32_t(p0 >> 32) ^ c3 ^ key[1] ;
+   ctr[3] = uint32_t(p0) ;
+}
+
+static inline
+void PhiloxInit(PhiloxStream *rng, uint32_t seed, uint32_t stream)
+{
+   rng->key[0] = seed ;
+   rng->key[1] = 0x1F123BB5u ;   // fixed, only the seed varies per rank
+   rng->ctr[0] = 0 ;
+   rng->ctr[1] = 0 ;
+   rng->ctr[2] = stream ;
+   rng->ctr[3] = 0 ;
+   rng->next = 4 ;
+}
 
-  // Boundary nodesets
-  if (m_colLoc == 0)
-    m_symmX.resize(edgeNodes*edgeNodes);
-  if (m_rowLoc == 0)
-    m_symmY.resize(edgeNodes*edgeNodes);
-  if (m_planeLoc == 0)
-    m_symmZ.resize(edgeNodes*edgeNodes);
+static inline
+uint32_t PhiloxNext(PhiloxStream *rng)
+{
+   if (rng->next == 4) {
+      uint32_t key[2] = { rng->key[0], rng->key[1] } ;
+      for (Int_t i=0 ; i<4 ; ++i) {
+         rng->out[i] = rng->ctr[i] ;
+      }
+      for (Int_t round=0 ; round<10 ; ++round) {
+         PhiloxRound(rng->out, key) ;
+         key[0] += 0x9E3779B9u ;
+         key[1] += 0xBB67AE85u ;
+      }
+      ++rng->ctr[0] ;
+      rng->next = 0 ;
+   }
+   return rng->out[rng->next++] ;
 }
 
+static inline
+Int_t PickRegion(PhiloxStream *rng, const Int_t *regBinEnd,
+                 Int_t costDenominator, Int_t numReg, Int_t myRank)
+{
+   Int_t regionVar = Int_t(PhiloxNext(rng) % uint32_t(costDenominator)) ;
+   Int_t i = 0 ;
+   while (regionVar >= regBinEnd[i])
+      i++ ;
+   //rotate the regions based on MPI rank.  Rotation is Rank % NumRegions this makes each domain have a different region with 
+   //the highest representation
+   return ((i + myRank) % numReg) + 1 ;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 void
@@ -403,131 +585,211 @@ Domain::CreateRegionIndexSets(Int_t nr, Int_t balance)
 #if USE_MPI   
    int myRank;
    MPI_Comm_rank(MPI_COMM_WORLD, &myRank) ;
-   srand(myRank);
 #else
-   srand(0);
    Index_t myRank = 0;
 #endif
    this->numReg() = nr;
    m_regElemSize = new Index_t[numReg()];
    m_regElemlist = new Index_t*[numReg()];
-   Index_t nextIndex = 0;
+
+   // Elements are assigned in fixed-size chunks, each drawing from its
+   // own Philox stream, so the result depends on the rank but not on
+   // the number of threads
+   Index_t numElem = this->numElem() ;
+   Index_t numChunk = (numElem + REGION_INIT_CHUNK - 1) / REGION_INIT_CHUNK ;
+   Int_t   numReg = this->numReg() ;
+   Index_t *chunkRegCount = new Index_t[numChunk*numReg] ;
+
    //if we only have one region just fill it
    // Fill out the regNumList with material numbers, which are always
    // the region index plus one 
-   if(numReg() == 1) {
-      while (nextIndex < numElem()) {
-	 this->regNumList(nextIndex) = 1;
-         nextIndex++;
+   if(numReg == 1) {
+#pragma omp parallel for firstprivate(numElem)
+      for (Index_t i=0; i<numElem; ++i) {
+	 this->regNumList(i) = 1;
       }
-      regElemSize(0) = 0;
    }
    //If we have more than one region distribute the elements.
    else {
-      Int_t regionNum;
-      Int_t regionVar;
-      Int_t lastReg = -1;
-      Int_t binSize;
-      Index_t elements;
-      Index_t runto = 0;
       Int_t costDenominator = 0;
-      Int_t* regBinEnd = new Int_t[numReg()];
+      Int_t* regBinEnd = new Int_t[numReg];
       //Determine the relative weights of all the regions.  This is based off the -b flag.  Balance is the value passed into b.  
-      for (Index_t i=0 ; i<numReg() ; ++i) {
-         regElemSize(i) = 0;
+      for (Index_t i=0 ; i<numReg ; ++i) {
 	 costDenominator += pow((i+1), balance);  //Total sum of all regions weights
 	 regBinEnd[i] = costDenominator;  //Chance of hitting a given region is (regBinEnd[i] - regBinEdn[i-1])/costDenominator
       }
-      //Until all elements are assigned
-      while (nextIndex < numElem()) {
-	 //pick the region
-	 regionVar = rand() % costDenominator;
-	 Index_t i = 0;
-         while(regionVar >= regBinEnd[i])
-	    i++;
-         //rotate the regions based on MPI rank.  Rotation is Rank % NumRegions this makes each domain have a different region with 
-         //the highest representation
-	 regionNum = ((i + myRank) % numReg()) + 1;
-	 // make sure we don't pick the same region twice in a row
-         while(regionNum == lastReg) {
-	    regionVar = rand() % costDenominator;
-	    i = 0;
-            while(regionVar >= regBinEnd[i])
-	       i++;
-	    regionNum = ((i + myRank) % numReg()) + 1;
+
+#pragma omp parallel for firstprivate(numElem, numChunk, numReg, costDenominator, myRank)
+      for (Index_t c=0 ; c<numChunk ; ++c) {
+         PhiloxStream rng ;
+         PhiloxInit(&rng, uint32_t(myRank), uint32_t(c)) ;
+         Index_t nextIndex = c*REGION_INIT_CHUNK ;
+         Index_t chunkEnd = MIN(nextIndex + REGION_INIT_CHUNK, numElem) ;
+         Int_t lastReg = -1;
+         //Until all elements of the chunk are assigned
+         while (nextIndex < chunkEnd) {
+            Int_t regionNum ;
+            Index_t elements ;
+            //pick the region, making sure we don't pick the same region twice in a row
+            do {
+               regionNum = PickRegion(&rng, regBinEnd, costDenominator,
+                                      numReg, myRank) ;
+            } while (regionNum == lastReg) ;
+            //Pick the bin size of the region and determine the number of elements.
+            uint32_t binSize = PhiloxNext(&rng) % 1000;
+            uint32_t draw = PhiloxNext(&rng) ;
+            if(binSize < 773) {
+              elements = draw % 15 + 1;
+            }
+            else if(binSize < 937) {
+              elements = draw % 16 + 16;
+            }
+            else if(binSize < 970) {
+              elements = draw % 32 + 32;
+            }
+            else if(binSize < 974) {
+              elements = draw % 64 + 64;
+            } 
+            else if(binSize < 978) {
+              elements = draw % 128 + 128;
+            }
+            else if(binSize < 981) {
+              elements = draw % 256 + 256;
+            }
+            else
+               elements = draw % 1537 + 512;
+            Index_t runto = MIN(elements + nextIndex, chunkEnd) ;
+            //Store the elements.  If we hit the end of the chunk before we run out of elements then just stop.
+            while (nextIndex < runto) {
+               this->regNumList(nextIndex) = regionNum;
+               nextIndex++;
+            }
+            lastReg = regionNum;
          }
-	 //Pick the bin size of the region and determine the number of elements.
-         binSize = rand() % 1000;
-	 if(binSize < 773) {
-	   elements = rand() % 15 + 1;
-	 }
-	 else if(binSize < 937) {
-	   elements = rand() % 16 + 16;
-	 }
-	 else if(binSize < 970) {
-	   elements = rand() % 32 + 32;
-	 }
-	 else if(binSize < 974) {
-	   elements = rand() % 64 + 64;
-	 } 
-	 else if(binSize < 978) {
-	   elements = rand() % 128 + 128;
-	 }
-	 else if(binSize < 981) {
-	   elements = rand() % 256 + 256;
-	 }
-	 else
-	    elements = rand() % 1537 + 512;
-	 runto = elements + nextIndex;
-	 //Store the elements.  If we hit the end before we run out of elements then just stop.
-         while (nextIndex < runto && nextIndex < numElem()) {
-	    this->regNumList(nextIndex) = regionNum;
-	    nextIndex++;
-	 }
-	 lastReg = regionNum;
       }
 
       delete [] regBinEnd; 
    }
+
    // Convert regNumList to region index sets
-   // First, count size of each region 
-   for (Index_t i=0 ; i<numElem() ; ++i) {
-      int r = this->regNumList(i)-1; // region index == regnum-1
-      regElemSize(r)++;
+   // First, count size of each region within each chunk
+#pragma omp parallel for firstprivate(numElem, numChunk, numReg)
+   for (Index_t c=0 ; c<numChunk ; ++c) {
+      Index_t *count = &chunkRegCount[c*numReg] ;
+      Index_t chunkEnd = MIN((c+1)*REGION_INIT_CHUNK, numElem) ;
+      for (Index_t r=0 ; r<numReg ; ++r) {
+         count[r] = 0 ;
+      }
+      for (Index_t i=c*REGION_INIT_CHUNK ; i<chunkEnd ; ++i) {
+         count[this->regNumList(i)-1]++ ; // region index == regnum-1
+      }
    }
-   // Second, allocate each region index set
-   for (Index_t i=0 ; i<numReg() ; ++i) {
-      m_regElemlist[i] = new Index_t[regElemSize(i)];
-      regElemSize(i) = 0;
+
+   // Second, turn counts into per-chunk offsets and allocate each
+   // region index set
+#pragma omp parallel for firstprivate(numChunk, numReg)
+   for (Index_t r=0 ; r<numReg ; ++r) {
+      Index_t offset = 0 ;
+      for (Index_t c=0 ; c<numChunk ; ++c) {
+         Index_t count = chunkRegCount[c*numReg + r] ;
+         chunkRegCount[c*numReg + r] = offset ;
+         offset += count ;
+      }
+      regElemSize(r) = offset ;
+      m_regElemlist[r] = new Index_t[offset];
    }
-   // Third, fill index sets
-   for (Index_t i=0 ; i<numElem() ; ++i) {
-      Index_t r = regNumList(i)-1;       // region index == regnum-1
-      Index_t regndx = regElemSize(r)++; // Note increment
-      regElemlist(r,regndx) = i;
+
+   // Third, fill index sets; each chunk owns a slice of every set, so
+   // the sets come out in ascending element order
+#pragma omp parallel for firstprivate(numElem, numChunk, numReg)
+   for (Index_t c=0 ; c<numChunk ; ++c) {
+      Index_t *offset = &chunkRegCount[c*numReg] ;
+      Index_t chunkEnd = MIN((c+1)*REGION_INIT_CHUNK, numElem) ;
+      for (Index_t i=c*REGION_INIT_CHUNK ; i<chunkEnd ; ++i) {
+         Index_t r = regNumList(i)-1;     // region index == regnum-1
+         regElemlist(r,offset[r]++) = i;  // Note increment
+      }
    }
-   
+
+   delete [] chunkRegCount ;
+}
+
+/////////////////////////////////////////////////////////////
+void
+Domain::SetupRegionMigration(Int_t interval, Real_t fraction)
+{
+   if (interval <= 0 || fraction <= Real_t(0.)) {
+      return ;
+   }
+
+   m_regMigrateInterval = interval ;
+   m_regMaxMoves = Index_t(fraction*Real_t(numElem())) ;
+   if (m_regMaxMoves < 1) {
+      m_regMaxMoves = 1 ;
+   }
+   else if (m_regMaxMoves > numElem()) {
+      m_regMaxMoves = numElem() ;
+   }
+
+   // Leave room in every region list for one migration's worth of
+   // arrivals; ReserveRegionElems grows a list beyond that if needed
+   m_regElemCap = new Index_t[numReg()] ;
+   for (Index_t r=0 ; r<numReg() ; ++r) {
+      m_regElemCap[r] = MIN(regElemSize(r) + m_regMaxMoves, numElem()) ;
+      Index_t *list = new Index_t[m_regElemCap[r]] ;
+      memcpy(list, m_regElemlist[r], regElemSize(r)*sizeof(Index_t)) ;
+      delete [] m_regElemlist[r] ;
+      m_regElemlist[r] = list ;
+   }
+
+   m_regElemPos = new Index_t[numElem()] ;
+   for (Index_t r=0 ; r<numReg() ; ++r) {
+      for (Index_t k=0 ; k<regElemSize(r) ; ++k) {
+         m_regElemPos[regElemlist(r,k)] = k ;
+      }
+   }
+
+   m_regMoves = new Index_t[3*m_regMaxMoves] ;
+}
+
+/////////////////////////////////////////////////////////////
+void
+Domain::ReserveRegionElems(Int_t r, Index_t count)
+{
+   if (count <= m_regElemCap[r]) {
+      return ;
+   }
+
+   // Doubling keeps the copies of a steadily growing region cheap; no
+   // region can hold more than every element
+   Index_t cap = MIN(MAX(count, 2*m_regElemCap[r]), numElem()) ;
+   // A checkpoint restore grows a list after its new size is read, so
+   // copy no more than the old list holds
+   Index_t *list = new Index_t[cap] ;
+   memcpy(list, m_regElemlist[r],
+          MIN(regElemSize(r), m_regElemCap[r])*sizeof(Index_t)) ;
+   delete [] m_regElemlist[r] ;
+   m_regElemlist[r] = list ;
+   m_regElemCap[r] = cap ;
 }
 
 /////////////////////////////////////////////////////////////
 void 
 Domain::SetupSymmetryPlanes(Int_t edgeNodes)
 {
-  Index_t nidx = 0 ;
   for (Index_t i=0; i<edgeNodes; ++i) {
     Index_t planeInc = i*edgeNodes*edgeNodes ;
     Index_t rowInc   = i*edgeNodes ;
     for (Index_t j=0; j<edgeNodes; ++j) {
       if (m_planeLoc == 0) {
-	m_symmZ[nidx] = rowInc   + j ;
+	m_nodeBC[rowInc   + j] |= NODE_SYMM_Z ;
       }
       if (m_rowLoc == 0) {
-	m_symmY[nidx] = planeInc + j ;
+	m_nodeBC[planeInc + j] |= NODE_SYMM_Y ;
       }
       if (m_colLoc == 0) {
-	m_symmX[nidx] = planeInc + j*edgeNodes ;
+	m_nodeBC[planeInc + j*edgeNodes] |= NODE_SYMM_X ;
       }
-      ++nidx ;
     }
   }
 }
@@ -538,29 +800,18 @@ Domain::SetupSymmetryPlanes(Int_t edgeNodes)
 void
 Domain::SetupElementConnectivities(Int_t edgeElems)
 {
-   lxim(0) = 0 ;
-   for (Index_t i=1; i<numElem(); ++i) {
-      lxim(i)   = i-1 ;
-      lxip(i-1) = i ;
-   }
-   lxip(numElem()-1) = numElem()-1 ;
-
-   for (Index_t i=0; i<edgeElems; ++i) {
-      letam(i) = i ; 
-      letap(numElem()-edgeElems+i) = numElem()-edgeElems+i ;
-   }
-   for (Index_t i=edgeElems; i<numElem(); ++i) {
-      letam(i) = i-edgeElems ;
-      letap(i-edgeElems) = i ;
-   }
-
-   for (Index_t i=0; i<edgeElems*edgeElems; ++i) {
-      lzetam(i) = i ;
-      lzetap(numElem()-edgeElems*edgeElems+i) = numElem()-edgeElems*edgeElems+i ;
-   }
-   for (Index_t i=edgeElems*edgeElems; i<numElem(); ++i) {
-      lzetam(i) = i - edgeElems*edgeElems ;
-      lzetap(i-edgeElems*edgeElems) = i ;
+   Index_t numElem = this->numElem() ;
+   Index_t edgePlane = edgeElems*edgeElems ;
+
+   // Elements at the ends of the lattice point at themselves
+#pragma omp parallel for firstprivate(numElem, edgeElems, edgePlane)
+   for (Index_t i=0; i<numElem; ++i) {
+      lxim(i)   = (i > 0)                    ? i-1         : i ;
+      lxip(i)   = (i < numElem-1)            ? i+1         : i ;
+      letam(i)  = (i >= edgeElems)           ? i-edgeElems : i ;
+      letap(i)  = (i < numElem-edgeElems)    ? i+edgeElems : i ;
+      lzetam(i) = (i >= edgePlane)           ? i-edgePlane : i ;
+      lzetap(i) = (i < numElem-edgePlane)    ? i+edgePlane : i ;
    }
 }
 
@@ -570,11 +821,6 @@ Domain::SetupBoundaryConditions(Int_t edgeElems)
 {
   Index_t ghostIdx[6] ;  // offsets to ghost locations
 
-  // set up boundary condition information
-  for (Index_t i=0; i<numElem(); ++i) {
-     elemBC(i) = Int_t(0) ;
-  }
-
   for (Index_t i=0; i<6; ++i) {
     ghostIdx[i] = INT_MIN ;
   }
@@ -609,67 +855,191 @@ Domain::SetupBoundaryConditions(Int_t edgeElems)
     ghostIdx[5] = pidx ;
   }
 
-  // symmetry plane or free surface BCs 
-  for (Index_t i=0; i<edgeElems; ++i) {
-    Index_t planeInc = i*edgeElems*edgeElems ;
-    Index_t rowInc   = i*edgeElems ;
-    for (Index_t j=0; j<edgeElems; ++j) {
-      if (m_planeLoc == 0) {
-	elemBC(rowInc+j) |= ZETA_M_SYMM ;
-      }
-      else {
-	elemBC(rowInc+j) |= ZETA_M_COMM ;
-	lzetam(rowInc+j) = ghostIdx[0] + rowInc + j ;
+  // symmetry plane or free surface BCs.  Each element gathers the
+  // conditions of all its faces, so planes can be set up independently
+#pragma omp parallel for firstprivate(edgeElems)
+  for (Index_t plane=0; plane<edgeElems; ++plane) {
+    for (Index_t row=0; row<edgeElems; ++row) {
+      for (Index_t col=0; col<edgeElems; ++col) {
+	Index_t i = (plane*edgeElems + row)*edgeElems + col ;
+	Int_t bc = Int_t(0) ;
+
+	if (plane == 0) {
+	  if (m_planeLoc == 0) {
+	    bc |= ZETA_M_SYMM ;
+	  }
+	  else {
+	    bc |= ZETA_M_COMM ;
+	    lzetam(i) = ghostIdx[0] + row*edgeElems + col ;
+	  }
+	}
+
+	if (plane == edgeElems-1) {
+	  if (m_planeLoc == m_tp-1) {
+	    bc |= ZETA_P_FREE ;
+	  }
+	  else {
+	    bc |= ZETA_P_COMM ;
+	    lzetap(i) = ghostIdx[1] + row*edgeElems + col ;
+	  }
+	}
+
+	if (row == 0) {
+	  if (m_rowLoc == 0) {
+	    bc |= ETA_M_SYMM ;
+	  }
+	  else {
+	    bc |= ETA_M_COMM ;
+	    letam(i) = ghostIdx[2] + plane*edgeElems + col ;
+	  }
+	}
+
+	if (row == edgeElems-1) {
+	  if (m_rowLoc == m_tp-1) {
+	    bc |= ETA_P_FREE ;
+	  }
+	  else {
+	    bc |= ETA_P_COMM ;
+	    letap(i) = ghostIdx[3] + plane*edgeElems + col ;
+	  }
+	}
+
+	if (col == 0) {
+	  if (m_colLoc == 0) {
+	    bc |= XI_M_SYMM ;
+	  }
+	  else {
+	    bc |= XI_M_COMM ;
+	    lxim(i) = ghostIdx[4] + plane*edgeElems + row ;
+	  }
+	}
+
+	if (col == edgeElems-1) {
+	  if (m_colLoc == m_tp-1) {
+	    bc |= XI_P_FREE ;
+	  }
+	  else {
+	    bc |= XI_P_COMM ;
+	    lxip(i) = ghostIdx[5] + plane*edgeElems + row ;
+	  }
+	}
+
+	elemBC(i) = bc ;
       }
+    }
+  }
+}
 
-      if (m_planeLoc == m_tp-1) {
-	elemBC(rowInc+j+numElem()-edgeElems*edgeElems) |=
-	  ZETA_P_FREE;
-      }
-      else {
-	elemBC(rowInc+j+numElem()-edgeElems*edgeElems) |=
-	  ZETA_P_COMM ;
-	lzetap(rowInc+j+numElem()-edgeElems*edgeElems) =
-	  ghostIdx[1] + rowInc + j ;
+/////////////////////////////////////////////////////////////
+template <typename Field>
+static void PermuteElemField(Field &field,
+                             const std::vector<Index_t> &newIdx,
+                             Index_t width)
+{
+   Field tmp(field) ;
+   Index_t numElem = Index_t(newIdx.size()) ;
+#pragma omp parallel for firstprivate(numElem, width)
+   for (Index_t i=0; i<numElem; ++i) {
+      for (Index_t j=0; j<width; ++j) {
+         field[newIdx[i]*width + j] = tmp[i*width + j] ;
       }
+   }
+}
 
-      if (m_rowLoc == 0) {
-	elemBC(planeInc+j) |= ETA_M_SYMM ;
-      }
-      else {
-	elemBC(planeInc+j) |= ETA_M_COMM ;
-	letam(planeInc+j) = ghostIdx[2] + rowInc + j ;
-      }
+/////////////////////////////////////////////////////////////
+void
+Domain::SortElementsByRegion()
+{
+   // Stable counting sort on region number, so elements keep their
+   // lattice order within a region
+   std::vector<Index_t> regStart(numReg()) ;
+   Index_t start = 0 ;
+   for (Index_t r=0 ; r<numReg() ; ++r) {
+      regStart[r] = start ;
+      start += regElemSize(r) ;
+   }
 
-      if (m_rowLoc == m_tp-1) {
-	elemBC(planeInc+j+edgeElems*edgeElems-edgeElems) |= 
-	  ETA_P_FREE ;
-      }
-      else {
-	elemBC(planeInc+j+edgeElems*edgeElems-edgeElems) |= 
-	  ETA_P_COMM ;
-	letap(planeInc+j+edgeElems*edgeElems-edgeElems) =
-	  ghostIdx[3] +  rowInc + j ;
-      }
+   m_spatialElem.resize(numElem()) ;
+   for (Index_t i=0 ; i<numElem() ; ++i) {
+      m_spatialElem[i] = regStart[regNumList(i)-1]++ ;
+   }
 
-      if (m_colLoc == 0) {
-	elemBC(planeInc+j*edgeElems) |= XI_M_SYMM ;
-      }
-      else {
-	elemBC(planeInc+j*edgeElems) |= XI_M_COMM ;
-	lxim(planeInc+j*edgeElems) = ghostIdx[4] + rowInc + j ;
-      }
+   // Only connectivity and boundary data exist at this point; the
+   // physical fields still hold their uniform initial values
+   PermuteElemField(m_nodelist, m_spatialElem, 8) ;
+   m_latticeNodes = false ;
+   PermuteElemField(m_lxim,     m_spatialElem, 1) ;
+   PermuteElemField(m_lxip,     m_spatialElem, 1) ;
+   PermuteElemField(m_letam,    m_spatialElem, 1) ;
+   PermuteElemField(m_letap,    m_spatialElem, 1) ;
+   PermuteElemField(m_lzetam,   m_spatialElem, 1) ;
+   PermuteElemField(m_lzetap,   m_spatialElem, 1) ;
+   PermuteElemField(m_elemBC,   m_spatialElem, 1) ;
+   if (unstructured()) {
+      PermuteElemField(m_meshElem, m_spatialElem, 1) ;
+   }
+#if USE_MPI
+   for (size_t k=0 ; k<haloSendElem.size() ; ++k) {
+      haloSendElem[k] = m_spatialElem[haloSendElem[k]] ;
+   }
+#endif
 
-      if (m_colLoc == m_tp-1) {
-	elemBC(planeInc+j*edgeElems+edgeElems-1) |= XI_P_FREE ;
+   // Face neighbors that are local elements are renumbered as well;
+   // ghost slots (>= numElem) keep their indices
+   for (Index_t i=0 ; i<numElem() ; ++i) {
+      if (lxim(i)   < numElem()) lxim(i)   = m_spatialElem[lxim(i)] ;
+      if (lxip(i)   < numElem()) lxip(i)   = m_spatialElem[lxip(i)] ;
+      if (letam(i)  < numElem()) letam(i)  = m_spatialElem[letam(i)] ;
+      if (letap(i)  < numElem()) letap(i)  = m_spatialElem[letap(i)] ;
+      if (lzetam(i) < numElem()) lzetam(i) = m_spatialElem[lzetam(i)] ;
+      if (lzetap(i) < numElem()) lzetap(i) = m_spatialElem[lzetap(i)] ;
+   }
+
+   // Region index sets become consecutive ranges
+   start = 0 ;
+   for (Index_t r=0 ; r<numReg() ; ++r) {
+      for (Index_t k=0 ; k<regElemSize(r) ; ++k) {
+         regNumList(start + k) = r + 1 ;
+         regElemlist(r,k) = start + k ;
       }
-      else {
-	elemBC(planeInc+j*edgeElems+edgeElems-1) |= XI_P_COMM ;
-	lxip(planeInc+j*edgeElems+edgeElems-1) =
-	  ghostIdx[5] + rowInc + j ;
+      start += regElemSize(r) ;
+   }
+}
+
+/////////////////////////////////////////////////////////////
+void
+Domain::SetupMonoQNeighbors()
+{
+   // Each face of an element reads the velocity gradient of its
+   // neighbor (a ghost slot for comm faces), its own for a symmetry
+   // plane, or the zero slot past the ghosts for a free surface.  This
+   // turns the limiter's boundary switches into plain gathers
+   Index_t numElem = this->numElem() ;
+   Index_t zeroSlot = allElem() ;
+
+#pragma omp parallel for firstprivate(numElem, zeroSlot)
+   for (Index_t i=0; i<numElem; ++i) {
+      Int_t bcMask = elemBC(i) ;
+      Index_t *nbr = delvNbr(i) ;
+      const Int_t   symmBC[6] = { XI_M_SYMM, XI_P_SYMM, ETA_M_SYMM,
+                                  ETA_P_SYMM, ZETA_M_SYMM, ZETA_P_SYMM } ;
+      const Int_t   freeBC[6] = { XI_M_FREE, XI_P_FREE, ETA_M_FREE,
+                                  ETA_P_FREE, ZETA_M_FREE, ZETA_P_FREE } ;
+      const Index_t face[6]   = { lxim(i), lxip(i), letam(i),
+                                  letap(i), lzetam(i), lzetap(i) } ;
+
+      for (Index_t j=0; j<6; ++j) {
+         if (bcMask & symmBC[j]) {
+            nbr[j] = i ;
+         }
+         else if (bcMask & freeBC[j]) {
+            nbr[j] = zeroSlot ;
+         }
+         else {
+            nbr[j] = face[j] ;
+         }
       }
-    }
-  }
+   }
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,422 @@
+#if USE_MPI
+# include <mpi.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <sys/mman.h>
+# include <sys/syscall.h>
+#endif
+#include "lulesh.h"
+
+/*
+   Storage for the persistent Domain fields and the per-cycle scratch
+   arrays.
+
+   Every field gets its own page-aligned block whose length is rounded
+   up to whole pages, so no page is shared by two fields and the NUMA
+   placement of a field is decided entirely by the threads that first
+   touch it.
+
+   Under a huge page policy, fields and scratch arrays of at least one
+   huge page are carved from 2MB-aligned blocks.  Scratch blocks are
+   not returned to the system on Release() but cached for the next
+   cycle, which asks for the same sizes again; this avoids paying the
+   mmap and huge page clearing cost every cycle.
+
+   The registry of huge page blocks is shared by all threads, and the
+   kernels may allocate scratch from inside a parallel region, so every
+   access to it is serialized in the pageBlocks critical section.
+*/
+
+#define HUGE_PAGE_SIZE    (size_t(2) << 20)
+
+// Number of NUMA nodes tracked by the placement report
+#define MAX_NUMA_NODES    64
+
+// Pages per field queried by the placement report, evenly strided
+#define PLACEMENT_SAMPLES 4096
+
+struct PageBlock {
+   void   *ptr ;
+   size_t  len ;
+   bool    mapped ;   // from mmap(MAP_HUGETLB), else posix_memalign
+   bool    scratch ;
+   bool    inUse ;
+} ;
+
+static Int_t fieldMemPolicy = FieldMemDefault ;
+static std::vector<PageBlock> pageBlocks ;   // huge page blocks only
+static bool hugeTLBWarned = false ;
+
+/******************************************/
+
+void SetFieldMemPolicy(Int_t policy)
+{
+   fieldMemPolicy = policy ;
+}
+
+/******************************************/
+
+const char *FieldMemPolicyName(Int_t policy)
+{
+   switch (policy) {
+      case FieldMemTHP:     return "thp" ;
+      case FieldMemHugeTLB: return "hugetlb" ;
+      default:              return "none" ;
+   }
+}
+
+/******************************************/
+
+static size_t PageSize()
+{
+   static size_t pageSize = 0 ;
+   if (pageSize == 0) {
+      long sz = sysconf(_SC_PAGESIZE) ;
+      pageSize = (sz > 0) ? size_t(sz) : size_t(4096) ;
+   }
+   return pageSize ;
+}
+
+/******************************************/
+
+static void OutOfMemory(size_t len)
+{
+   fprintf(stderr, "Unable to allocate %lu bytes\n", (unsigned long) len) ;
+#if USE_MPI
+   MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+   exit(-1) ;
+#endif
+}
+
+/******************************************/
+
+static void *AlignedAlloc(size_t align, size_t len)
+{
+   void *ptr = NULL ;
+   if (posix_memalign(&ptr, align, len) != 0) {
+      OutOfMemory(len) ;
+   }
+   return ptr ;
+}
+
+/******************************************/
+
+/* Allocate a huge page block of len bytes (a multiple of 2MB) and
+   register it so that it can be told apart from malloc'd memory.
+   Callers hold the pageBlocks critical section, as for HugeFree and
+   FindBlock. */
+static void *HugeAlloc(size_t len, bool scratch)
+{
+   PageBlock block ;
+   block.ptr = NULL ;
+   block.len = len ;
+   block.mapped = false ;
+   block.scratch = scratch ;
+   block.inUse = true ;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+   if (fieldMemPolicy == FieldMemHugeTLB) {
+      void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) ;
+      if (ptr != MAP_FAILED) {
+         block.ptr = ptr ;
+         block.mapped = true ;
+      }
+   }
+#endif
+
+   if (block.ptr == NULL) {
+      if ((fieldMemPolicy == FieldMemHugeTLB) && !hugeTLBWarned) {
+         fprintf(stderr, "hugetlbfs pages unavailable (see /proc/sys/vm/nr_hugepages), "
+                         "using transparent huge pages\n") ;
+         hugeTLBWarned = true ;
+      }
+      block.ptr = AlignedAlloc(HUGE_PAGE_SIZE, len) ;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      // Advisory only; ignored where THP is disabled
+      madvise(block.ptr, len, MADV_HUGEPAGE) ;
+#endif
+   }
+
+   pageBlocks.push_back(block) ;
+   return block.ptr ;
+}
+
+/******************************************/
+
+static void HugeFree(Index_t idx)
+{
+   PageBlock &block = pageBlocks[idx] ;
+#if defined(__linux__)
+   if (block.mapped) {
+      munmap(block.ptr, block.len) ;
+   }
+   else
+#endif
+   {
+      free(block.ptr) ;
+   }
+   pageBlocks.erase(pageBlocks.begin() + idx) ;
+}
+
+/******************************************/
+
+static Index_t FindBlock(const void *ptr)
+{
+   for (size_t i=0 ; i<pageBlocks.size() ; ++i) {
+      if (pageBlocks[i].ptr == ptr) {
+         return Index_t(i) ;
+      }
+   }
+   return -1 ;
+}
+
+/******************************************/
+
+void *FieldAlloc(size_t bytes)
+{
+   if ((fieldMemPolicy != FieldMemDefault) && (bytes >= HUGE_PAGE_SIZE)) {
+      void *ptr ;
+#pragma omp critical (pageBlocks)
+      ptr = HugeAlloc(((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE,
+                      false) ;
+      return ptr ;
+   }
+
+   size_t pageSize = PageSize() ;
+   size_t len = ((bytes + pageSize - 1) / pageSize) * pageSize ;
+   return AlignedAlloc(pageSize, (len == 0) ? pageSize : len) ;
+}
+
+/******************************************/
+
+void FieldFree(void *ptr, size_t /* bytes */)
+{
+   // The policy only changes between domains, so under default pages
+   // no huge page block can be live
+   if (fieldMemPolicy == FieldMemDefault) {
+      free(ptr) ;
+      return ;
+   }
+
+   Index_t idx ;
+#pragma omp critical (pageBlocks)
+   {
+      idx = FindBlock(ptr) ;
+      if (idx >= 0) {
+         HugeFree(idx) ;
+      }
+   }
+   if (idx < 0) {
+      free(ptr) ;
+   }
+}
+
+/******************************************/
+
+void *ScratchAlloc(size_t bytes)
+{
+   if ((fieldMemPolicy == FieldMemDefault) || (bytes < HUGE_PAGE_SIZE)) {
+      return malloc(bytes) ;
+   }
+
+   size_t len = ((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE ;
+   void *ptr = NULL ;
+#pragma omp critical (pageBlocks)
+   {
+      for (size_t i=0 ; i<pageBlocks.size() ; ++i) {
+         PageBlock &block = pageBlocks[i] ;
+         if (block.scratch && !block.inUse && (block.len == len)) {
+            block.inUse = true ;
+            ptr = block.ptr ;
+            break ;
+         }
+      }
+      if (ptr == NULL) {
+         ptr = HugeAlloc(len, true) ;
+      }
+   }
+   return ptr ;
+}
+
+/******************************************/
+
+void ScratchFree(void *ptr)
+{
+   if (fieldMemPolicy == FieldMemDefault) {
+      free(ptr) ;
+      return ;
+   }
+
+   Index_t idx ;
+#pragma omp critical (pageBlocks)
+   {
+      idx = FindBlock(ptr) ;
+      if (idx >= 0) {
+         pageBlocks[idx].inUse = false ;   // keep for the next cycle
+      }
+   }
+   if (idx < 0) {
+      free(ptr) ;
+   }
+}
+
+/******************************************/
+
+void ReleaseScratchPool()
+{
+#pragma omp critical (pageBlocks)
+   for (Index_t i=Index_t(pageBlocks.size())-1 ; i>=0 ; --i) {
+      if (pageBlocks[i].scratch && !pageBlocks[i].inUse) {
+         HugeFree(i) ;
+      }
+   }
+}
+
+/******************************************/
+
+#if defined(__linux__) && defined(SYS_move_pages)
+
+/* Count sampled pages of [base, base+bytes) per NUMA node.  Pages that
+   have not been touched yet (or cannot be queried) are counted in
+   counts[MAX_NUMA_NODES].  Returns the number of pages sampled. */
+static Index_t CountFieldPages(const void *base, size_t bytes, Index_t *counts)
+{
+   const Index_t batch = 256 ;
+   void   *pages[256] ;
+   int     status[256] ;
+   size_t  pageSize = PageSize() ;
+   size_t  first = size_t(base) / pageSize ;
+   size_t  last = (size_t(base) + bytes - 1) / pageSize ;
+   size_t  numPages = last - first + 1 ;
+   size_t  stride = (numPages + PLACEMENT_SAMPLES - 1) / PLACEMENT_SAMPLES ;
+   Index_t sampled = 0 ;
+
+   for (size_t pg=0 ; pg<numPages ; ) {
+      Index_t n = 0 ;
+      for ( ; (n < batch) && (pg < numPages) ; ++n, pg += stride) {
+         pages[n] = reinterpret_cast<void *>((first + pg)*pageSize) ;
+      }
+      // nodes == NULL only queries where each page currently resides
+      if (syscall(SYS_move_pages, 0, (unsigned long) n, pages,
+                  NULL, status, 0) != 0) {
+         for (Index_t i=0 ; i<n ; ++i) {
+            status[i] = -1 ;
+         }
+      }
+      for (Index_t i=0 ; i<n ; ++i) {
+         if ((status[i] >= 0) && (status[i] < MAX_NUMA_NODES)) {
+            ++counts[status[i]] ;
+         }
+         else {
+            ++counts[MAX_NUMA_NODES] ;
+         }
+      }
+      sampled += n ;
+   }
+
+   return sampled ;
+}
+
+#endif
+
+/******************************************/
+
+void ReportFieldPlacement(Domain& domain, Int_t myRank)
+{
+   if (myRank != 0) {
+      return ;
+   }
+
+#if defined(__linux__) && defined(SYS_move_pages)
+   size_t numNode = domain.numNode() ;
+   size_t numElem = domain.numElem() ;
+   struct {
+      const char *name ;
+      const void *base ;
+      size_t      bytes ;
+   } field[] = {
+      { "x",         &domain.x(0),          numNode*sizeof(Real_t) },
+      { "y",         &domain.y(0),          numNode*sizeof(Real_t) },
+      { "z",         &domain.z(0),          numNode*sizeof(Real_t) },
+      { "xd",        &domain.xd(0),         numNode*sizeof(Real_t) },
+      { "yd",        &domain.yd(0),         numNode*sizeof(Real_t) },
+      { "zd",        &domain.zd(0),         numNode*sizeof(Real_t) },
+      { "fx",        &domain.fx(0),         numNode*sizeof(Real_t) },
+      { "fy",        &domain.fy(0),         numNode*sizeof(Real_t) },
+      { "fz",        &domain.fz(0),         numNode*sizeof(Real_t) },
+      { "nodalMass", &domain.nodalMass(0),  numNode*sizeof(Real_t) },
+      { "nodeBC",    &domain.nodeBC(0),     numNode*sizeof(unsigned char) },
+      { "nodelist",  domain.nodelist(0),    8*numElem*sizeof(Index_t) },
+      { "lxim",      &domain.lxim(0),       numElem*sizeof(Index_t) },
+      { "lxip",      &domain.lxip(0),       numElem*sizeof(Index_t) },
+      { "letam",     &domain.letam(0),      numElem*sizeof(Index_t) },
+      { "letap",     &domain.letap(0),      numElem*sizeof(Index_t) },
+      { "lzetam",    &domain.lzetam(0),     numElem*sizeof(Index_t) },
+      { "lzetap",    &domain.lzetap(0),     numElem*sizeof(Index_t) },
+      { "elemBC",    &domain.elemBC(0),     numElem*sizeof(Int_t) },
+      { "delvNbr",   domain.delvNbr(0),     6*numElem*sizeof(Index_t) },
+      { "e",         &domain.e(0),          numElem*sizeof(Real_t) },
+      { "p",         &domain.p(0),          numElem*sizeof(Real_t) },
+      { "q",         &domain.q(0),          numElem*sizeof(Real_t) },
+      { "ql",        &domain.ql(0),         numElem*sizeof(Real_t) },
+      { "qq",        &domain.qq(0),         numElem*sizeof(Real_t) },
+      { "v",         &domain.v(0),          numElem*sizeof(Real_t) },
+      { "volo",      &domain.volo(0),       numElem*sizeof(Real_t) },
+      { "vnew",      &domain.vnew(0),       numElem*sizeof(Real_t) },
+      { "delv",      &domain.delv(0),       numElem*sizeof(Real_t) },
+      { "vdov",      &domain.vdov(0),       numElem*sizeof(Real_t) },
+      { "arealg",    &domain.arealg(0),     numElem*sizeof(Real_t) },
+      { "ss",        &domain.ss(0),         numElem*sizeof(Real_t) },
+      { "elemMass",  &domain.elemMass(0),   numElem*sizeof(Real_t) }
+   } ;
+   const Int_t numField = Int_t(sizeof(field)/sizeof(field[0])) ;
+
+   Index_t counts[numField][MAX_NUMA_NODES+1] ;
+   Index_t sampled[numField] ;
+   Int_t   numNuma = 1 ;
+   bool    untouched = false ;
+
+   memset(counts, 0, sizeof(counts)) ;
+   for (Int_t f=0 ; f<numField ; ++f) {
+      sampled[f] = CountFieldPages(field[f].base, field[f].bytes, counts[f]) ;
+      for (Int_t n=0 ; n<MAX_NUMA_NODES ; ++n) {
+         if (counts[f][n] != 0 && n >= numNuma) {
+            numNuma = n + 1 ;
+         }
+      }
+      untouched = untouched || (counts[f][MAX_NUMA_NODES] != 0) ;
+   }
+
+   printf("Field page placement on rank 0 (%% of sampled %luKB pages):\n",
+          (unsigned long)(PageSize() >> 10)) ;
+   printf("   %-10s %8s", "field", "pages") ;
+   for (Int_t n=0 ; n<numNuma ; ++n) {
+      printf("   node%-3d", n) ;
+   }
+   if (untouched) {
+      printf("   %7s", "none") ;
+   }
+   printf("\n") ;
+
+   for (Int_t f=0 ; f<numField ; ++f) {
+      Real_t scale = Real_t(100.0) / Real_t(sampled[f]) ;
+      printf("   %-10s %8d", field[f].name, int(sampled[f])) ;
+      for (Int_t n=0 ; n<numNuma ; ++n) {
+         printf("   %6.1f%%", double(counts[f][n]*scale)) ;
+      }
+      if (untouched) {
+         printf("   %6.1f%%", double(counts[f][MAX_NUMA_NODES]*scale)) ;
+      }
+      printf("\n") ;
+   }
+   printf("\n") ;
+#else
+   printf("Field page placement report is not available on this platform\n\n") ;
+#endif
+}
@@ -0,0 +1,581 @@
+#include <math.h>
+#if USE_MPI
+# include <mpi.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "lulesh.h"
+
+/*
+   Unstructured hexahedral mesh input.  The file holds the whole mesh;
+   every rank reads it (through rank 0), cuts it into numRanks parts by
+   recursive coordinate bisection of the element centroids and builds
+   its Domain from its own part.  Face neighbors and boundary conditions
+   are derived from the connectivity: a face that no other element
+   shares is a symmetry plane when its four nodes share a NODE_SYMM_*
+   flag and a free surface otherwise.
+
+   Parts exchange data through explicit halo lists (nodes shared with
+   each neighbor rank, elements read across a face) rather than the 26
+   lattice neighbors.  The monotonic q limiter still pairs the xi, eta
+   and zeta gradients of face neighbors, so meshes are expected to keep
+   a consistent corner orientation, as BuildMesh does.
+
+   File format (native endianness):
+
+      char           magic[8]      "LULHEX1\0"
+      Index_t        numNode, numElem, originElem
+      Real_t         originEnergy
+      Real_t         x[numNode], y[numNode], z[numNode]
+      unsigned char  nodeBC[numNode]
+      Index_t        nodelist[8*numElem]
+*/
+
+static const char meshMagic[8] = { 'L', 'U', 'L', 'H', 'E', 'X', '1', '\0' } ;
+
+/******************************************/
+
+/* Collective: stop every rank when rank 0 could not read the mesh */
+static void CheckMeshRead(bool ok, const char *message,
+                          const char *fname, Int_t myRank)
+{
+#if USE_MPI
+   Int_t flag = ok ? 1 : 0 ;
+   MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD) ;
+   ok = (flag != 0) ;
+#endif
+
+   if (!ok) {
+      if (myRank == 0) {
+         fprintf(stderr, message, fname) ;
+      }
+#if USE_MPI
+      MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+      exit(-1) ;
+#endif
+   }
+}
+
+/******************************************/
+
+void ReadHexMesh(const char *fname, HexMesh *mesh, Int_t myRank)
+{
+   Index_t counts[3] = { 0, 0, -1 } ;
+   Real_t  energy = Real_t(0.0) ;
+   FILE   *fp = NULL ;
+   bool    ok = true ;
+
+   if (myRank == 0) {
+      char magic[8] ;
+      fp = fopen(fname, "rb") ;
+      ok = (fp != NULL) &&
+           (fread(magic, 1, 8, fp) == 8) &&
+           (memcmp(magic, meshMagic, 8) == 0) &&
+           (fread(counts, sizeof(Index_t), 3, fp) == 3) &&
+           (fread(&energy, sizeof(Real_t), 1, fp) == 1) &&
+           (counts[0] >= 8) && (counts[1] >= 1) &&
+           (counts[2] >= 0) && (counts[2] < counts[1]) ;
+   }
+   CheckMeshRead(ok, "Unable to read hex mesh from %s\n", fname, myRank) ;
+
+#if USE_MPI
+   MPI_Bcast(counts, 3, MPI_INT, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(&energy, 1, ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE),
+             0, MPI_COMM_WORLD) ;
+#endif
+
+   Index_t numNode = counts[0] ;
+   Index_t numElem = counts[1] ;
+   mesh->numNode = numNode ;
+   mesh->numElem = numElem ;
+   mesh->originElem = counts[2] ;
+   mesh->originEnergy = energy ;
+   mesh->x.resize(numNode) ;
+   mesh->y.resize(numNode) ;
+   mesh->z.resize(numNode) ;
+   mesh->nodeBC.resize(numNode) ;
+   mesh->nodelist.resize(size_t(8)*numElem) ;
+
+   if (myRank == 0) {
+      size_t numCorner = size_t(8)*numElem ;
+      ok = (fread(&mesh->x[0], sizeof(Real_t), numNode, fp) == size_t(numNode)) &&
+           (fread(&mesh->y[0], sizeof(Real_t), numNode, fp) == size_t(numNode)) &&
+           (fread(&mesh->z[0], sizeof(Real_t), numNode, fp) == size_t(numNode)) &&
+           (fread(&mesh->nodeBC[0], 1, numNode, fp) == size_t(numNode)) &&
+           (fread(&mesh->nodelist[0], sizeof(Index_t), numCorner, fp) == numCorner) ;
+      fclose(fp) ;
+      for (size_t k=0 ; ok && k<numCorner ; ++k) {
+         ok = (mesh->nodelist[k] >= 0) && (mesh->nodelist[k] < numNode) ;
+      }
+   }
+   CheckMeshRead(ok, "Truncated or invalid hex mesh in %s\n", fname, myRank) ;
+
+#if USE_MPI
+   MPI_Datatype baseType = ((sizeof(Real_t) == 4) ? MPI_FLOAT : MPI_DOUBLE) ;
+   MPI_Bcast(&mesh->x[0], numNode, baseType, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(&mesh->y[0], numNode, baseType, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(&mesh->z[0], numNode, baseType, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(&mesh->nodeBC[0], numNode, MPI_UNSIGNED_CHAR, 0, MPI_COMM_WORLD) ;
+   MPI_Bcast(&mesh->nodelist[0], 8*numElem, MPI_INT, 0, MPI_COMM_WORLD) ;
+#endif
+}
+
+/******************************************/
+
+/* Writes a whole (single rank) domain as it was built, so the
+   built-in problem can be rerun through the file mesh path */
+void WriteHexMesh(Domain& domain, const char *fname)
+{
+   FILE *fp = fopen(fname, "wb") ;
+   if (fp == NULL) {
+      fprintf(stderr, "Unable to open %s to write hex mesh\n", fname) ;
+      return ;
+   }
+
+   Index_t numNode = domain.numNode() ;
+   Index_t numElem = domain.numElem() ;
+   Index_t counts[3] = { numNode, numElem, domain.originElem() } ;
+   Real_t  energy = domain.e(domain.originElem()) ;
+   size_t  numCorner = size_t(8)*numElem ;
+   Domain_member coord[3] = { &Domain::x, &Domain::y, &Domain::z } ;
+   std::vector<Real_t> buf(numNode) ;
+   std::vector<unsigned char> nodeBC(numNode) ;
+
+   bool ok = (fwrite(meshMagic, 1, 8, fp) == 8) &&
+             (fwrite(counts, sizeof(Index_t), 3, fp) == 3) &&
+             (fwrite(&energy, sizeof(Real_t), 1, fp) == 1) ;
+   for (Int_t d=0 ; ok && d<3 ; ++d) {
+      for (Index_t i=0 ; i<numNode ; ++i) {
+         buf[i] = (domain.*coord[d])(i) ;
+      }
+      ok = (fwrite(&buf[0], sizeof(Real_t), numNode, fp) == size_t(numNode)) ;
+   }
+   for (Index_t i=0 ; i<numNode ; ++i) {
+      nodeBC[i] = domain.nodeBC(i) ;
+   }
+   ok = ok &&
+        (fwrite(&nodeBC[0], 1, numNode, fp) == size_t(numNode)) &&
+        (fwrite(domain.nodelist(0), sizeof(Index_t), numCorner, fp) == numCorner) ;
+
+   if (!ok) {
+      fprintf(stderr, "Error writing hex mesh to %s\n", fname) ;
+   }
+   fclose(fp) ;
+}
+
+/******************************************/
+
+/* Orders element ids by one centroid coordinate, ties by id, so the
+   bisection does not depend on the nth_element implementation */
+struct CentroidLess {
+   CentroidLess(const Real_t *coord) : m_coord(coord) {}
+   bool operator()(Index_t a, Index_t b) const
+   {
+      return (m_coord[a] < m_coord[b]) ||
+             ((m_coord[a] == m_coord[b]) && (a < b)) ;
+   }
+   const Real_t *m_coord ;
+} ;
+
+/******************************************/
+
+/* Recursive coordinate bisection: cut across the longest extent of the
+   elements' bounding box, with element counts proportional to the
+   number of parts on each side */
+static void BisectElems(const Real_t *const centroid[3],
+                        Index_t *elems, Index_t count,
+                        Int_t firstPart, Int_t numParts,
+                        std::vector<Int_t>& part)
+{
+   if (numParts == 1) {
+      for (Index_t i=0 ; i<count ; ++i) {
+         part[elems[i]] = firstPart ;
+      }
+      return ;
+   }
+
+   Int_t axis = 0 ;
+   Real_t extent = Real_t(-1.0) ;
+   for (Int_t d=0 ; d<3 ; ++d) {
+      const Real_t *c = centroid[d] ;
+      Real_t lo = c[elems[0]] ;
+      Real_t hi = c[elems[0]] ;
+      for (Index_t i=1 ; i<count ; ++i) {
+         lo = MIN(lo, c[elems[i]]) ;
+         hi = MAX(hi, c[elems[i]]) ;
+      }
+      if (hi - lo > extent) {
+         extent = hi - lo ;
+         axis = d ;
+      }
+   }
+
+   Int_t lowParts = numParts/2 ;
+   Index_t lowCount = Index_t((Int8_t(count)*lowParts)/numParts) ;
+   std::nth_element(elems, elems + lowCount, elems + count,
+                    CentroidLess(centroid[axis])) ;
+
+   BisectElems(centroid, elems, lowCount,
+               firstPart, lowParts, part) ;
+   BisectElems(centroid, elems + lowCount, count - lowCount,
+               firstPart + lowParts, numParts - lowParts, part) ;
+}
+
+/******************************************/
+
+/* Local number of each mesh node used by the given elements (-1 if
+   unused), in mesh id order.  Returns the number of local nodes */
+static Index_t LocalNodeMap(const HexMesh& mesh,
+                            const std::vector<Index_t>& elems,
+                            std::vector<Index_t>& nodeLocal)
+{
+   nodeLocal.assign(mesh.numNode, -1) ;
+   for (size_t i=0 ; i<elems.size() ; ++i) {
+      const Index_t *corner = &mesh.nodelist[size_t(8)*elems[i]] ;
+      for (Index_t j=0 ; j<8 ; ++j) {
+         nodeLocal[corner[j]] = 0 ;
+      }
+   }
+
+   Index_t numNode = 0 ;
+   for (Index_t g=0 ; g<mesh.numNode ; ++g) {
+      if (nodeLocal[g] == 0) {
+         nodeLocal[g] = numNode++ ;
+      }
+   }
+   return numNode ;
+}
+
+/******************************************/
+
+void
+Domain::PartitionHexMesh(const HexMesh& mesh, Int_t myRank,
+                         std::vector<Int_t>& part)
+{
+   Index_t meshElem = mesh.numElem ;
+   Int_t numParts = m_numRanks ;
+
+   if (numParts > meshElem) {
+      if (myRank == 0) {
+         fprintf(stderr, "More ranks than elements in the hex mesh\n") ;
+      }
+#if USE_MPI
+      MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+      exit(-1) ;
+#endif
+   }
+
+   part.assign(meshElem, 0) ;
+   if (numParts > 1) {
+      std::vector<Real_t> cx(meshElem), cy(meshElem), cz(meshElem) ;
+      std::vector<Index_t> elems(meshElem) ;
+
+#pragma omp parallel for firstprivate(meshElem)
+      for (Index_t i=0 ; i<meshElem ; ++i) {
+         const Index_t *corner = &mesh.nodelist[size_t(8)*i] ;
+         Real_t sx = Real_t(0.0) ;
+         Real_t sy = Real_t(0.0) ;
+         Real_t sz = Real_t(0.0) ;
+         for (Index_t j=0 ; j<8 ; ++j) {
+            sx += mesh.x[corner[j]] ;
+            sy += mesh.y[corner[j]] ;
+            sz += mesh.z[corner[j]] ;
+         }
+         cx[i] = Real_t(0.125)*sx ;
+         cy[i] = Real_t(0.125)*sy ;
+         cz[i] = Real_t(0.125)*sz ;
+         elems[i] = i ;
+      }
+
+      const Real_t *centroid[3] = { &cx[0], &cy[0], &cz[0] } ;
+      BisectElems(centroid, &elems[0], meshElem, 0, numParts, part) ;
+
+      // Rank 0 reports the origin energy, so it gets the deposit
+      Int_t originPart = part[mesh.originElem] ;
+      for (Index_t i=0 ; i<meshElem ; ++i) {
+         if (part[i] == originPart) {
+            part[i] = 0 ;
+         }
+         else if (part[i] == 0) {
+            part[i] = originPart ;
+         }
+      }
+   }
+
+   // Local elements and nodes keep the mesh id order
+   m_meshElem.clear() ;
+   for (Index_t i=0 ; i<meshElem ; ++i) {
+      if (part[i] == myRank) {
+         m_meshElem.push_back(i) ;
+      }
+   }
+
+   std::vector<Index_t> nodeLocal ;
+   m_numElem = Index_t(m_meshElem.size()) ;
+   m_numNode = LocalNodeMap(mesh, m_meshElem, nodeLocal) ;
+   m_meshNumElem = meshElem ;
+
+   // There is no lattice behind a file mesh
+   m_sizeX = 0 ;
+   m_sizeY = 0 ;
+   m_sizeZ = 0 ;
+}
+
+/******************************************/
+
+/* The element other than elem that has all four given corners, or -1
+   on the boundary of the mesh */
+static Index_t FindFaceNeighbor(const HexMesh& mesh,
+                                const std::vector<Index_t>& nodeElemStart,
+                                const std::vector<Index_t>& nodeElemList,
+                                Index_t elem, const Index_t corner[4])
+{
+   for (Index_t k=nodeElemStart[corner[0]] ;
+        k<nodeElemStart[corner[0]+1] ; ++k) {
+      Index_t other = nodeElemList[k] ;
+      if (other == elem) {
+         continue ;
+      }
+      const Index_t *otherCorner = &mesh.nodelist[size_t(8)*other] ;
+      Int_t found = 1 ;
+      for (Int_t c=1 ; c<4 ; ++c) {
+         for (Int_t j=0 ; j<8 ; ++j) {
+            if (otherCorner[j] == corner[c]) {
+               ++found ;
+               break ;
+            }
+         }
+      }
+      if (found == 4) {
+         return other ;
+      }
+   }
+   return -1 ;
+}
+
+/******************************************/
+
+#if USE_MPI
+
+typedef std::pair<Int_t, Index_t> RankIndex ;
+
+/* Offsets of each rank's run in pairs sorted by rank (ranks that do not
+   appear get an empty run), and optionally the indices themselves */
+static void GroupByRank(const std::vector<Int_t>& ranks,
+                        const std::vector<RankIndex>& pairs,
+                        std::vector<Index_t>& start,
+                        std::vector<Index_t>& index)
+{
+   start.resize(ranks.size() + 1) ;
+   index.resize(pairs.size()) ;
+   size_t k = 0 ;
+   for (size_t n=0 ; n<ranks.size() ; ++n) {
+      start[n] = Index_t(k) ;
+      while (k < pairs.size() && pairs[k].first == ranks[n]) {
+         index[k] = pairs[k].second ;
+         ++k ;
+      }
+   }
+   start[ranks.size()] = Index_t(k) ;
+}
+
+/******************************************/
+
+/* Neighbor ranks are those sharing a node; elements across faces are a
+   subset of them.  Every list is sorted by mesh id on both sides */
+static void SetupHexMeshHalos(Domain& domain, Int_t myRank,
+                              const std::vector<Int_t>& part,
+                              const std::vector<Index_t>& nodeLocal,
+                              const std::vector<Index_t>& nodeElemStart,
+                              const std::vector<Index_t>& nodeElemList,
+                              const std::vector<RankIndex>& ghosts,
+                              const std::vector<RankIndex>& sends)
+{
+   std::vector<RankIndex> shared ;
+   std::vector<Index_t> unused ;
+
+   domain.haloNodes.clear() ;
+   for (size_t g=0 ; g<nodeLocal.size() ; ++g) {
+      if (nodeLocal[g] < 0) {
+         continue ;
+      }
+      Index_t pos = Index_t(domain.haloNodes.size()) ;
+      bool isShared = false ;
+      for (Index_t k=nodeElemStart[g] ; k<nodeElemStart[g+1] ; ++k) {
+         Int_t owner = part[nodeElemList[k]] ;
+         if (owner != myRank) {
+            shared.push_back(RankIndex(owner, pos)) ;
+            isShared = true ;
+         }
+      }
+      if (isShared) {
+         domain.haloNodes.push_back(nodeLocal[g]) ;
+      }
+   }
+   std::sort(shared.begin(), shared.end()) ;
+   shared.erase(std::unique(shared.begin(), shared.end()), shared.end()) ;
+
+   domain.haloRanks.clear() ;
+   for (size_t k=0 ; k<shared.size() ; ++k) {
+      if (domain.haloRanks.empty() ||
+          domain.haloRanks.back() != shared[k].first) {
+         domain.haloRanks.push_back(shared[k].first) ;
+      }
+   }
+
+   GroupByRank(domain.haloRanks, shared,
+               domain.haloNodeStart, domain.haloNodePos) ;
+   GroupByRank(domain.haloRanks, sends,
+               domain.haloSendStart, domain.haloSendElem) ;
+   GroupByRank(domain.haloRanks, ghosts,
+               domain.haloRecvStart, unused) ;
+}
+
+#endif
+
+/******************************************/
+
+void
+Domain::BuildHexMesh(const HexMesh& mesh, Int_t myRank,
+                     const std::vector<Int_t>& part)
+{
+   Index_t numElem = this->numElem() ;
+   Index_t meshNode = mesh.numNode ;
+   Index_t meshElem = mesh.numElem ;
+   std::vector<Index_t> nodeLocal ;
+   std::vector<Index_t> elemLocal(meshElem, -1) ;
+
+   LocalNodeMap(mesh, m_meshElem, nodeLocal) ;
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      elemLocal[m_meshElem[i]] = i ;
+   }
+
+   for (Index_t g=0 ; g<meshNode ; ++g) {
+      Index_t n = nodeLocal[g] ;
+      if (n >= 0) {
+         x(n) = mesh.x[g] ;
+         y(n) = mesh.y[g] ;
+         z(n) = mesh.z[g] ;
+         nodeBC(n) = mesh.nodeBC[g] ;
+      }
+   }
+
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      const Index_t *corner = &mesh.nodelist[size_t(8)*m_meshElem[i]] ;
+      Index_t *localNode = nodelist(i) ;
+      for (Index_t j=0 ; j<8 ; ++j) {
+         localNode[j] = nodeLocal[corner[j]] ;
+      }
+   }
+   m_latticeNodes = false ;
+
+   // Elements around each node of the whole mesh, in id order
+   std::vector<Index_t> nodeElemStart(meshNode + 1, 0) ;
+   std::vector<Index_t> nodeElemList(size_t(8)*meshElem) ;
+   for (size_t k=0 ; k<mesh.nodelist.size() ; ++k) {
+      ++nodeElemStart[mesh.nodelist[k] + 1] ;
+   }
+   for (Index_t g=0 ; g<meshNode ; ++g) {
+      nodeElemStart[g+1] += nodeElemStart[g] ;
+   }
+   {
+      std::vector<Index_t> fill(nodeElemStart.begin(), nodeElemStart.end() - 1) ;
+      for (size_t k=0 ; k<mesh.nodelist.size() ; ++k) {
+         nodeElemList[fill[mesh.nodelist[k]]++] = Index_t(k/8) ;
+      }
+   }
+
+   // Faces in the order xi-, xi+, eta-, eta+, zeta-, zeta+ of the
+   // corner numbering of BuildMesh
+   static const Index_t faceCorner[6][4] = {
+      { 0, 3, 7, 4 }, { 1, 2, 6, 5 }, { 0, 1, 5, 4 },
+      { 3, 2, 6, 7 }, { 0, 1, 2, 3 }, { 4, 5, 6, 7 } } ;
+
+   std::vector<Index_t> faceNbr(size_t(6)*numElem) ;
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      Index_t elem = m_meshElem[i] ;
+      const Index_t *corner = &mesh.nodelist[size_t(8)*elem] ;
+      for (Index_t f=0 ; f<6 ; ++f) {
+         Index_t faceNode[4] ;
+         for (Index_t c=0 ; c<4 ; ++c) {
+            faceNode[c] = corner[faceCorner[f][c]] ;
+         }
+         faceNbr[6*i+f] = FindFaceNeighbor(mesh, nodeElemStart, nodeElemList,
+                                           elem, faceNode) ;
+      }
+   }
+
+   // Off-rank face neighbors get ghost slots past numElem, grouped by
+   // rank and ordered by mesh id
+   std::vector<std::pair<Int_t, Index_t> > ghosts ;
+   std::vector<std::pair<Int_t, Index_t> > sends ;
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      for (Index_t f=0 ; f<6 ; ++f) {
+         Index_t nbr = faceNbr[6*i+f] ;
+         if (nbr >= 0 && part[nbr] != myRank) {
+            ghosts.push_back(std::make_pair(part[nbr], nbr)) ;
+            sends.push_back(std::make_pair(part[nbr], i)) ;
+         }
+      }
+   }
+   std::sort(ghosts.begin(), ghosts.end()) ;
+   ghosts.erase(std::unique(ghosts.begin(), ghosts.end()), ghosts.end()) ;
+   std::sort(sends.begin(), sends.end()) ;
+   sends.erase(std::unique(sends.begin(), sends.end()), sends.end()) ;
+   m_numGhostElem = Index_t(ghosts.size()) ;
+
+#pragma omp parallel for firstprivate(numElem)
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      const Int_t symmBC[6] = { XI_M_SYMM, XI_P_SYMM, ETA_M_SYMM,
+                                ETA_P_SYMM, ZETA_M_SYMM, ZETA_P_SYMM } ;
+      const Int_t freeBC[6] = { XI_M_FREE, XI_P_FREE, ETA_M_FREE,
+                                ETA_P_FREE, ZETA_M_FREE, ZETA_P_FREE } ;
+      const Int_t commBC[6] = { XI_M_COMM, XI_P_COMM, ETA_M_COMM,
+                                ETA_P_COMM, ZETA_M_COMM, ZETA_P_COMM } ;
+      const Index_t *corner = &mesh.nodelist[size_t(8)*m_meshElem[i]] ;
+      Index_t face[6] ;
+      Int_t bc = Int_t(0) ;
+
+      for (Index_t f=0 ; f<6 ; ++f) {
+         Index_t nbr = faceNbr[6*i+f] ;
+         if (nbr < 0) {
+            unsigned char common = NODE_SYMM_X | NODE_SYMM_Y | NODE_SYMM_Z ;
+            for (Index_t c=0 ; c<4 ; ++c) {
+               common &= mesh.nodeBC[corner[faceCorner[f][c]]] ;
+            }
+            bc |= (common != 0) ? symmBC[f] : freeBC[f] ;
+            face[f] = i ;
+         }
+         else if (part[nbr] == myRank) {
+            face[f] = elemLocal[nbr] ;
+         }
+         else {
+            bc |= commBC[f] ;
+            face[f] = numElem + Index_t(std::lower_bound(ghosts.begin(), ghosts.end(),
+                                                         std::make_pair(part[nbr], nbr)) -
+                                        ghosts.begin()) ;
+         }
+      }
+
+      lxim(i)   = face[0] ;
+      lxip(i)   = face[1] ;
+      letam(i)  = face[2] ;
+      letap(i)  = face[3] ;
+      lzetam(i) = face[4] ;
+      lzetap(i) = face[5] ;
+      elemBC(i) = bc ;
+   }
+
+#if USE_MPI
+   SetupHexMeshHalos(*this, myRank, part, nodeLocal,
+                     nodeElemStart, nodeElemList, ghosts, sends) ;
+#endif
+}
@@ -0,0 +1,561 @@
+#include "lulesh.h"
+
+// Without LULESH_TIMERS the timers are empty inlines in lulesh.h
+#if LULESH_TIMERS
+
+#if USE_MPI
+# include <mpi.h>
+#endif
+#if _OPENMP
+# include <omp.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+#endif
+
+/*
+   Phase timers.  Phases nest (e.g. CommSend inside CalcForceForNodes)
+   and time is charged to the innermost running phase only, so the
+   phase times add up to the time of the timed region.  A start/stop
+   pair costs two clock_gettime calls plus, when hardware counters are
+   enabled, one read() per thread.
+*/
+
+#define TIMER_STACK_DEPTH 16
+
+struct PhaseTimer {
+   double   time ;
+   Int8_t   calls ;
+   uint64_t count[MAX_PERF_COUNTERS] ;
+   double   bytes ;    // analytic work, see TimerAddWork
+   double   flops ;
+} ;
+
+static const char *phaseName[TimerEOSRegion] = {
+   "TimeIncrement",
+   "CalcForceForNodes",
+   "IntegrateNodes",
+   "CalcLagrangeElements",
+   "CalcQForElems",
+   "ApplyMaterialProperties",
+   "UpdateVolumesForElems",
+   "CalcTimeConstraints",
+   "MigrateRegions",
+   "CommRecv",
+   "CommSend",
+   "CommSBN",
+   "CommSyncPosVel",
+   "CommMonoQ",
+   "Checkpoint",
+   "VizOutput"
+} ;
+
+static std::vector<PhaseTimer> timers ;
+static Int_t    timerStack[TIMER_STACK_DEPTH] ;
+static Int_t    timerDepth = 0 ;
+static double   lastTime ;
+static uint64_t lastCount[MAX_PERF_COUNTERS] ;
+
+static Int_t    numCounters = 0 ;     // 0 = hardware counters off
+static std::vector<int> perfLeader ;  // one counter group per thread
+
+/******************************************/
+
+/* Inside a parallel region every thread of the team passes through
+ * the kernel timers; the stack belongs to the master thread */
+static inline bool TimerThread()
+{
+#if _OPENMP
+   return omp_get_thread_num() == 0 ;
+#else
+   return true ;
+#endif
+}
+
+/******************************************/
+
+static inline double TimerNow()
+{
+   struct timespec ts ;
+   clock_gettime(CLOCK_MONOTONIC, &ts) ;
+   return double(ts.tv_sec) + 1.0e-9*double(ts.tv_nsec) ;
+}
+
+/******************************************/
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+
+static int PerfOpen(uint32_t type, uint64_t config, int groupFd)
+{
+   struct perf_event_attr attr ;
+   memset(&attr, 0, sizeof(attr)) ;
+   attr.size = sizeof(attr) ;
+   attr.type = type ;
+   attr.config = config ;
+   attr.exclude_kernel = 1 ;
+   attr.exclude_hv = 1 ;
+   attr.read_format = PERF_FORMAT_GROUP ;
+   // pid 0, cpu -1: the calling thread, on whatever cpu it runs
+   return int(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0)) ;
+}
+
+/* Open a counter group for the calling thread; returns the leader */
+static int PerfOpenGroup(uint64_t flopEvent, Int_t *opened)
+{
+   int leader = PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1) ;
+   *opened = 0 ;
+   if (leader < 0) {
+      return -1 ;
+   }
+   if ((PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader) < 0) ||
+       (PerfOpen(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader) < 0)) {
+      close(leader) ;   // closing the leader detaches the members
+      return -1 ;
+   }
+   *opened = 3 ;
+   if ((flopEvent != 0) && (PerfOpen(PERF_TYPE_RAW, flopEvent, leader) >= 0)) {
+      *opened = 4 ;
+   }
+   return leader ;
+}
+
+#endif
+
+/******************************************/
+
+static inline void ReadCounters(uint64_t *count)
+{
+   for (Int_t c=0 ; c<numCounters ; ++c) {
+      count[c] = 0 ;
+   }
+   for (size_t t=0 ; t<perfLeader.size() ; ++t) {
+      uint64_t buf[1+MAX_PERF_COUNTERS] ;
+      if (read(perfLeader[t], buf, sizeof(buf)) > 0) {
+         for (Int_t c=0 ; c<numCounters ; ++c) {
+            count[c] += buf[1+c] ;
+         }
+      }
+   }
+}
+
+/******************************************/
+
+/* Phases nested deeper than the stack still count in timerDepth, so
+   starts and stops stay paired; their time goes to the deepest phase
+   that has a slot */
+static inline PhaseTimer &TopTimer()
+{
+   return timers[timerStack[MIN(timerDepth, TIMER_STACK_DEPTH) - 1]] ;
+}
+
+static inline void ChargeTop(double now, const uint64_t *count)
+{
+   PhaseTimer &timer = TopTimer() ;
+   timer.time += now - lastTime ;
+   for (Int_t c=0 ; c<numCounters ; ++c) {
+      timer.count[c] += count[c] - lastCount[c] ;
+   }
+}
+
+/******************************************/
+
+void TimerInit(Int_t numReg, bool perfCounters, Int_t myRank)
+{
+   timers.resize(TimerEOSRegion + numReg) ;
+   TimerReset() ;
+
+   if (!perfCounters) {
+      return ;
+   }
+
+#if defined(__linux__) && defined(SYS_perf_event_open)
+   // Model specific raw event for floating point operations, e.g.
+   // LULESH_PERF_FLOPS=0x... ; there is no portable generic FLOP event
+   const char *flopEnv = getenv("LULESH_PERF_FLOPS") ;
+   uint64_t flopEvent = (flopEnv != NULL) ? strtoull(flopEnv, NULL, 0) : 0 ;
+#if _OPENMP
+   Int_t numThreads = omp_get_max_threads() ;
+#else
+   Int_t numThreads = 1 ;
+#endif
+   std::vector<Int_t> opened(numThreads, 0) ;
+   perfLeader.assign(numThreads, -1) ;
+
+   // Each thread counts itself; all later parallel regions reuse the
+   // same threads
+#pragma omp parallel
+   {
+#if _OPENMP
+      Int_t t = omp_get_thread_num() ;
+#else
+      Int_t t = 0 ;
+#endif
+      perfLeader[t] = PerfOpenGroup(flopEvent, &opened[t]) ;
+   }
+
+   numCounters = MAX_PERF_COUNTERS ;
+   for (Int_t t=0 ; t<numThreads ; ++t) {
+      numCounters = MIN(numCounters, opened[t]) ;
+   }
+
+   if (numCounters == 0) {
+      for (Int_t t=0 ; t<numThreads ; ++t) {
+         if (perfLeader[t] >= 0) {
+            close(perfLeader[t]) ;
+         }
+      }
+      perfLeader.clear() ;
+      if (myRank == 0) {
+         fprintf(stderr, "Hardware counters unavailable "
+                         "(see /proc/sys/kernel/perf_event_paranoid)\n") ;
+      }
+   }
+#else
+   if (myRank == 0) {
+      fprintf(stderr, "Hardware counters are not supported on this platform\n") ;
+   }
+#endif
+}
+
+/******************************************/
+
+void TimerReset()
+{
+   memset(&timers[0], 0, timers.size()*sizeof(PhaseTimer)) ;
+   timerDepth = 0 ;
+}
+
+/******************************************/
+
+void TimerStart(Int_t phase)
+{
+   if (!TimerThread()) {
+      return ;
+   }
+   double now = TimerNow() ;
+   uint64_t count[MAX_PERF_COUNTERS] ;
+
+   if (numCounters != 0) {
+      ReadCounters(count) ;
+   }
+   if (timerDepth > 0) {
+      ChargeTop(now, count) ;
+   }
+   if (timerDepth < TIMER_STACK_DEPTH) {
+      timerStack[timerDepth] = phase ;
+      ++timers[phase].calls ;
+   }
+   ++timerDepth ;
+   lastTime = now ;
+   if (numCounters != 0) {
+      memcpy(lastCount, count, sizeof(count)) ;
+   }
+}
+
+/******************************************/
+
+void TimerStop()
+{
+   if (!TimerThread()) {
+      return ;
+   }
+   double now = TimerNow() ;
+   uint64_t count[MAX_PERF_COUNTERS] ;
+
+   if (numCounters != 0) {
+      ReadCounters(count) ;
+   }
+   if (timerDepth > 0) {
+      ChargeTop(now, count) ;
+      --timerDepth ;
+   }
+   lastTime = now ;
+   if (numCounters != 0) {
+      memcpy(lastCount, count, sizeof(count)) ;
+   }
+}
+
+/******************************************/
+
+void TimerAddWork(double bytes, double flops)
+{
+   if ((timerDepth > 0) && TimerThread()) {
+      PhaseTimer& timer = TopTimer() ;
+      timer.bytes += bytes ;
+      timer.flops += flops ;
+   }
+}
+
+/******************************************/
+
+Int_t TimerGather(Int_t myRank, Int_t numRanks, std::vector<PhaseStats>& stats)
+{
+   Int_t numTimers = Int_t(timers.size()) ;
+   std::vector<double> time(numTimers) ;
+   std::vector<double> tmin(numTimers), tmax(numTimers), tsum(numTimers) ;
+   std::vector<double> count(numTimers*MAX_PERF_COUNTERS, 0.0) ;
+   std::vector<double> countSum(numTimers*MAX_PERF_COUNTERS, 0.0) ;
+   std::vector<double> work(2*numTimers), workSum(2*numTimers) ;
+
+   for (Int_t i=0 ; i<numTimers ; ++i) {
+      time[i] = timers[i].time ;
+      work[2*i]   = timers[i].bytes ;
+      work[2*i+1] = timers[i].flops ;
+      for (Int_t c=0 ; c<numCounters ; ++c) {
+         count[i*MAX_PERF_COUNTERS + c] = double(timers[i].count[c]) ;
+      }
+   }
+
+#if USE_MPI
+   MPI_Reduce(&time[0], &tmin[0], numTimers, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(&time[0], &tmax[0], numTimers, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(&time[0], &tsum[0], numTimers, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(&count[0], &countSum[0], numTimers*MAX_PERF_COUNTERS, MPI_DOUBLE,
+              MPI_SUM, 0, MPI_COMM_WORLD) ;
+   MPI_Reduce(&work[0], &workSum[0], 2*numTimers, MPI_DOUBLE,
+              MPI_SUM, 0, MPI_COMM_WORLD) ;
+#else
+   tmin = time ;
+   tmax = time ;
+   tsum = time ;
+   countSum = count ;
+   workSum = work ;
+#endif
+
+   stats.clear() ;
+   if (myRank != 0) {
+      return 0 ;
+   }
+
+   for (Int_t i=0 ; i<numTimers ; ++i) {
+      PhaseStats phase ;
+      if (timers[i].calls == 0) {
+         continue ;
+      }
+      if (i < TimerEOSRegion) {
+         snprintf(phase.name, sizeof(phase.name), "%s", phaseName[i]) ;
+      }
+      else {
+         snprintf(phase.name, sizeof(phase.name), "EvalEOS region %d",
+                  int(i - TimerEOSRegion + 1)) ;
+      }
+      phase.calls = timers[i].calls ;
+      phase.tmin = tmin[i] ;
+      phase.tavg = tsum[i] / numRanks ;
+      phase.tmax = tmax[i] ;
+      phase.bytes = workSum[2*i] ;
+      phase.flops = workSum[2*i+1] ;
+      for (Int_t c=0 ; c<MAX_PERF_COUNTERS ; ++c) {
+         phase.count[c] = countSum[i*MAX_PERF_COUNTERS + c] ;
+      }
+      stats.push_back(phase) ;
+   }
+   return numCounters ;
+}
+
+/******************************************/
+
+void TimerReport(const std::vector<PhaseStats>& stats, Int_t numCounters)
+{
+   Int_t numPhases = Int_t(stats.size()) ;
+
+   double total = 0.0 ;
+   for (Int_t i=0 ; i<numPhases ; ++i) {
+      total += stats[i].tavg ;
+   }
+
+   printf("Phase timers (exclusive wall time in s, avg over ranks):\n") ;
+   printf("   %-26s %8s %10s %10s %10s %6s %6s\n",
+          "phase", "calls", "min", "avg", "max", "imbal", "%") ;
+   for (Int_t i=0 ; i<numPhases ; ++i) {
+      const PhaseStats& p = stats[i] ;
+      printf("   %-26s %8ld %10.4f %10.4f %10.4f %6.2f %5.1f%%\n",
+             p.name, long(p.calls), p.tmin, p.tavg, p.tmax,
+             (p.tavg > 0.0) ? p.tmax/p.tavg : 1.0,
+             (total > 0.0) ? 100.0*p.tavg/total : 0.0) ;
+   }
+   printf("\n") ;
+
+   if (numCounters == 0) {
+      return ;
+   }
+
+   // Counters are summed over threads and ranks; rates use the
+   // slowest rank's time
+   printf("Phase hardware counters (all ranks and threads):\n") ;
+   printf("   %-26s %10s %6s %12s %10s", "phase", "Gcycles", "IPC",
+          "LLC misses", "GB/s") ;
+   if (numCounters > PerfFlops) {
+      printf(" %10s", "GFLOP/s") ;
+   }
+   printf("\n") ;
+   for (Int_t i=0 ; i<numPhases ; ++i) {
+      const double *c = stats[i].count ;
+      double rate = (stats[i].tmax > 0.0) ? 1.0e-9/stats[i].tmax : 0.0 ;
+      printf("   %-26s %10.3f %6.2f %12.4g %10.2f", stats[i].name,
+             1.0e-9*c[PerfCycles],
+             (c[PerfCycles] > 0.0) ? c[PerfInstructions]/c[PerfCycles] : 0.0,
+             c[PerfLLCMisses],
+             // every last level cache miss moves one 64 byte line
+             64.0*c[PerfLLCMisses]*rate) ;
+      if (numCounters > PerfFlops) {
+         printf(" %10.2f", c[PerfFlops]*rate) ;
+      }
+      printf("\n") ;
+   }
+   printf("\n") ;
+}
+
+/******************************************/
+
+/*
+   Machine peaks for the roofline report.  Bandwidth is a STREAM triad
+   over arrays well beyond any last level cache; the FLOP rate comes
+   from independent multiply-add chains in L1, compiled with the same
+   flags as LULESH, so it is the peak this build can reach rather than
+   the datasheet number.
+*/
+
+#define STREAM_ARRAY_BYTES (64*1024*1024)
+#define FMA_ARRAY_LENGTH   512
+#define FMA_ITERATIONS     200000
+#define PROBE_TRIALS       5
+
+static double StreamTriadBandwidth()
+{
+   Index_t n = STREAM_ARRAY_BYTES / sizeof(Real_t) ;
+   Real_t *a = new Real_t[n] ;
+   Real_t *b = new Real_t[n] ;
+   Real_t *c = new Real_t[n] ;
+   const Real_t scalar = Real_t(3.0) ;
+   double best = 1.0e+20 ;
+
+#pragma omp parallel for firstprivate(n)
+   for (Index_t i=0 ; i<n ; ++i) {
+      a[i] = Real_t(0.0) ;
+      b[i] = Real_t(1.0) ;
+      c[i] = Real_t(2.0) ;
+   }
+
+   for (Int_t trial=0 ; trial<PROBE_TRIALS ; ++trial) {
+      double start = TimerNow() ;
+#pragma omp parallel for firstprivate(n, scalar)
+      for (Index_t i=0 ; i<n ; ++i) {
+         a[i] = b[i] + scalar*c[i] ;
+      }
+      best = MIN(best, TimerNow() - start) ;
+   }
+
+   delete [] c ;
+   delete [] b ;
+   delete [] a ;
+
+   // STREAM convention: write allocate traffic is not counted
+   return 3.0*double(n)*sizeof(Real_t) / best ;
+}
+
+static double FMARate()
+{
+   double best = 1.0e+20 ;
+   double flops = 0.0 ;
+   Real_t sink = Real_t(0.0) ;
+
+   for (Int_t trial=0 ; trial<PROBE_TRIALS ; ++trial) {
+      double start = TimerNow() ;
+      Int_t numThreads = 1 ;
+#pragma omp parallel reduction(+:sink)
+      {
+         Real_t x[FMA_ARRAY_LENGTH] ;
+         const Real_t alpha = Real_t(0.999999) ;
+         const Real_t beta  = Real_t(1.0e-6) ;
+#if _OPENMP
+#pragma omp single
+         numThreads = omp_get_num_threads() ;
+#endif
+         for (Int_t i=0 ; i<FMA_ARRAY_LENGTH ; ++i) {
+            x[i] = Real_t(i) ;
+         }
+         for (Int_t it=0 ; it<FMA_ITERATIONS ; ++it) {
+            for (Int_t i=0 ; i<FMA_ARRAY_LENGTH ; ++i) {
+               x[i] = x[i]*alpha + beta ;
+            }
+         }
+         for (Int_t i=0 ; i<FMA_ARRAY_LENGTH ; ++i) {
+            sink += x[i] ;
+         }
+      }
+      best = MIN(best, TimerNow() - start) ;
+      flops = 2.0*double(numThreads)*FMA_ITERATIONS*FMA_ARRAY_LENGTH ;
+   }
+
+   // keeps the chains from being optimized away
+   if (sink == Real_t(-1.0)) {
+      printf("%g\n", double(sink)) ;
+   }
+   return flops / best ;
+}
+
+/******************************************/
+
+void MeasureMachinePeaks(MachinePeaks *peaks)
+{
+   double local[2] ;
+
+#if USE_MPI
+   // All ranks probe at once so shared memory channels are saturated
+   MPI_Barrier(MPI_COMM_WORLD) ;
+#endif
+   local[0] = StreamTriadBandwidth() ;
+#if USE_MPI
+   MPI_Barrier(MPI_COMM_WORLD) ;
+#endif
+   local[1] = FMARate() ;
+
+#if USE_MPI
+   double total[2] ;
+   MPI_Reduce(local, total, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) ;
+   peaks->bandwidth = total[0] ;
+   peaks->flops = total[1] ;
+#else
+   peaks->bandwidth = local[0] ;
+   peaks->flops = local[1] ;
+#endif
+}
+
+/******************************************/
+
+void RooflineReport(const std::vector<PhaseStats>& stats,
+                    const MachinePeaks& peaks)
+{
+   double ridge = peaks.flops / peaks.bandwidth ;
+
+   // Work is summed over ranks; rates use the slowest rank's time
+   printf("Roofline (analytic work; STREAM triad %.2f GB/s, multiply-add %.2f GFLOP/s,"
+          " ridge %.2f flop/byte):\n",
+          1.0e-9*peaks.bandwidth, 1.0e-9*peaks.flops, ridge) ;
+   printf("   %-26s %10s %10s %6s %10s %6s %10s %8s\n",
+          "phase", "GB", "GB/s", "%BW", "GFLOP/s", "%FLOP", "flop/byte", "bound") ;
+   for (size_t i=0 ; i<stats.size() ; ++i) {
+      const PhaseStats& p = stats[i] ;
+      if (p.bytes <= 0.0 || p.tmax <= 0.0) {
+         continue ;
+      }
+      double bw = p.bytes / p.tmax ;
+      double fl = p.flops / p.tmax ;
+      double intensity = p.flops / p.bytes ;
+      printf("   %-26s %10.3f %10.2f %5.1f%% %10.2f %5.1f%% %10.2f %8s\n",
+             p.name, 1.0e-9*p.bytes, 1.0e-9*bw, 100.0*bw/peaks.bandwidth,
+             1.0e-9*fl, 100.0*fl/peaks.flops, intensity,
+             (intensity < ridge) ? "memory" : "compute") ;
+   }
+   // Bytes assume every loop streams its arrays from memory once
+   printf("   (%%BW over 100 means the phase is running from cache)\n\n") ;
+}
+
+#endif
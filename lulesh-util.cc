@@ -7,6 +7,9 @@
 #if USE_MPI
 #include <mpi.h>
 #endif
+#if _OPENMP
+#include <omp.h>
+#endif
 #include "lulesh.h"
 
 /* Helper function for converting strings to ints, with error checking */
@@ -28,6 +31,47 @@ int StrToInt(const char *token, IntT *retVal)
       return 0 ;
 }
 
+/* Helper function for converting strings to reals, with error checking */
+template<typename RealT>
+int StrToReal(const char *token, RealT *retVal)
+{
+   const char *c ;
+   char *endptr ;
+
+   if (token == NULL)
+      return 0 ;
+
+   c = token ;
+   *retVal = strtod(c, &endptr) ;
+   if((endptr != c) && ((*endptr == ' ') || (*endptr == '\0')))
+      return 1 ;
+   else
+      return 0 ;
+}
+
+/* Helper function for converting a comma separated list of positive ints */
+static int StrToIntList(const char *token, std::vector<Int_t> *retVal)
+{
+   const char *c ;
+   char *endptr ;
+   const int decimal_base = 10 ;
+
+   if (token == NULL)
+      return 0 ;
+
+   retVal->clear() ;
+   c = token ;
+   while (*c != '\0') {
+      long val = strtol(c, &endptr, decimal_base) ;
+      if ((endptr == c) || (val <= 0) ||
+          ((*endptr != ',') && (*endptr != '\0')))
+         return 0 ;
+      retVal->push_back(Int_t(val)) ;
+      c = (*endptr == ',') ? endptr + 1 : endptr ;
+   }
+   return (retVal->empty() ? 0 : 1) ;
+}
+
 static void PrintCommandLineOptions(char *execname, int myRank)
 {
    if (myRank == 0) {
@@ -41,8 +85,32 @@ static void PrintCommandLineOptions(char *execname, int myRank)
       printf(" -b <balance>    : Load balance between regions of a domain (def: 1)\n");
       printf(" -c <cost>       : Extra cost of more expensive regions (def: 1)\n");
       printf(" -f <numfiles>   : Number of files to split viz dump into (def: (np+10)/9)\n");
+      printf(" -R              : Store elements sorted by region (unit stride region loops)\n");
+      printf(" --nodelist      : Read element corners from the node list even on the lattice mesh\n");
+      printf(" --mesh <file>   : Run on an unstructured hex mesh read from file instead of the cube\n");
+      printf(" --mesh-out <file> : Write the cube as a hex mesh file (one rank)\n");
+      printf(" -a <cycles>     : Move elements between regions every <cycles> (def: 0, off)\n");
+      printf(" -A <fraction>   : Fraction of elements sampled per region move (def: 0.01)\n");
+      printf(" -L <cycles>     : Rebalance EOS work between ranks every <cycles> (def: 0, off)\n");
+      printf(" -t <file>       : Use tabulated EOS read from file (def: analytic)\n");
+      printf(" -T <file>       : Write built-in ideal gas EOS table to file and use it\n");
+      printf(" -H <policy>     : Page policy for large arrays: none, thp, hugetlb (def: none)\n");
+      printf(" -B              : A/B run, first with default pages then with -H (def: thp)\n");
+      printf(" -N              : Report NUMA placement of field pages at startup\n");
+      printf(" --timers        : Print the per phase timer report at the end\n");
+      printf(" -P              : Add hardware counters to the phase timer report (implies --timers)\n");
+      printf(" --output <fmt> <file> : Write results as json or csv to file\n");
+      printf(" --roofline      : Measure machine peaks and report per phase GB/s and GFLOP/s\n");
+      printf(" --sweep-threads <list> : Scaling table over thread counts, e.g. 1,2,4\n");
+      printf(" --sweep-size <list>    : Scaling table over sizes, e.g. 30,60,90\n");
+      printf(" --checkpoint <file> <cycles> : Write <file>.<rank> every <cycles> (0: at end only)\n");
+      printf(" --restart <file> : Resume from checkpoint <file>.<rank>, same options and ranks\n");
+      printf(" --checkpoint-async : Snapshot checkpoints and write them on a background thread\n");
       printf(" -p              : Print out progress\n");
-      printf(" -v              : Output viz file (requires compiling with -DVIZ_MESH\n");
+      printf(" -v [cycles]     : Output viz file at the end, and every [cycles] if given\n");
+      printf("                   (SILO with -DVIZ_MESH, else VTK)\n");
+      printf(" --vtk [cycles]  : Same as -v, as VTK .pvtu/.vtu with no external libraries\n");
+      printf(" --viz-stride <s>: Keep every s-th node along each axis in VTK output (def: 1)\n");
       printf(" -h              : This message\n");
       printf("\n\n");
    }
@@ -60,6 +128,43 @@ static void ParseError(const char *message, int myRank)
    }
 }
 
+/* Defaults that can be overridden by command line opts */
+void InitCmdLineOpts(struct cmdLineOpts *opts, Int_t numRanks)
+{
+   opts->its = 9999999;
+   opts->nx  = 30;
+   opts->numReg = 11;
+   opts->numFiles = (int)(numRanks+10)/9;
+   opts->showProg = 0;
+   opts->quiet = 0;
+   opts->viz = VizNone;
+   opts->vizInterval = 0;
+   opts->vizStride = 1;
+   opts->balance = 1;
+   opts->cost = 1;
+   opts->sortRegions = 0;
+   opts->nodelist = 0;
+   opts->meshFile = NULL;
+   opts->meshOut = NULL;
+   opts->migrateInterval = 0;
+   opts->migrateFraction = Real_t(0.01);
+   opts->eosBalanceInterval = 0;
+   opts->eosFile = NULL;
+   opts->eosOut = NULL;
+   opts->memPolicy = FieldMemDefault;
+   opts->placement = 0;
+   opts->pageAB = 0;
+   opts->phaseTimers = 0;
+   opts->perfCounters = 0;
+   opts->outputFormat = OutputNone;
+   opts->outputFile = NULL;
+   opts->roofline = 0;
+   opts->checkpointFile = NULL;
+   opts->checkpointInterval = 0;
+   opts->checkpointAsync = 0;
+   opts->restartFile = NULL;
+}
+
 void ParseCommandLineOptions(int argc, char *argv[],
                              Int_t myRank, struct cmdLineOpts *opts)
 {
@@ -112,6 +217,202 @@ void ParseCommandLineOptions(int argc, char *argv[],
             }
             i+=2;
          }
+         /* -R */
+         else if (strcmp(argv[i], "-R") == 0) {
+            opts->sortRegions = 1;
+            i++;
+         }
+         /* --nodelist */
+         else if (strcmp(argv[i], "--nodelist") == 0) {
+            opts->nodelist = 1;
+            i++;
+         }
+         /* --mesh <file> */
+         else if (strcmp(argv[i], "--mesh") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing file name argument to --mesh\n", myRank);
+            }
+            opts->meshFile = argv[i+1];
+            i+=2;
+         }
+         /* --mesh-out <file> */
+         else if (strcmp(argv[i], "--mesh-out") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing file name argument to --mesh-out\n", myRank);
+            }
+            opts->meshOut = argv[i+1];
+            i+=2;
+         }
+         /* -a <migration interval> */
+         else if (strcmp(argv[i], "-a") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing integer argument to -a\n", myRank);
+            }
+            ok = StrToInt(argv[i+1], &(opts->migrateInterval));
+            if (!ok) {
+               ParseError("Parse Error on option -a integer value required after argument\n", myRank);
+            }
+            i+=2;
+         }
+         /* -A <migration fraction> */
+         else if (strcmp(argv[i], "-A") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing real argument to -A\n", myRank);
+            }
+            ok = StrToReal(argv[i+1], &(opts->migrateFraction));
+            if (!ok || opts->migrateFraction < 0.0 || opts->migrateFraction > 1.0) {
+               ParseError("Parse Error on option -A value between 0 and 1 required after argument\n", myRank);
+            }
+            i+=2;
+         }
+         /* -L <eos balance interval> */
+         else if (strcmp(argv[i], "-L") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing integer argument to -L\n", myRank);
+            }
+            ok = StrToInt(argv[i+1], &(opts->eosBalanceInterval));
+            if (!ok || opts->eosBalanceInterval < 0) {
+               ParseError("Parse Error on option -L non-negative integer value required after argument\n", myRank);
+            }
+            i+=2;
+         }
+         /* -t <eos table file> */
+         else if (strcmp(argv[i], "-t") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing file name argument to -t\n", myRank);
+            }
+            opts->eosFile = argv[i+1];
+            i+=2;
+         }
+         /* -T <eos table file> */
+         else if (strcmp(argv[i], "-T") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing file name argument to -T\n", myRank);
+            }
+            opts->eosOut = argv[i+1];
+            i+=2;
+         }
+         /* -H <page policy> */
+         else if (strcmp(argv[i], "-H") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing policy argument to -H\n", myRank);
+            }
+            if (strcmp(argv[i+1], "none") == 0) {
+               opts->memPolicy = FieldMemDefault;
+            }
+            else if (strcmp(argv[i+1], "thp") == 0) {
+               opts->memPolicy = FieldMemTHP;
+            }
+            else if (strcmp(argv[i+1], "hugetlb") == 0) {
+               opts->memPolicy = FieldMemHugeTLB;
+            }
+            else {
+               ParseError("Parse Error on option -H: none, thp or hugetlb required after argument\n", myRank);
+            }
+            i+=2;
+         }
+         /* -B */
+         else if (strcmp(argv[i], "-B") == 0) {
+            opts->pageAB = 1;
+            i++;
+         }
+         /* --timers */
+         else if (strcmp(argv[i], "--timers") == 0) {
+#if LULESH_TIMERS
+            opts->phaseTimers = 1;
+#else
+            ParseError("Use of --timers requires compiling with -DLULESH_TIMERS\n", myRank);
+#endif
+            i++;
+         }
+         /* -P */
+         else if (strcmp(argv[i], "-P") == 0) {
+            opts->perfCounters = 1;
+            opts->phaseTimers = 1;
+            i++;
+         }
+         /* --output <format> <file> */
+         else if (strcmp(argv[i], "--output") == 0) {
+            if (i+2 >= argc) {
+               ParseError("Missing format and file name arguments to --output\n", myRank);
+            }
+            if (strcmp(argv[i+1], "json") == 0) {
+               opts->outputFormat = OutputJSON;
+            }
+            else if (strcmp(argv[i+1], "csv") == 0) {
+               opts->outputFormat = OutputCSV;
+            }
+            else {
+               ParseError("Parse Error on option --output: json or csv required after argument\n", myRank);
+            }
+            opts->outputFile = argv[i+2];
+            i+=3;
+         }
+         /* --roofline */
+         else if (strcmp(argv[i], "--roofline") == 0) {
+#if LULESH_TIMERS
+            opts->roofline = 1;
+#else
+            ParseError("Use of --roofline requires compiling with -DLULESH_TIMERS\n", myRank);
+#endif
+            i++;
+         }
+         /* --sweep-threads <list> */
+         else if (strcmp(argv[i], "--sweep-threads") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing list argument to --sweep-threads\n", myRank);
+            }
+#if _OPENMP
+            ok = StrToIntList(argv[i+1], &(opts->sweepThreads));
+            if (!ok) {
+               ParseError("Parse Error on option --sweep-threads: comma separated thread counts required after argument\n", myRank);
+            }
+#else
+            ParseError("Use of --sweep-threads requires compiling with OpenMP\n", myRank);
+#endif
+            i+=2;
+         }
+         /* --sweep-size <list> */
+         else if (strcmp(argv[i], "--sweep-size") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing list argument to --sweep-size\n", myRank);
+            }
+            ok = StrToIntList(argv[i+1], &(opts->sweepSizes));
+            if (!ok) {
+               ParseError("Parse Error on option --sweep-size: comma separated sizes required after argument\n", myRank);
+            }
+            i+=2;
+         }
+         /* --checkpoint <file> <cycles> */
+         else if (strcmp(argv[i], "--checkpoint") == 0) {
+            if (i+2 >= argc) {
+               ParseError("Missing file name and interval arguments to --checkpoint\n", myRank);
+            }
+            opts->checkpointFile = argv[i+1];
+            ok = StrToInt(argv[i+2], &(opts->checkpointInterval));
+            if (!ok || opts->checkpointInterval < 0) {
+               ParseError("Parse Error on option --checkpoint: non-negative cycle interval required after file name\n", myRank);
+            }
+            i+=3;
+         }
+         /* --checkpoint-async */
+         else if (strcmp(argv[i], "--checkpoint-async") == 0) {
+            opts->checkpointAsync = 1;
+            i++;
+         }
+         /* --restart <file> */
+         else if (strcmp(argv[i], "--restart") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing file name argument to --restart\n", myRank);
+            }
+            opts->restartFile = argv[i+1];
+            i+=2;
+         }
+         /* -N */
+         else if (strcmp(argv[i], "-N") == 0) {
+            opts->placement = 1;
+            i++;
+         }
          /* -p */
          else if (strcmp(argv[i], "-p") == 0) {
             opts->showProg = 1;
@@ -145,11 +446,40 @@ void ParseCommandLineOptions(int argc, char *argv[],
          /* -v */
          else if (strcmp(argv[i], "-v") == 0) {
 #if VIZ_MESH            
-            opts->viz = 1;
+            opts->viz = VizSilo;
 #else
-            ParseError("Use of -v requires compiling with -DVIZ_MESH\n", myRank);
+            opts->viz = VizVTK;
 #endif
             i++;
+            /* optional output interval */
+            if (i < argc && StrToInt(argv[i], &(opts->vizInterval))) {
+               if (opts->vizInterval < 0) {
+                  ParseError("Parse Error on option -v: interval must be non-negative\n", myRank);
+               }
+               i++;
+            }
+         }
+         /* --vtk [cycles] */
+         else if (strcmp(argv[i], "--vtk") == 0) {
+            opts->viz = VizVTK;
+            i++;
+            if (i < argc && StrToInt(argv[i], &(opts->vizInterval))) {
+               if (opts->vizInterval < 0) {
+                  ParseError("Parse Error on option --vtk: interval must be non-negative\n", myRank);
+               }
+               i++;
+            }
+         }
+         /* --viz-stride <s> */
+         else if (strcmp(argv[i], "--viz-stride") == 0) {
+            if (i+1 >= argc) {
+               ParseError("Missing integer argument to --viz-stride\n", myRank);
+            }
+            ok = StrToInt(argv[i+1], &(opts->vizStride));
+            if (!ok || opts->vizStride < 1) {
+               ParseError("Parse Error on option --viz-stride positive integer value required after argument\n", myRank);
+            }
+            i+=2;
          }
          /* -h */
          else if (strcmp(argv[i], "-h") == 0) {
@@ -167,64 +497,456 @@ void ParseCommandLineOptions(int argc, char *argv[],
             ParseError(msg, myRank);
          }
       }
+      // Sorted storage keeps each region contiguous, so membership is fixed
+      if (opts->sortRegions && opts->migrateInterval > 0) {
+         ParseError("Options -R and -a cannot be combined\n", myRank);
+      }
+      if (opts->vizStride > 1 && opts->viz == VizSilo) {
+         ParseError("Option --viz-stride applies to VTK output only, use --vtk\n", myRank);
+      }
+      // Both walk the lattice of the built-in cube
+      if (opts->meshFile != NULL && opts->vizStride > 1) {
+         ParseError("Options --mesh and --viz-stride cannot be combined\n", myRank);
+      }
+      if (opts->meshFile != NULL && !opts->sweepSizes.empty()) {
+         ParseError("Options --mesh and --sweep-size cannot be combined\n", myRank);
+      }
+      if (opts->checkpointAsync && opts->checkpointFile == NULL) {
+         ParseError("Option --checkpoint-async requires --checkpoint\n", myRank);
+      }
+      // An A/B run compares against huge pages unless told otherwise
+      if (opts->pageAB && opts->memPolicy == FieldMemDefault) {
+         opts->memPolicy = FieldMemTHP;
+      }
    }
 }
 
 /////////////////////////////////////////////////////////////////////
 
-void VerifyAndWriteFinalOutput(Real_t elapsed_time,
-                               Domain& locDom,
-                               Int_t nx,
-                               Int_t numRanks)
+/* Called outside of any parallel region once a kernel has flagged an
+ * element, so the abort does not race other threads */
+void ReportElemError(Domain& domain, const ElemError& err, const char *where)
+{
+   int myRank = 0 ;
+#if USE_MPI
+   MPI_Comm_rank(MPI_COMM_WORLD, &myRank) ;
+#endif
+
+   fflush(stdout) ;
+   fprintf(stderr, "Rank %d, cycle %d: %s in element %d (region %d) "
+           "detected in %s\n", myRank, int(domain.cycle()),
+           (err.code == QStopError) ? "q exceeds qstop" : "negative volume",
+           int(err.elem), int(domain.regNumList(err.elem)), where) ;
+   fflush(stderr) ;
+
+#if USE_MPI
+   MPI_Abort(MPI_COMM_WORLD, err.code) ;
+#else
+   exit(err.code) ;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void ComputeRunResults(Real_t elapsed_time, Int_t cycles, Domain& locDom,
+                       Int_t nx, Int_t numRanks, RunResults *results)
 {
    // GrindTime1 only takes a single domain into account, and is thus a good way to measure
    // processor speed indepdendent of MPI parallelism.
    // GrindTime2 takes into account speedups from MPI parallelism.
    // Cast to 64-bit integer to avoid overflows.
    Int8_t nx8 = nx;
-   Real_t grindTime1 = ((elapsed_time*1e6)/locDom.cycle())/(nx8*nx8*nx8);
-   Real_t grindTime2 = ((elapsed_time*1e6)/locDom.cycle())/(nx8*nx8*nx8*numRanks);
-
-   Index_t ElemId = 0;
-   std::cout << "Run completed:\n";
-   std::cout << "   Problem size        =  " << nx       << "\n";
-   std::cout << "   MPI tasks           =  " << numRanks << "\n";
-   std::cout << "   Iteration count     =  " << locDom.cycle() << "\n";
-   std::cout << "   Final Origin Energy =  ";
-   std::cout << std::scientific << std::setprecision(6);
-   std::cout << std::setw(12) << locDom.e(ElemId) << "\n";
+   results->elapsedTime = elapsed_time;
+   if (locDom.unstructured()) {
+      // A file mesh has no side length: rank 0's part and the whole mesh
+      results->grindTime1 = ((elapsed_time*1e6)/cycles)/Int8_t(locDom.numElem());
+      results->grindTime2 = ((elapsed_time*1e6)/cycles)/Int8_t(locDom.meshNumElem());
+   }
+   else {
+      results->grindTime1 = ((elapsed_time*1e6)/cycles)/(nx8*nx8*nx8);
+      results->grindTime2 = ((elapsed_time*1e6)/cycles)/(nx8*nx8*nx8*numRanks);
+   }
+   results->fom = 1000.0/results->grindTime2;
+   results->originEnergy = locDom.e(locDom.originElem());
+   results->cycles = cycles;
+   results->time = locDom.time();
+   results->peakBandwidth = 0.0;
+   results->peakFlops = 0.0;
 
    Real_t   MaxAbsDiff = Real_t(0.0);
    Real_t TotalAbsDiff = Real_t(0.0);
    Real_t   MaxRelDiff = Real_t(0.0);
 
-   for (Index_t j=0; j<nx; ++j) {
-      for (Index_t k=j+1; k<nx; ++k) {
-         Real_t AbsDiff = FABS(locDom.e(j*nx+k)-locDom.e(k*nx+j));
+   // The symmetry check reads plane 0 of the cube; a file mesh has no
+   // such plane and is reported as not checked
+   results->symmetryChecked = !locDom.unstructured() ;
+   Index_t symmSide = results->symmetryChecked ? nx : 0 ;
+   for (Index_t j=0; j<symmSide; ++j) {
+      for (Index_t k=j+1; k<symmSide; ++k) {
+         Real_t AbsDiff = FABS(locDom.e(locDom.spatialElem(j*nx+k)) -
+                               locDom.e(locDom.spatialElem(k*nx+j)));
          TotalAbsDiff  += AbsDiff;
 
          if (MaxAbsDiff <AbsDiff) MaxAbsDiff = AbsDiff;
 
-         Real_t RelDiff = AbsDiff / locDom.e(k*nx+j);
+         Real_t RelDiff = AbsDiff / locDom.e(locDom.spatialElem(k*nx+j));
 
          if (MaxRelDiff <RelDiff)  MaxRelDiff = RelDiff;
       }
    }
 
+   results->maxAbsDiff = MaxAbsDiff;
+   results->totalAbsDiff = TotalAbsDiff;
+   results->maxRelDiff = MaxRelDiff;
+}
+
+/////////////////////////////////////////////////////////////////////
+
+void VerifyAndWriteFinalOutput(Real_t elapsed_time,
+                               Int_t cycles,
+                               Domain& locDom,
+                               Int_t nx,
+                               Int_t numRanks)
+{
+   RunResults r;
+   ComputeRunResults(elapsed_time, cycles, locDom, nx, numRanks, &r);
+
+   std::cout << "Run completed:\n";
+   if (locDom.unstructured()) {
+      std::cout << "   Mesh elements       =  " << locDom.meshNumElem() << "\n";
+   }
+   else {
+      std::cout << "   Problem size        =  " << nx       << "\n";
+   }
+   std::cout << "   MPI tasks           =  " << numRanks << "\n";
+   std::cout << "   Iteration count     =  " << r.cycles << "\n";
+   std::cout << "   Final Origin Energy =  ";
+   std::cout << std::scientific << std::setprecision(6);
+   std::cout << std::setw(12) << r.originEnergy << "\n";
+
    // Quick symmetry check
-   std::cout << "   Testing Plane 0 of Energy Array on rank 0:\n";
-   std::cout << "        MaxAbsDiff   = " << std::setw(12) << MaxAbsDiff   << "\n";
-   std::cout << "        TotalAbsDiff = " << std::setw(12) << TotalAbsDiff << "\n";
-   std::cout << "        MaxRelDiff   = " << std::setw(12) << MaxRelDiff   << "\n";
+   if (r.symmetryChecked) {
+      std::cout << "   Testing Plane 0 of Energy Array on rank 0:\n";
+      std::cout << "        MaxAbsDiff   = " << std::setw(12) << r.maxAbsDiff   << "\n";
+      std::cout << "        TotalAbsDiff = " << std::setw(12) << r.totalAbsDiff << "\n";
+      std::cout << "        MaxRelDiff   = " << std::setw(12) << r.maxRelDiff   << "\n";
+   }
+   else {
+      std::cout << "   Testing Plane 0 of Energy Array on rank 0: n/a (file mesh)\n";
+   }
 
    // Timing information
    std::cout.unsetf(std::ios_base::floatfield);
    std::cout << std::setprecision(2);
    std::cout << "\nElapsed time         = " << std::setw(10) << elapsed_time << " (s)\n";
    std::cout << std::setprecision(8);
-   std::cout << "Grind time (us/z/c)  = "  << std::setw(10) << grindTime1 << " (per dom)  ("
+   std::cout << "Grind time (us/z/c)  = "  << std::setw(10) << r.grindTime1 << " (per dom)  ("
              << std::setw(10) << elapsed_time << " overall)\n";
-   std::cout << "FOM                  = " << std::setw(10) << 1000.0/grindTime2 << " (z/s)\n\n";
+   std::cout << "FOM                  = " << std::setw(10) << r.fom << " (z/s)\n\n";
 
    return ;
 }
+
+/////////////////////////////////////////////////////////////////////
+
+/* Build configuration recorded with machine readable results */
+struct BuildFlag {
+   const char *name ;
+   const char *value ;
+} ;
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static const BuildFlag buildFlags[] = {
+   { "USE_MPI", STRINGIFY(USE_MPI) },
+#if _OPENMP
+   { "_OPENMP", STRINGIFY(_OPENMP) },
+#else
+   { "_OPENMP", "0" },
+#endif
+#if LULESH_TIMERS
+   { "LULESH_TIMERS", STRINGIFY(LULESH_TIMERS) },
+#else
+   { "LULESH_TIMERS", "0" },
+#endif
+#if VIZ_MESH
+   { "VIZ_MESH", STRINGIFY(VIZ_MESH) },
+#else
+   { "VIZ_MESH", "0" },
+#endif
+#if defined(__OPTIMIZE__)
+   { "__OPTIMIZE__", "1" },
+#else
+   { "__OPTIMIZE__", "0" },
+#endif
+#if defined(__VERSION__)
+   { "compiler", __VERSION__ },
+#endif
+} ;
+
+static const char *counterName[MAX_PERF_COUNTERS] = {
+   "cycles", "instructions", "llc_misses", "flops"
+} ;
+
+/* Writes s as a JSON string literal */
+static void JSONString(FILE *fp, const char *s)
+{
+   fputc('"', fp);
+   for ( ; *s != '\0'; ++s) {
+      unsigned char c = (unsigned char) *s;
+      if (c == '"' || c == '\\') {
+         fprintf(fp, "\\%c", c);
+      }
+      else if (c < 0x20) {
+         fprintf(fp, "\\u%04x", c);
+      }
+      else {
+         fputc(c, fp);
+      }
+   }
+   fputc('"', fp);
+}
+
+/* Writes s as a CSV field, quoted when it holds a separator */
+static void CSVString(FILE *fp, const char *s)
+{
+   if (strpbrk(s, ",\"\n") == NULL) {
+      fputs(s, fp);
+      return;
+   }
+   fputc('"', fp);
+   for ( ; *s != '\0'; ++s) {
+      if (*s == '"') {
+         fputc('"', fp);
+      }
+      fputc(*s, fp);
+   }
+   fputc('"', fp);
+}
+
+static void WriteResultsJSON(FILE *fp, const cmdLineOpts& opts,
+                             const RunResults& r,
+                             const std::vector<TimeStepRecord>& history,
+                             const std::vector<PhaseStats>& phases,
+                             Int_t numCounters, Int_t numRanks,
+                             Int_t numThreads)
+{
+   size_t numFlags = sizeof(buildFlags)/sizeof(buildFlags[0]);
+
+   fprintf(fp, "{\n");
+   fprintf(fp, "  \"config\": {\n");
+   fprintf(fp, "    \"size\": %d,\n", int(opts.nx));
+   fprintf(fp, "    \"iterations\": %d,\n", int(opts.its));
+   fprintf(fp, "    \"regions\": %d,\n", int(opts.numReg));
+   fprintf(fp, "    \"balance\": %d,\n", int(opts.balance));
+   fprintf(fp, "    \"cost\": %d,\n", int(opts.cost));
+   fprintf(fp, "    \"sort_regions\": %d,\n", int(opts.sortRegions));
+   fprintf(fp, "    \"nodelist\": %d,\n", int(opts.nodelist));
+   fprintf(fp, "    \"migrate_interval\": %d,\n", int(opts.migrateInterval));
+   fprintf(fp, "    \"migrate_fraction\": %.17g,\n", double(opts.migrateFraction));
+   fprintf(fp, "    \"eos_balance_interval\": %d,\n", int(opts.eosBalanceInterval));
+   fprintf(fp, "    \"eos_table\": ");
+   if (opts.eosFile != NULL) {
+      JSONString(fp, opts.eosFile);
+   }
+   else if (opts.eosOut != NULL) {
+      JSONString(fp, opts.eosOut);
+   }
+   else {
+      fprintf(fp, "null");
+   }
+   fprintf(fp, ",\n");
+   fprintf(fp, "    \"mesh\": ");
+   if (opts.meshFile != NULL) {
+      JSONString(fp, opts.meshFile);
+   }
+   else {
+      fprintf(fp, "null");
+   }
+   fprintf(fp, ",\n");
+   fprintf(fp, "    \"page_policy\": \"%s\",\n", FieldMemPolicyName(opts.memPolicy));
+   fprintf(fp, "    \"ranks\": %d,\n", int(numRanks));
+   fprintf(fp, "    \"threads\": %d,\n", int(numThreads));
+   fprintf(fp, "    \"real_bytes\": %d\n", int(sizeof(Real_t)));
+   fprintf(fp, "  },\n");
+
+   fprintf(fp, "  \"build\": {\n");
+   for (size_t i=0; i<numFlags; ++i) {
+      fprintf(fp, "    ");
+      JSONString(fp, buildFlags[i].name);
+      fprintf(fp, ": ");
+      JSONString(fp, buildFlags[i].value);
+      fprintf(fp, "%s\n", (i+1 < numFlags) ? "," : "");
+   }
+   fprintf(fp, "  },\n");
+
+   fprintf(fp, "  \"results\": {\n");
+   fprintf(fp, "    \"cycles\": %d,\n", int(r.cycles));
+   fprintf(fp, "    \"time\": %.17g,\n", double(r.time));
+   fprintf(fp, "    \"elapsed_s\": %.17g,\n", double(r.elapsedTime));
+   fprintf(fp, "    \"grind_us_per_zone_cycle\": %.17g,\n", double(r.grindTime1));
+   fprintf(fp, "    \"grind_us_per_zone_cycle_overall\": %.17g,\n", double(r.grindTime2));
+   fprintf(fp, "    \"fom_zones_per_s\": %.17g,\n", double(r.fom));
+   fprintf(fp, "    \"origin_energy\": %.17g,\n", double(r.originEnergy));
+   if (r.symmetryChecked) {
+      fprintf(fp, "    \"max_abs_diff\": %.17g,\n", double(r.maxAbsDiff));
+      fprintf(fp, "    \"total_abs_diff\": %.17g,\n", double(r.totalAbsDiff));
+      fprintf(fp, "    \"max_rel_diff\": %.17g\n", double(r.maxRelDiff));
+   }
+   else {
+      fprintf(fp, "    \"max_abs_diff\": null,\n");
+      fprintf(fp, "    \"total_abs_diff\": null,\n");
+      fprintf(fp, "    \"max_rel_diff\": null\n");
+   }
+   fprintf(fp, "  },\n");
+
+   if (r.peakBandwidth > 0.0) {
+      fprintf(fp, "  \"machine\": {\n");
+      fprintf(fp, "    \"stream_triad_bytes_per_s\": %.17g,\n", r.peakBandwidth);
+      fprintf(fp, "    \"multiply_add_flops_per_s\": %.17g\n", r.peakFlops);
+      fprintf(fp, "  },\n");
+   }
+
+   fprintf(fp, "  \"phases\": [");
+   for (size_t i=0; i<phases.size(); ++i) {
+      const PhaseStats& p = phases[i];
+      fprintf(fp, "%s\n    {\"name\": ", (i > 0) ? "," : "");
+      JSONString(fp, p.name);
+      fprintf(fp, ", \"calls\": %ld, \"min_s\": %.17g, \"avg_s\": %.17g, \"max_s\": %.17g",
+              long(p.calls), p.tmin, p.tavg, p.tmax);
+      fprintf(fp, ", \"bytes\": %.17g, \"flops\": %.17g", p.bytes, p.flops);
+      for (Int_t c=0; c<numCounters; ++c) {
+         fprintf(fp, ", \"%s\": %.17g", counterName[c], p.count[c]);
+      }
+      fprintf(fp, "}");
+   }
+   fprintf(fp, "%s],\n", phases.empty() ? "" : "\n  ");
+
+   fprintf(fp, "  \"dt_history\": {\n");
+   fprintf(fp, "    \"time\": [");
+   for (size_t i=0; i<history.size(); ++i) {
+      fprintf(fp, "%s%.17g", (i > 0) ? ", " : "", double(history[i].time));
+   }
+   fprintf(fp, "],\n");
+   fprintf(fp, "    \"dt\": [");
+   for (size_t i=0; i<history.size(); ++i) {
+      fprintf(fp, "%s%.17g", (i > 0) ? ", " : "", double(history[i].dt));
+   }
+   fprintf(fp, "]\n");
+   fprintf(fp, "  }\n");
+   fprintf(fp, "}\n");
+}
+
+/* One "section,name,metric,value" row per value, so a single reader
+   handles every part of the file */
+static void WriteResultsCSV(FILE *fp, const cmdLineOpts& opts,
+                            const RunResults& r,
+                            const std::vector<TimeStepRecord>& history,
+                            const std::vector<PhaseStats>& phases,
+                            Int_t numCounters, Int_t numRanks,
+                            Int_t numThreads)
+{
+   size_t numFlags = sizeof(buildFlags)/sizeof(buildFlags[0]);
+
+   fprintf(fp, "section,name,metric,value\n");
+   fprintf(fp, "config,run,size,%d\n", int(opts.nx));
+   fprintf(fp, "config,run,iterations,%d\n", int(opts.its));
+   fprintf(fp, "config,run,regions,%d\n", int(opts.numReg));
+   fprintf(fp, "config,run,balance,%d\n", int(opts.balance));
+   fprintf(fp, "config,run,cost,%d\n", int(opts.cost));
+   fprintf(fp, "config,run,sort_regions,%d\n", int(opts.sortRegions));
+   fprintf(fp, "config,run,nodelist,%d\n", int(opts.nodelist));
+   fprintf(fp, "config,run,migrate_interval,%d\n", int(opts.migrateInterval));
+   fprintf(fp, "config,run,migrate_fraction,%.17g\n", double(opts.migrateFraction));
+   fprintf(fp, "config,run,eos_balance_interval,%d\n", int(opts.eosBalanceInterval));
+   if (opts.eosFile != NULL || opts.eosOut != NULL) {
+      fprintf(fp, "config,run,eos_table,");
+      CSVString(fp, (opts.eosFile != NULL) ? opts.eosFile : opts.eosOut);
+      fprintf(fp, "\n");
+   }
+   if (opts.meshFile != NULL) {
+      fprintf(fp, "config,run,mesh,");
+      CSVString(fp, opts.meshFile);
+      fprintf(fp, "\n");
+   }
+   fprintf(fp, "config,run,page_policy,%s\n", FieldMemPolicyName(opts.memPolicy));
+   fprintf(fp, "config,run,ranks,%d\n", int(numRanks));
+   fprintf(fp, "config,run,threads,%d\n", int(numThreads));
+   fprintf(fp, "config,run,real_bytes,%d\n", int(sizeof(Real_t)));
+
+   for (size_t i=0; i<numFlags; ++i) {
+      fprintf(fp, "build,");
+      CSVString(fp, buildFlags[i].name);
+      fprintf(fp, ",value,");
+      CSVString(fp, buildFlags[i].value);
+      fprintf(fp, "\n");
+   }
+
+   fprintf(fp, "result,run,cycles,%d\n", int(r.cycles));
+   fprintf(fp, "result,run,time,%.17g\n", double(r.time));
+   fprintf(fp, "result,run,elapsed_s,%.17g\n", double(r.elapsedTime));
+   fprintf(fp, "result,run,grind_us_per_zone_cycle,%.17g\n", double(r.grindTime1));
+   fprintf(fp, "result,run,grind_us_per_zone_cycle_overall,%.17g\n", double(r.grindTime2));
+   fprintf(fp, "result,run,fom_zones_per_s,%.17g\n", double(r.fom));
+   fprintf(fp, "result,run,origin_energy,%.17g\n", double(r.originEnergy));
+   if (r.symmetryChecked) {
+      fprintf(fp, "result,run,max_abs_diff,%.17g\n", double(r.maxAbsDiff));
+      fprintf(fp, "result,run,total_abs_diff,%.17g\n", double(r.totalAbsDiff));
+      fprintf(fp, "result,run,max_rel_diff,%.17g\n", double(r.maxRelDiff));
+   }
+   if (r.peakBandwidth > 0.0) {
+      fprintf(fp, "machine,run,stream_triad_bytes_per_s,%.17g\n", r.peakBandwidth);
+      fprintf(fp, "machine,run,multiply_add_flops_per_s,%.17g\n", r.peakFlops);
+   }
+
+   for (size_t i=0; i<phases.size(); ++i) {
+      const PhaseStats& p = phases[i];
+      fprintf(fp, "phase,%s,calls,%ld\n", p.name, long(p.calls));
+      fprintf(fp, "phase,%s,min_s,%.17g\n", p.name, p.tmin);
+      fprintf(fp, "phase,%s,avg_s,%.17g\n", p.name, p.tavg);
+      fprintf(fp, "phase,%s,max_s,%.17g\n", p.name, p.tmax);
+      fprintf(fp, "phase,%s,bytes,%.17g\n", p.name, p.bytes);
+      fprintf(fp, "phase,%s,flops,%.17g\n", p.name, p.flops);
+      for (Int_t c=0; c<numCounters; ++c) {
+         fprintf(fp, "phase,%s,%s,%.17g\n", p.name, counterName[c], p.count[c]);
+      }
+   }
+
+   for (size_t i=0; i<history.size(); ++i) {
+      fprintf(fp, "cycle,%d,time,%.17g\n", int(i+1), double(history[i].time));
+      fprintf(fp, "cycle,%d,dt,%.17g\n", int(i+1), double(history[i].dt));
+   }
+}
+
+/* Called on rank 0 only */
+void WriteRunResults(const cmdLineOpts& opts, const RunResults& results,
+                     const std::vector<TimeStepRecord>& history,
+                     const std::vector<PhaseStats>& phases,
+                     Int_t numCounters, Int_t numRanks)
+{
+#if _OPENMP
+   Int_t numThreads = omp_get_max_threads();
+#else
+   Int_t numThreads = 1;
+#endif
+
+   FILE *fp = fopen(opts.outputFile, "w");
+   if (fp == NULL) {
+      printf("Unable to open results file %s\n", opts.outputFile);
+      return;
+   }
+
+   if (opts.outputFormat == OutputJSON) {
+      WriteResultsJSON(fp, opts, results, history, phases,
+                       numCounters, numRanks, numThreads);
+   }
+   else {
+      WriteResultsCSV(fp, opts, results, history, phases,
+                      numCounters, numRanks, numThreads);
+   }
+
+   if (fclose(fp) != 0) {
+      printf("Error writing results file %s\n", opts.outputFile);
+   }
+}
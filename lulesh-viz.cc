@@ -2,6 +2,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "lulesh.h"
 
 #ifdef VIZ_MESH
@@ -431,3 +434,432 @@ void DumpToVisit(Domain& domain, int numFiles, int myRank, int numRanks)
 
 #endif
 
+
+/**********************************************************************/
+
+/*
+   Native VTK output, no external libraries: every rank writes its own
+   piece, lulesh_plot_c<cycle>_<rank>.vtu, concurrently with the others,
+   and rank 0 adds lulesh_plot_c<cycle>.pvtu to tie the pieces together.
+
+   A piece is one XML header followed by all of its arrays as appended
+   raw binary.  A dump is split in two: the snapshot converts the fields
+   to float, by all threads, straight into a staging image laid out
+   exactly like the appended data, and the write puts the image on disk
+   with one call.  Periodic dumps (-v N) hand the image to an I/O thread
+   and return, so the timestep loop only pays for the snapshot; a ring
+   of VTK_RING_SIZE images lets that many dumps be in flight.  Images
+   are kept (and locked in memory where permitted) for later dumps.
+
+   With --viz-stride s every s-th node of the structured domain block
+   along each axis is kept, and each coarse zone shows the values of the
+   fine zone at its lower corner.
+*/
+
+#define VTK_HEXAHEDRON 12
+#define VTK_RING_SIZE  3
+
+// Arrays of a piece in the order they are appended; the cell type
+// bytes go last so every other block stays 4-byte aligned
+enum { VTKVelocity, VTKSpeed, VTKEnergy, VTKPressure, VTKRelVol, VTKQ,
+       VTKSoundSpeed, VTKRegion, VTKPoints, VTKConnectivity, VTKOffsets,
+       VTKTypes, VTKNumBlocks } ;
+
+static const char *vtkBlockName[VTKNumBlocks] = {
+   "velocity", "speed", "e", "p", "v", "q", "ss", "region",
+   NULL, "connectivity", "offsets", "types"
+} ;
+
+struct VTKImage {
+   char    *data ;
+   size_t   capacity ;
+   size_t   size ;
+   size_t   offset[VTKNumBlocks] ;
+   Int_t    numNode ;
+   Int_t    numElem ;
+   Int_t    cycle ;
+   double   time ;
+   bool     busy ;       // snapshot taken, not yet on disk
+} ;
+
+static VTKImage        vtkRing[VTK_RING_SIZE] ;
+static Int_t           vtkQueue[VTK_RING_SIZE] ;
+static Int_t           vtkQueued = 0 ;
+static Int_t           vtkNext = 0 ;
+static Int_t           vtkRank = 0 ;
+static Int_t           vtkNumRanks = 1 ;
+static bool            vtkThreadRunning = false ;
+static bool            vtkQuit = false ;
+static pthread_t       vtkThread ;
+static pthread_mutex_t vtkLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  vtkCond = PTHREAD_COND_INITIALIZER ;
+
+/**********************************************************************/
+
+static const char *VTKByteOrder()
+{
+   const uint16_t one = 1 ;
+   return (*reinterpret_cast<const unsigned char *>(&one) == 1) ?
+          "LittleEndian" : "BigEndian" ;
+}
+
+/**********************************************************************/
+
+static void VTKPieceName(char *name, size_t len, int cycle, int rank)
+{
+   snprintf(name, len, "lulesh_plot_c%d_%05d.vtu", cycle, rank) ;
+}
+
+/**********************************************************************/
+
+static bool VTKReserve(VTKImage& image, size_t bytes)
+{
+   if (bytes > image.capacity) {
+      if (image.data != NULL) {
+         munlock(image.data, image.capacity) ;
+         free(image.data) ;
+      }
+      image.data = NULL ;
+      image.capacity = 0 ;
+      if (posix_memalign(reinterpret_cast<void **>(&image.data), 4096, bytes) != 0) {
+         image.data = NULL ;
+         return false ;
+      }
+      image.capacity = bytes ;
+      // Pinning is only an optimization; RLIMIT_MEMLOCK may refuse it
+      mlock(image.data, image.capacity) ;
+   }
+   image.size = bytes ;
+   return true ;
+}
+
+/**********************************************************************/
+
+// Lattice coordinates kept along one axis of an edgeElems block
+static void VTKSamples(Index_t edgeElems, Int_t stride, std::vector<Index_t>& samples)
+{
+   samples.clear() ;
+   for (Index_t i=0 ; i<edgeElems ; i+=stride) {
+      samples.push_back(i) ;
+   }
+   samples.push_back(edgeElems) ;
+}
+
+/**********************************************************************/
+
+static bool SnapshotVTK(Domain& domain, Int_t stride, VTKImage& image)
+{
+   // Coarse output needs the structured block; stride 1 works from the
+   // element connectivity and needs nothing else
+   std::vector<Index_t> samples ;
+   Index_t edgeElems = domain.sizeX() ;
+   Index_t edgeNodes = edgeElems + 1 ;
+   Index_t m = 0 ;
+   Index_t numNode = domain.numNode() ;
+   Index_t numElem = domain.numElem() ;
+   if (stride > 1) {
+      VTKSamples(edgeElems, stride, samples) ;
+      m = Index_t(samples.size()) ;
+      numNode = m*m*m ;
+      numElem = (m-1)*(m-1)*(m-1) ;
+   }
+
+   // Byte length of every appended block, without its UInt64 length
+   size_t blockBytes[VTKNumBlocks] ;
+   blockBytes[VTKVelocity]     = size_t(3)*numNode*sizeof(float) ;
+   blockBytes[VTKSpeed]        = size_t(numNode)*sizeof(float) ;
+   blockBytes[VTKEnergy]       = size_t(numElem)*sizeof(float) ;
+   blockBytes[VTKPressure]     = size_t(numElem)*sizeof(float) ;
+   blockBytes[VTKRelVol]       = size_t(numElem)*sizeof(float) ;
+   blockBytes[VTKQ]            = size_t(numElem)*sizeof(float) ;
+   blockBytes[VTKSoundSpeed]   = size_t(numElem)*sizeof(float) ;
+   blockBytes[VTKRegion]       = size_t(numElem)*sizeof(int) ;
+   blockBytes[VTKPoints]       = size_t(3)*numNode*sizeof(float) ;
+   blockBytes[VTKConnectivity] = size_t(8)*numElem*sizeof(int) ;
+   blockBytes[VTKOffsets]      = size_t(numElem)*sizeof(int) ;
+   blockBytes[VTKTypes]        = size_t(numElem) ;
+
+   size_t total = 0 ;
+   for (int b=0 ; b<VTKNumBlocks ; ++b) {
+      image.offset[b] = total ;
+      total += sizeof(uint64_t) + blockBytes[b] ;
+   }
+   if (!VTKReserve(image, total)) {
+      return false ;
+   }
+   image.numNode = numNode ;
+   image.numElem = numElem ;
+   image.cycle = domain.cycle() ;
+   image.time = double(domain.time()) ;
+
+   char *stage = image.data ;
+   for (int b=0 ; b<VTKNumBlocks ; ++b) {
+      uint64_t len = blockBytes[b] ;
+      memcpy(stage + image.offset[b], &len, sizeof(len)) ;
+   }
+
+#define VTK_BLOCK(T, b) reinterpret_cast<T *>(stage + image.offset[b] + sizeof(uint64_t))
+   float *vel    = VTK_BLOCK(float, VTKVelocity) ;
+   float *speed  = VTK_BLOCK(float, VTKSpeed) ;
+   float *points = VTK_BLOCK(float, VTKPoints) ;
+   float *e      = VTK_BLOCK(float, VTKEnergy) ;
+   float *p      = VTK_BLOCK(float, VTKPressure) ;
+   float *v      = VTK_BLOCK(float, VTKRelVol) ;
+   float *q      = VTK_BLOCK(float, VTKQ) ;
+   float *ss     = VTK_BLOCK(float, VTKSoundSpeed) ;
+   int   *region = VTK_BLOCK(int, VTKRegion) ;
+   int   *conn   = VTK_BLOCK(int, VTKConnectivity) ;
+   int   *offs   = VTK_BLOCK(int, VTKOffsets) ;
+   unsigned char *types = VTK_BLOCK(unsigned char, VTKTypes) ;
+#undef VTK_BLOCK
+
+   const Index_t *sample = samples.empty() ? NULL : &samples[0] ;
+
+#pragma omp parallel for firstprivate(numNode, m, edgeNodes, sample)
+   for (Index_t i=0 ; i<numNode ; ++i) {
+      Index_t ni = i ;
+      if (sample != NULL) {
+         ni = (sample[i/(m*m)]*edgeNodes + sample[(i/m)%m])*edgeNodes + sample[i%m] ;
+      }
+      float xd = float(domain.xd(ni)) ;
+      float yd = float(domain.yd(ni)) ;
+      float zd = float(domain.zd(ni)) ;
+      vel[3*i]      = xd ;
+      vel[3*i+1]    = yd ;
+      vel[3*i+2]    = zd ;
+      speed[i]      = float(sqrt((xd*xd)+(yd*yd)+(zd*zd))) ;
+      points[3*i]   = float(domain.x(ni)) ;
+      points[3*i+1] = float(domain.y(ni)) ;
+      points[3*i+2] = float(domain.z(ni)) ;
+   }
+
+#pragma omp parallel for firstprivate(numElem, m, edgeElems, sample)
+   for (Index_t i=0 ; i<numElem ; ++i) {
+      Index_t ei = i ;
+      if (sample != NULL) {
+         Index_t mc = m - 1 ;
+         Index_t col = i%mc, row = (i/mc)%mc, plane = i/(mc*mc) ;
+         ei = domain.spatialElem((sample[plane]*edgeElems + sample[row])*edgeElems
+                                 + sample[col]) ;
+         Index_t n0 = (plane*m + row)*m + col ;
+         conn[8*i]   = int(n0) ;
+         conn[8*i+1] = int(n0 + 1) ;
+         conn[8*i+2] = int(n0 + m + 1) ;
+         conn[8*i+3] = int(n0 + m) ;
+         conn[8*i+4] = int(n0 + m*m) ;
+         conn[8*i+5] = int(n0 + m*m + 1) ;
+         conn[8*i+6] = int(n0 + m*m + m + 1) ;
+         conn[8*i+7] = int(n0 + m*m + m) ;
+      }
+      else {
+         const Index_t *elemToNode = domain.nodelist(ei) ;
+         for (int ni=0 ; ni<8 ; ++ni) {
+            conn[8*i+ni] = int(elemToNode[ni]) ;
+         }
+      }
+      e[i]  = float(domain.e(ei)) ;
+      p[i]  = float(domain.p(ei)) ;
+      v[i]  = float(domain.v(ei)) ;
+      q[i]  = float(domain.q(ei)) ;
+      ss[i] = float(domain.ss(ei)) ;
+      region[i] = int(domain.regNumList(ei)) ;
+      offs[i] = int(8*(i+1)) ;
+      types[i] = VTK_HEXAHEDRON ;
+   }
+
+   return true ;
+}
+
+/**********************************************************************/
+
+static void WriteVTKMaster(int cycle, int numRanks)
+{
+   char fname[64] ;
+   snprintf(fname, sizeof(fname), "lulesh_plot_c%d.pvtu", cycle) ;
+   FILE *fp = fopen(fname, "w") ;
+   if (fp == NULL) {
+      printf("Error writing out viz file %s\n", fname) ;
+      return ;
+   }
+
+   fprintf(fp, "<?xml version=\"1.0\"?>\n"
+               "<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\" "
+               "byte_order=\"%s\" header_type=\"UInt64\">\n"
+               "<PUnstructuredGrid GhostLevel=\"0\">\n"
+               "<PPointData Vectors=\"velocity\" Scalars=\"speed\">\n"
+               "<PDataArray type=\"Float32\" Name=\"velocity\" NumberOfComponents=\"3\"/>\n"
+               "<PDataArray type=\"Float32\" Name=\"speed\"/>\n"
+               "</PPointData>\n"
+               "<PCellData Scalars=\"e\">\n", VTKByteOrder()) ;
+   for (int b=VTKEnergy ; b<VTKRegion ; ++b) {
+      fprintf(fp, "<PDataArray type=\"Float32\" Name=\"%s\"/>\n", vtkBlockName[b]) ;
+   }
+   fprintf(fp, "<PDataArray type=\"Int32\" Name=\"region\"/>\n"
+               "</PCellData>\n"
+               "<PPoints>\n"
+               "<PDataArray type=\"Float32\" NumberOfComponents=\"3\"/>\n"
+               "</PPoints>\n") ;
+   for (int r=0 ; r<numRanks ; ++r) {
+      char piece[64] ;
+      VTKPieceName(piece, sizeof(piece), cycle, r) ;
+      fprintf(fp, "<Piece Source=\"%s\"/>\n", piece) ;
+   }
+   fprintf(fp, "</PUnstructuredGrid>\n</VTKFile>\n") ;
+
+   if (fclose(fp) != 0) {
+      printf("Error writing out viz file %s\n", fname) ;
+   }
+}
+
+/**********************************************************************/
+
+static void WriteVTKImage(const VTKImage& image, int myRank, int numRanks)
+{
+   const size_t *offset = image.offset ;
+   char fname[64] ;
+   VTKPieceName(fname, sizeof(fname), image.cycle, myRank) ;
+   FILE *fp = fopen(fname, "wb") ;
+   if (fp == NULL) {
+      printf("Error writing out viz file - rank %d\n", myRank) ;
+      return ;
+   }
+
+   fprintf(fp, "<?xml version=\"1.0\"?>\n"
+               "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" "
+               "byte_order=\"%s\" header_type=\"UInt64\">\n"
+               "<UnstructuredGrid>\n"
+               "<FieldData>\n"
+               "<DataArray type=\"Float64\" Name=\"TIME\" NumberOfTuples=\"1\" format=\"ascii\">%.17g</DataArray>\n"
+               "<DataArray type=\"Int32\" Name=\"CYCLE\" NumberOfTuples=\"1\" format=\"ascii\">%d</DataArray>\n"
+               "</FieldData>\n"
+               "<Piece NumberOfPoints=\"%d\" NumberOfCells=\"%d\">\n",
+           VTKByteOrder(), image.time, int(image.cycle),
+           int(image.numNode), int(image.numElem)) ;
+   fprintf(fp, "<PointData Vectors=\"velocity\" Scalars=\"speed\">\n"
+               "<DataArray type=\"Float32\" Name=\"velocity\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%zu\"/>\n"
+               "<DataArray type=\"Float32\" Name=\"speed\" format=\"appended\" offset=\"%zu\"/>\n"
+               "</PointData>\n"
+               "<CellData Scalars=\"e\">\n",
+           offset[VTKVelocity], offset[VTKSpeed]) ;
+   for (int b=VTKEnergy ; b<VTKRegion ; ++b) {
+      fprintf(fp, "<DataArray type=\"Float32\" Name=\"%s\" format=\"appended\" offset=\"%zu\"/>\n",
+              vtkBlockName[b], offset[b]) ;
+   }
+   fprintf(fp, "<DataArray type=\"Int32\" Name=\"region\" format=\"appended\" offset=\"%zu\"/>\n"
+               "</CellData>\n"
+               "<Points>\n"
+               "<DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%zu\"/>\n"
+               "</Points>\n"
+               "<Cells>\n"
+               "<DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"%zu\"/>\n"
+               "<DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"%zu\"/>\n"
+               "<DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"%zu\"/>\n"
+               "</Cells>\n"
+               "</Piece>\n"
+               "</UnstructuredGrid>\n"
+               "<AppendedData encoding=\"raw\">\n_",
+           offset[VTKRegion], offset[VTKPoints], offset[VTKConnectivity],
+           offset[VTKOffsets], offset[VTKTypes]) ;
+
+   bool ok = (fwrite(image.data, 1, image.size, fp) == image.size) ;
+   fprintf(fp, "\n</AppendedData>\n</VTKFile>\n") ;
+   ok = (fclose(fp) == 0) && ok ;
+   if (!ok) {
+      printf("Error writing out viz file - rank %d\n", myRank) ;
+   }
+
+   if (myRank == 0) {
+      WriteVTKMaster(image.cycle, numRanks) ;
+   }
+}
+
+/**********************************************************************/
+
+static void *VTKWriterThread(void *)
+{
+   pthread_mutex_lock(&vtkLock) ;
+   for (;;) {
+      while ((vtkQueued == 0) && !vtkQuit) {
+         pthread_cond_wait(&vtkCond, &vtkLock) ;
+      }
+      if (vtkQueued == 0) {
+         break ;
+      }
+      Int_t slot = vtkQueue[0] ;
+      pthread_mutex_unlock(&vtkLock) ;
+
+      WriteVTKImage(vtkRing[slot], vtkRank, vtkNumRanks) ;
+
+      pthread_mutex_lock(&vtkLock) ;
+      for (Int_t k=1 ; k<vtkQueued ; ++k) {
+         vtkQueue[k-1] = vtkQueue[k] ;
+      }
+      --vtkQueued ;
+      vtkRing[slot].busy = false ;
+      pthread_cond_broadcast(&vtkCond) ;
+   }
+   pthread_mutex_unlock(&vtkLock) ;
+   return NULL ;
+}
+
+/**********************************************************************/
+
+void DumpToVTK(Domain& domain, int myRank, int numRanks, int stride, bool async)
+{
+   if (async && !vtkThreadRunning) {
+      vtkRank = myRank ;
+      vtkNumRanks = numRanks ;
+      vtkQuit = false ;
+      vtkThreadRunning =
+         (pthread_create(&vtkThread, NULL, VTKWriterThread, NULL) == 0) ;
+   }
+   async = async && vtkThreadRunning ;
+
+   // Wait only when every image of the ring is still queued
+   VTKImage& image = vtkRing[vtkNext] ;
+   pthread_mutex_lock(&vtkLock) ;
+   while (image.busy) {
+      pthread_cond_wait(&vtkCond, &vtkLock) ;
+   }
+   pthread_mutex_unlock(&vtkLock) ;
+
+   if (!SnapshotVTK(domain, stride, image)) {
+      printf("Error allocating viz staging buffer - rank %d\n", myRank) ;
+      return ;
+   }
+
+   if (!async) {
+      WriteVTKImage(image, myRank, numRanks) ;
+      return ;
+   }
+
+   pthread_mutex_lock(&vtkLock) ;
+   image.busy = true ;
+   vtkQueue[vtkQueued++] = vtkNext ;
+   pthread_cond_broadcast(&vtkCond) ;
+   pthread_mutex_unlock(&vtkLock) ;
+
+   vtkNext = (vtkNext + 1) % VTK_RING_SIZE ;
+}
+
+/**********************************************************************/
+
+void FinishVTK()
+{
+   if (vtkThreadRunning) {
+      pthread_mutex_lock(&vtkLock) ;
+      vtkQuit = true ;
+      pthread_cond_broadcast(&vtkCond) ;
+      pthread_mutex_unlock(&vtkLock) ;
+      pthread_join(vtkThread, NULL) ;
+      vtkThreadRunning = false ;
+   }
+   for (Int_t s=0 ; s<VTK_RING_SIZE ; ++s) {
+      if (vtkRing[s].data != NULL) {
+         munlock(vtkRing[s].data, vtkRing[s].capacity) ;
+         free(vtkRing[s].data) ;
+         vtkRing[s].data = NULL ;
+         vtkRing[s].capacity = 0 ;
+      }
+   }
+}
@@ -27,8 +27,32 @@ DIFFERENCES BETWEEN THIS VERSION (2.x) AND EARLIER VERSIONS:
  -b <balance>    : Load balance between regions of a domain (def: 1)
  -c <cost>       : Extra cost of more expensive regions (def: 1)
  -f <filepieces> : Number of file parts for viz output (def: np/9)
+ -R              : Store elements sorted by region (unit stride region loops)
+ --nodelist      : Read element corners from the node list even on the lattice mesh
+ --mesh <file>   : Run on an unstructured hex mesh read from file instead of the cube
+ --mesh-out <file> : Write the cube as a hex mesh file (one rank)
+ -a <cycles>     : Move elements between regions every <cycles> (def: 0, off)
+ -A <fraction>   : Fraction of elements sampled per region move (def: 0.01)
+ -L <cycles>     : Rebalance EOS work between ranks every <cycles> (def: 0, off)
+ -t <file>       : Use tabulated EOS read from file (def: analytic)
+ -T <file>       : Write built-in ideal gas EOS table to file and use it
+ -H <policy>     : Page policy for large arrays: none, thp, hugetlb (def: none)
+ -B              : A/B run, first with default pages then with -H (def: thp)
+ -N              : Report NUMA placement of field pages at startup
+ --timers        : Print the per phase timer report at the end
+ -P              : Add hardware counters to the phase timer report (implies --timers)
+ --output <fmt> <file> : Write results as json or csv to file
+ --roofline      : Measure machine peaks and report per phase GB/s and GFLOP/s
+ --sweep-threads <list> : Scaling table over thread counts, e.g. 1,2,4
+ --sweep-size <list>    : Scaling table over sizes, e.g. 30,60,90
+ --checkpoint <file> <cycles> : Write <file>.<rank> every <cycles> (0: at end only)
+ --restart <file> : Resume from checkpoint <file>.<rank>, same options and ranks
+ --checkpoint-async : Snapshot checkpoints and write them on a background thread
  -p              : Print out progress
- -v              : Output viz file (requires compiling with -DVIZ_MESH
+ -v [cycles]     : Output viz file at the end, and every [cycles] if given
+                   (SILO with -DVIZ_MESH, else VTK)
+ --vtk [cycles]  : Same as -v, as VTK .pvtu/.vtu with no external libraries
+ --viz-stride <s>: Keep every s-th node along each axis in VTK output (def: 1)
  -h              : This message
 
  printf("Usage: %s [opts]\n", execname);
@@ -40,8 +64,32 @@ DIFFERENCES BETWEEN THIS VERSION (2.x) AND EARLIER VERSIONS:
       printf(" -b <balance>    : Load balance between regions of a domain (def: 1)\n");
       printf(" -c <cost>       : Extra cost of more expensive regions (def: 1)\n");
       printf(" -f <numfiles>   : Number of files to split viz dump into (def: (np+10)/9)\n");
+      printf(" -R              : Store elements sorted by region (unit stride region loops)\n");
+      printf(" --nodelist      : Read element corners from the node list even on the lattice mesh\n");
+      printf(" --mesh <file>   : Run on an unstructured hex mesh read from file instead of the cube\n");
+      printf(" --mesh-out <file> : Write the cube as a hex mesh file (one rank)\n");
+      printf(" -a <cycles>     : Move elements between regions every <cycles> (def: 0, off)\n");
+      printf(" -A <fraction>   : Fraction of elements sampled per region move (def: 0.01)\n");
+      printf(" -L <cycles>     : Rebalance EOS work between ranks every <cycles> (def: 0, off)\n");
+      printf(" -t <file>       : Use tabulated EOS read from file (def: analytic)\n");
+      printf(" -T <file>       : Write built-in ideal gas EOS table to file and use it\n");
+      printf(" -H <policy>     : Page policy for large arrays: none, thp, hugetlb (def: none)\n");
+      printf(" -B              : A/B run, first with default pages then with -H (def: thp)\n");
+      printf(" -N              : Report NUMA placement of field pages at startup\n");
+      printf(" --timers        : Print the per phase timer report at the end\n");
+      printf(" -P              : Add hardware counters to the phase timer report (implies --timers)\n");
+      printf(" --output <fmt> <file> : Write results as json or csv to file\n");
+      printf(" --roofline      : Measure machine peaks and report per phase GB/s and GFLOP/s\n");
+      printf(" --sweep-threads <list> : Scaling table over thread counts, e.g. 1,2,4\n");
+      printf(" --sweep-size <list>    : Scaling table over sizes, e.g. 30,60,90\n");
+      printf(" --checkpoint <file> <cycles> : Write <file>.<rank> every <cycles> (0: at end only)\n");
+      printf(" --restart <file> : Resume from checkpoint <file>.<rank>, same options and ranks\n");
+      printf(" --checkpoint-async : Snapshot checkpoints and write them on a background thread\n");
       printf(" -p              : Print out progress\n");
-      printf(" -v              : Output viz file (requires compiling with -DVIZ_MESH\n");
+      printf(" -v [cycles]     : Output viz file at the end, and every [cycles] if given\n");
+      printf("                   (SILO with -DVIZ_MESH, else VTK)\n");
+      printf(" --vtk [cycles]  : Same as -v, as VTK .pvtu/.vtu with no external libraries\n");
+      printf(" --viz-stride <s>: Keep every s-th node along each axis in VTK output (def: 1)\n");
       printf(" -h              : This message\n");
       printf("\n\n");
 
@@ -161,11 +209,79 @@ Additional BSD Notice
 
 #include "lulesh.h"
 
+/* OpenMP in the timestep.  By default every kernel loop forks its own
+ * team.  Built with LULESH_PERSISTENT_OMP=1, one parallel region spans
+ * LagrangeLeapFrog instead and the loops are orphaned worksharing
+ * constructs bound to it, which saves a fork and join per loop at
+ * small problem sizes.  Loop invariants are only firstprivate in the
+ * default mode; inside the region they are private to each thread.
+ *
+ * Either way the code between the loops is written to run on every
+ * thread of the team: scratch arrays and Domain allocations are made
+ * by one thread in a single construct and shared via copyprivate,
+ * reduction results live in shared (static) variables, and MPI and
+ * other side effects happen on the master thread, followed by a
+ * barrier where the team reads the result.  Outside a parallel region
+ * these constructs bind to a team of one and cost next to nothing. */
+#define LULESH_PRAGMA(x) _Pragma(#x)
+#if LULESH_PERSISTENT_OMP
+#define OMP_FOR(...)          LULESH_PRAGMA(omp for __VA_ARGS__)
+#define OMP_PARALLEL(...)
+#define OMP_FIRSTPRIVATE(...)
+#else
+#define OMP_FOR(...)          LULESH_PRAGMA(omp parallel for __VA_ARGS__)
+#define OMP_PARALLEL(...)     LULESH_PRAGMA(omp parallel __VA_ARGS__)
+#define OMP_FIRSTPRIVATE(...) firstprivate(__VA_ARGS__)
+#endif
+
 /* Work Routines */
 
+/* Sanity checks ride along in the kernels: each thread records the
+ * lowest failing element it sees, the elemError reduction merges the
+ * threads, and CheckElemError aborts once the parallel loop is done */
+static inline
+void FlagElemError(ElemError& err, Int_t code, Index_t elem)
+{
+   if ((err.code == 0) || (elem < err.elem)) {
+      err.code = code ;
+      err.elem = elem ;
+   }
+}
+
+static inline
+void MergeElemError(ElemError& out, const ElemError& in)
+{
+   if (in.code != 0) {
+      FlagElemError(out, in.code, in.elem) ;
+   }
+}
+
+#pragma omp declare reduction(elemError : ElemError : MergeElemError(omp_out, omp_in)) \
+        initializer(omp_priv = omp_orig)
+
+static inline
+void ClearElemError(ElemError& err)
+{
+   err.code = 0 ;
+   err.elem = -1 ;
+}
+
+static inline
+void CheckElemError(Domain& domain, const ElemError& err, const char *where)
+{
+   if (err.code != 0) {
+#pragma omp master
+      ReportElemError(domain, err, where) ;
+   }
+}
+
+/******************************************/
+
 static inline
 void TimeIncrement(Domain& domain)
 {
+   SCOPED_TIMER(TimerTimeIncrement) ;
+
    Real_t targetdt = domain.stoptime() - domain.time() ;
 
    if ((domain.dtfixed() <= Real_t(0.0)) && (domain.cycle() != Int_t(0))) {
@@ -279,10 +395,12 @@ void InitStressTermsForElems(Domain &domain,
    // pull in the stresses appropriate to the hydro integration
    //
 
-#pragma omp parallel for firstprivate(numElem)
+   OMP_FOR(OMP_FIRSTPRIVATE(numElem))
    for (Index_t i = 0 ; i < numElem ; ++i){
       sigxx[i] = sigyy[i] = sigzz[i] =  - domain.p(i) - domain.q(i) ;
    }
+
+   TimerAddWork(REAL_BYTES(5*numElem), 2.0*numElem) ;
 }
 
 /******************************************/
@@ -491,8 +609,9 @@ void SumElemStressesToNodeForces( const Real_t B[][8],
 
 /******************************************/
 
+template <typename Mesh>
 static inline
-void IntegrateStressForElems( Domain &domain,
+void IntegrateStressForElems( Domain &domain, const Mesh &mesh,
                               Real_t *sigxx, Real_t *sigyy, Real_t *sigzz,
                               Real_t *determ, Index_t numElem, Index_t numNode)
 {
@@ -503,25 +622,34 @@ void IntegrateStressForElems( Domain &domain,
 #endif
 
    Index_t numElem8 = numElem * 8 ;
-   Real_t *fx_elem;
-   Real_t *fy_elem;
-   Real_t *fz_elem;
+   Real_t *fx_elem = NULL ;
+   Real_t *fy_elem = NULL ;
+   Real_t *fz_elem = NULL ;
    Real_t fx_local[8] ;
    Real_t fy_local[8] ;
    Real_t fz_local[8] ;
+   static ElemError err ;
 
-
-  if (numthreads > 1) {
-     fx_elem = Allocate<Real_t>(numElem8) ;
-     fy_elem = Allocate<Real_t>(numElem8) ;
-     fz_elem = Allocate<Real_t>(numElem8) ;
+#pragma omp single copyprivate(fx_elem, fy_elem, fz_elem)
+  {
+     if (numthreads > 1) {
+        fx_elem = Allocate<Real_t>(numElem8) ;
+        fy_elem = Allocate<Real_t>(numElem8) ;
+        fz_elem = Allocate<Real_t>(numElem8) ;
+     }
+     ClearElemError(err) ;
   }
+
   // loop over all elements
 
-#pragma omp parallel for firstprivate(numElem)
-  for( Index_t k=0 ; k<numElem ; ++k )
+  Index_t numPencil = mesh.numPencils() ;
+
+  OMP_FOR(OMP_FIRSTPRIVATE(numPencil) reduction(elemError : err))
+  for( Index_t p=0 ; p<numPencil ; ++p )
+  for( Index_t k=mesh.pencilBegin(p) ; k<mesh.pencilEnd(p) ; ++k )
   {
-    const Index_t* const elemToNode = domain.nodelist(k);
+    Index_t nodes[8] ;
+    const Index_t* const elemToNode = mesh.elemNodes(p, k, nodes);
     Real_t B[3][8] ;// shape function derivatives
     Real_t x_local[8] ;
     Real_t y_local[8] ;
@@ -534,6 +662,11 @@ void IntegrateStressForElems( Domain &domain,
     CalcElemShapeFunctionDerivatives(x_local, y_local, z_local,
                                          B, &determ[k]);
 
+    // check for negative element volume
+    if (determ[k] <= Real_t(0.0)) {
+       FlagElemError(err, VolumeError, k) ;
+    }
+
     CalcElemNodeNormals( B[0] , B[1], B[2],
                           x_local, y_local, z_local );
 
@@ -559,10 +692,12 @@ void IntegrateStressForElems( Domain &domain,
     }
   }
 
+  CheckElemError(domain, err, "IntegrateStressForElems") ;
+
   if (numthreads > 1) {
      // If threaded, then we need to copy the data out of the temporary
      // arrays used above into the final forces field
-#pragma omp parallel for firstprivate(numNode)
+     OMP_FOR(OMP_FIRSTPRIVATE(numNode))
      for( Index_t gnode=0 ; gnode<numNode ; ++gnode )
      {
         Index_t count = domain.nodeElemCount(gnode) ;
@@ -580,10 +715,27 @@ void IntegrateStressForElems( Domain &domain,
         domain.fy(gnode) = fy_tmp ;
         domain.fz(gnode) = fz_tmp ;
      }
-     Release(&fz_elem) ;
-     Release(&fy_elem) ;
-     Release(&fx_elem) ;
+#pragma omp single
+     {
+        Release(&fz_elem) ;
+        Release(&fy_elem) ;
+        Release(&fx_elem) ;
+     }
+  }
+
+  // Stresses in and determ out per element, coordinates in and forces
+  // updated per node, or per corner and then summed when threaded.
+  // Shape functions 141, node normals 288, corner forces 24, sums 24.
+  double bytes = INDEX_BYTES(8*numElem) + REAL_BYTES(4*numElem) +
+                 REAL_BYTES(3*numNode) ;
+  if (numthreads > 1) {
+     bytes += REAL_BYTES(2*24*numElem + 3*numNode) +
+              INDEX_BYTES(8*numElem + 2*numNode) ;
+  }
+  else {
+     bytes += REAL_BYTES(6*numNode) ;
   }
+  TimerAddWork(bytes, 477.0*numElem) ;
 }
 
 /******************************************/
@@ -707,8 +859,9 @@ void CalcElemFBHourglassForce(Real_t *xd, Real_t *yd, Real_t *zd,  Real_t hourga
 
 /******************************************/
 
+template <typename Mesh>
 static inline
-void CalcFBHourglassForceForElems( Domain &domain,
+void CalcFBHourglassForceForElems( Domain &domain, const Mesh &mesh,
                                    Real_t *determ,
                                    Real_t *x8n, Real_t *y8n, Real_t *z8n,
                                    Real_t *dvdx, Real_t *dvdy, Real_t *dvdz,
@@ -730,10 +883,11 @@ void CalcFBHourglassForceForElems( Domain &domain,
   
    Index_t numElem8 = numElem * 8 ;
 
-   Real_t *fx_elem; 
-   Real_t *fy_elem; 
-   Real_t *fz_elem; 
+   Real_t *fx_elem = NULL ;
+   Real_t *fy_elem = NULL ;
+   Real_t *fz_elem = NULL ;
 
+#pragma omp single copyprivate(fx_elem, fy_elem, fz_elem)
    if(numthreads > 1) {
       fx_elem = Allocate<Real_t>(numElem8) ;
       fy_elem = Allocate<Real_t>(numElem8) ;
@@ -779,8 +933,11 @@ void CalcFBHourglassForceForElems( Domain &domain,
 /*    compute the hourglass modes */
 
 
-#pragma omp parallel for firstprivate(numElem, hourg)
-   for(Index_t i2=0;i2<numElem;++i2){
+   Index_t numPencil = mesh.numPencils() ;
+
+   OMP_FOR(OMP_FIRSTPRIVATE(numPencil, hourg))
+   for(Index_t p=0;p<numPencil;++p)
+   for(Index_t i2=mesh.pencilBegin(p);i2<mesh.pencilEnd(p);++i2){
       Real_t *fx_local, *fy_local, *fz_local ;
       Real_t hgfx[8], hgfy[8], hgfz[8] ;
 
@@ -789,7 +946,8 @@ void CalcFBHourglassForceForElems( Domain &domain,
       Real_t hourgam[8][4];
       Real_t xd1[8], yd1[8], zd1[8] ;
 
-      const Index_t *elemToNode = domain.nodelist(i2);
+      Index_t nodes[8] ;
+      const Index_t *elemToNode = mesh.elemNodes(p, i2, nodes);
       Index_t i3=8*i2;
       Real_t volinv=Real_t(1.0)/determ[i2];
       Real_t ss1, mass1, volume13 ;
@@ -966,7 +1124,7 @@ void CalcFBHourglassForceForElems( Domain &domain,
 
    if (numthreads > 1) {
      // Collect the data from the local arrays into the final force arrays
-#pragma omp parallel for firstprivate(numNode)
+      OMP_FOR(OMP_FIRSTPRIVATE(numNode))
       for( Index_t gnode=0 ; gnode<numNode ; ++gnode )
       {
          Index_t count = domain.nodeElemCount(gnode) ;
@@ -984,34 +1142,59 @@ void CalcFBHourglassForceForElems( Domain &domain,
          domain.fy(gnode) += fy_tmp ;
          domain.fz(gnode) += fz_tmp ;
       }
-      Release(&fz_elem) ;
-      Release(&fy_elem) ;
-      Release(&fx_elem) ;
+#pragma omp single
+      {
+         Release(&fz_elem) ;
+         Release(&fy_elem) ;
+         Release(&fx_elem) ;
+      }
+   }
+
+   // Corner coordinates and volume derivatives, determ, ss and mass in
+   // per element, velocities in and forces updated per node.  Hourglass
+   // modes 404, coefficient 7, element forces 372, sums 24.
+   double bytes = INDEX_BYTES(8*numElem) + REAL_BYTES(51*numElem) +
+                  REAL_BYTES(9*numNode) ;
+   if (numthreads > 1) {
+      bytes += REAL_BYTES(2*24*numElem) + INDEX_BYTES(8*numElem + 2*numNode) ;
    }
+   TimerAddWork(bytes, 807.0*numElem) ;
 }
 
 /******************************************/
 
+template <typename Mesh>
 static inline
-void CalcHourglassControlForElems(Domain& domain,
+void CalcHourglassControlForElems(Domain& domain, const Mesh &mesh,
                                   Real_t determ[], Real_t hgcoef)
 {
    Index_t numElem = domain.numElem() ;
    Index_t numElem8 = numElem * 8 ;
-   Real_t *dvdx = Allocate<Real_t>(numElem8) ;
-   Real_t *dvdy = Allocate<Real_t>(numElem8) ;
-   Real_t *dvdz = Allocate<Real_t>(numElem8) ;
-   Real_t *x8n  = Allocate<Real_t>(numElem8) ;
-   Real_t *y8n  = Allocate<Real_t>(numElem8) ;
-   Real_t *z8n  = Allocate<Real_t>(numElem8) ;
+   Real_t *dvdx, *dvdy, *dvdz, *x8n, *y8n, *z8n ;
+   static ElemError err ;
+
+#pragma omp single copyprivate(dvdx, dvdy, dvdz, x8n, y8n, z8n)
+   {
+      dvdx = Allocate<Real_t>(numElem8) ;
+      dvdy = Allocate<Real_t>(numElem8) ;
+      dvdz = Allocate<Real_t>(numElem8) ;
+      x8n  = Allocate<Real_t>(numElem8) ;
+      y8n  = Allocate<Real_t>(numElem8) ;
+      z8n  = Allocate<Real_t>(numElem8) ;
+      ClearElemError(err) ;
+   }
 
    /* start loop over elements */
-#pragma omp parallel for firstprivate(numElem)
-   for (Index_t i=0 ; i<numElem ; ++i){
+   Index_t numPencil = mesh.numPencils() ;
+
+   OMP_FOR(OMP_FIRSTPRIVATE(numPencil) reduction(elemError : err))
+   for (Index_t p=0 ; p<numPencil ; ++p)
+   for (Index_t i=mesh.pencilBegin(p) ; i<mesh.pencilEnd(p) ; ++i){
       Real_t  x1[8],  y1[8],  z1[8] ;
       Real_t pfx[8], pfy[8], pfz[8] ;
 
-      Index_t* elemToNode = domain.nodelist(i);
+      Index_t nodes[8] ;
+      const Index_t* elemToNode = mesh.elemNodes(p, i, nodes);
       CollectDomainNodesToElemNodes(domain, elemToNode, x1, y1, z1);
 
       CalcElemVolumeDerivative(pfx, pfy, pfz, x1, y1, z1);
@@ -1032,26 +1215,33 @@ void CalcHourglassControlForElems(Domain& domain,
 
       /* Do a check for negative volumes */
       if ( domain.v(i) <= Real_t(0.0) ) {
-#if USE_MPI         
-         MPI_Abort(MPI_COMM_WORLD, VolumeError) ;
-#else
-         exit(VolumeError);
-#endif
+         FlagElemError(err, VolumeError, i) ;
       }
    }
 
+   CheckElemError(domain, err, "CalcHourglassControlForElems") ;
+
+   // Coordinates in per node; volo and v in, determ and the corner
+   // coordinates and volume derivatives out per element.  Volume
+   // derivatives 576, determ 1.
+   TimerAddWork(INDEX_BYTES(8*numElem) + REAL_BYTES(51*numElem) +
+                REAL_BYTES(3*domain.numNode()), 577.0*numElem) ;
+
    if ( hgcoef > Real_t(0.) ) {
-      CalcFBHourglassForceForElems( domain,
+      CalcFBHourglassForceForElems( domain, mesh,
                                     determ, x8n, y8n, z8n, dvdx, dvdy, dvdz,
                                     hgcoef, numElem, domain.numNode()) ;
    }
 
-   Release(&z8n) ;
-   Release(&y8n) ;
-   Release(&x8n) ;
-   Release(&dvdz) ;
-   Release(&dvdy) ;
-   Release(&dvdx) ;
+#pragma omp single
+   {
+      Release(&z8n) ;
+      Release(&y8n) ;
+      Release(&x8n) ;
+      Release(&dvdz) ;
+      Release(&dvdy) ;
+      Release(&dvdx) ;
+   }
 
    return ;
 }
@@ -1064,38 +1254,45 @@ void CalcVolumeForceForElems(Domain& domain)
    Index_t numElem = domain.numElem() ;
    if (numElem != 0) {
       Real_t  hgcoef = domain.hgcoef() ;
-      Real_t *sigxx  = Allocate<Real_t>(numElem) ;
-      Real_t *sigyy  = Allocate<Real_t>(numElem) ;
-      Real_t *sigzz  = Allocate<Real_t>(numElem) ;
-      Real_t *determ = Allocate<Real_t>(numElem) ;
+      Real_t *sigxx, *sigyy, *sigzz, *determ ;
+
+#pragma omp single copyprivate(sigxx, sigyy, sigzz, determ)
+      {
+         sigxx  = Allocate<Real_t>(numElem) ;
+         sigyy  = Allocate<Real_t>(numElem) ;
+         sigzz  = Allocate<Real_t>(numElem) ;
+         determ = Allocate<Real_t>(numElem) ;
+      }
 
       /* Sum contributions to total stress tensor */
       InitStressTermsForElems(domain, sigxx, sigyy, sigzz, numElem);
 
       // call elemlib stress integration loop to produce nodal forces from
       // material stresses.
-      IntegrateStressForElems( domain,
-                               sigxx, sigyy, sigzz, determ, numElem,
-                               domain.numNode()) ;
-
-      // check for negative element volume
-#pragma omp parallel for firstprivate(numElem)
-      for ( Index_t k=0 ; k<numElem ; ++k ) {
-         if (determ[k] <= Real_t(0.0)) {
-#if USE_MPI            
-            MPI_Abort(MPI_COMM_WORLD, VolumeError) ;
-#else
-            exit(VolumeError);
-#endif
-         }
+      if (domain.latticeNodes()) {
+         LatticeNodes mesh(domain) ;
+         IntegrateStressForElems( domain, mesh,
+                                  sigxx, sigyy, sigzz, determ, numElem,
+                                  domain.numNode()) ;
+
+         CalcHourglassControlForElems(domain, mesh, determ, hgcoef) ;
       }
+      else {
+         NodeList mesh(domain) ;
+         IntegrateStressForElems( domain, mesh,
+                                  sigxx, sigyy, sigzz, determ, numElem,
+                                  domain.numNode()) ;
 
-      CalcHourglassControlForElems(domain, determ, hgcoef) ;
+         CalcHourglassControlForElems(domain, mesh, determ, hgcoef) ;
+      }
 
-      Release(&determ) ;
-      Release(&sigzz) ;
-      Release(&sigyy) ;
-      Release(&sigxx) ;
+#pragma omp single
+      {
+         Release(&determ) ;
+         Release(&sigzz) ;
+         Release(&sigyy) ;
+         Release(&sigxx) ;
+      }
    }
 }
 
@@ -1103,20 +1300,24 @@ void CalcVolumeForceForElems(Domain& domain)
 
 static inline void CalcForceForNodes(Domain& domain)
 {
+  SCOPED_TIMER(TimerCalcForceForNodes) ;
+
   Index_t numNode = domain.numNode() ;
 
 #if USE_MPI  
+#pragma omp master
   CommRecv(domain, MSG_COMM_SBN, 3,
            domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
            true, false) ;
 #endif  
 
-#pragma omp parallel for firstprivate(numNode)
+  OMP_FOR(OMP_FIRSTPRIVATE(numNode))
   for (Index_t i=0; i<numNode; ++i) {
      domain.fx(i) = Real_t(0.0) ;
      domain.fy(i) = Real_t(0.0) ;
      domain.fz(i) = Real_t(0.0) ;
   }
+  TimerAddWork(REAL_BYTES(3*numNode), 0.0) ;
 
   /* Calcforce calls partial, force, hourq */
   CalcVolumeForceForElems(domain) ;
@@ -1127,95 +1328,54 @@ static inline void CalcForceForNodes(Domain& domain)
   fieldData[1] = &Domain::fy ;
   fieldData[2] = &Domain::fz ;
   
-  CommSend(domain, MSG_COMM_SBN, 3, fieldData,
-           domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() +  1,
-           true, false) ;
-  CommSBN(domain, 3, fieldData) ;
+#pragma omp master
+  {
+     CommSend(domain, MSG_COMM_SBN, 3, fieldData,
+              domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() +  1,
+              true, false) ;
+     CommSBN(domain, 3, fieldData) ;
+  }
+#pragma omp barrier
 #endif  
 }
 
 /******************************************/
 
+// Acceleration, symmetry boundary conditions, velocity and position in
+// one pass over the nodes; the acceleration never leaves registers
 static inline
-void CalcAccelerationForNodes(Domain &domain, Index_t numNode)
-{
-   
-#pragma omp parallel for firstprivate(numNode)
-   for (Index_t i = 0; i < numNode; ++i) {
-      domain.xdd(i) = domain.fx(i) / domain.nodalMass(i);
-      domain.ydd(i) = domain.fy(i) / domain.nodalMass(i);
-      domain.zdd(i) = domain.fz(i) / domain.nodalMass(i);
-   }
-}
-
-/******************************************/
-
-static inline
-void ApplyAccelerationBoundaryConditionsForNodes(Domain& domain)
-{
-   Index_t size = domain.sizeX();
-   Index_t numNodeBC = (size+1)*(size+1) ;
-
-#pragma omp parallel
-   {
-      if (!domain.symmXempty() != 0) {
-#pragma omp for nowait firstprivate(numNodeBC)
-         for(Index_t i=0 ; i<numNodeBC ; ++i)
-            domain.xdd(domain.symmX(i)) = Real_t(0.0) ;
-      }
-
-      if (!domain.symmYempty() != 0) {
-#pragma omp for nowait firstprivate(numNodeBC)
-         for(Index_t i=0 ; i<numNodeBC ; ++i)
-            domain.ydd(domain.symmY(i)) = Real_t(0.0) ;
-      }
-
-      if (!domain.symmZempty() != 0) {
-#pragma omp for nowait firstprivate(numNodeBC)
-         for(Index_t i=0 ; i<numNodeBC ; ++i)
-            domain.zdd(domain.symmZ(i)) = Real_t(0.0) ;
-      }
-   }
-}
-
-/******************************************/
-
-static inline
-void CalcVelocityForNodes(Domain &domain, const Real_t dt, const Real_t u_cut,
-                          Index_t numNode)
+void IntegrateNodes(Domain &domain, const Real_t dt, const Real_t u_cut,
+                    Index_t numNode)
 {
+   SCOPED_TIMER(TimerIntegrateNodes) ;
 
-#pragma omp parallel for firstprivate(numNode)
-   for ( Index_t i = 0 ; i < numNode ; ++i )
-   {
-     Real_t xdtmp, ydtmp, zdtmp ;
-
-     xdtmp = domain.xd(i) + domain.xdd(i) * dt ;
-     if( FABS(xdtmp) < u_cut ) xdtmp = Real_t(0.0);
-     domain.xd(i) = xdtmp ;
-
-     ydtmp = domain.yd(i) + domain.ydd(i) * dt ;
-     if( FABS(ydtmp) < u_cut ) ydtmp = Real_t(0.0);
-     domain.yd(i) = ydtmp ;
-
-     zdtmp = domain.zd(i) + domain.zdd(i) * dt ;
-     if( FABS(zdtmp) < u_cut ) zdtmp = Real_t(0.0);
-     domain.zd(i) = zdtmp ;
+   OMP_FOR(OMP_FIRSTPRIVATE(numNode, dt, u_cut))
+   for (Index_t i = 0; i < numNode; ++i) {
+      const unsigned char bc = domain.nodeBC(i) ;
+      const Real_t mass = domain.nodalMass(i) ;
+
+      Real_t xdd = (bc & NODE_SYMM_X) ? Real_t(0.0) : domain.fx(i) / mass ;
+      Real_t ydd = (bc & NODE_SYMM_Y) ? Real_t(0.0) : domain.fy(i) / mass ;
+      Real_t zdd = (bc & NODE_SYMM_Z) ? Real_t(0.0) : domain.fz(i) / mass ;
+
+      Real_t xdtmp = domain.xd(i) + xdd * dt ;
+      if( FABS(xdtmp) < u_cut ) xdtmp = Real_t(0.0);
+      Real_t ydtmp = domain.yd(i) + ydd * dt ;
+      if( FABS(ydtmp) < u_cut ) ydtmp = Real_t(0.0);
+      Real_t zdtmp = domain.zd(i) + zdd * dt ;
+      if( FABS(zdtmp) < u_cut ) zdtmp = Real_t(0.0);
+
+      domain.xd(i) = xdtmp ;
+      domain.yd(i) = ydtmp ;
+      domain.zd(i) = zdtmp ;
+
+      domain.x(i) += xdtmp * dt ;
+      domain.y(i) += ydtmp * dt ;
+      domain.z(i) += zdtmp * dt ;
    }
-}
-
-/******************************************/
 
-static inline
-void CalcPositionForNodes(Domain &domain, const Real_t dt, Index_t numNode)
-{
-#pragma omp parallel for firstprivate(numNode)
-   for ( Index_t i = 0 ; i < numNode ; ++i )
-   {
-     domain.x(i) += domain.xd(i) * dt ;
-     domain.y(i) += domain.yd(i) * dt ;
-     domain.z(i) += domain.zd(i) * dt ;
-   }
+   // f, m, v, x in; v, x out; one flag byte
+   TimerAddWork(REAL_BYTES(16*numNode) + double(numNode), 15.0*numNode) ;
 }
 
 /******************************************/
@@ -1236,19 +1396,14 @@ void LagrangeNodal(Domain& domain)
 
 #if USE_MPI  
 #ifdef SEDOV_SYNC_POS_VEL_EARLY
+#pragma omp master
    CommRecv(domain, MSG_SYNC_POS_VEL, 6,
             domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
             false, false) ;
 #endif
 #endif
    
-   CalcAccelerationForNodes(domain, domain.numNode());
-   
-   ApplyAccelerationBoundaryConditionsForNodes(domain);
-
-   CalcVelocityForNodes( domain, delt, u_cut, domain.numNode()) ;
-
-   CalcPositionForNodes( domain, delt, domain.numNode() );
+   IntegrateNodes(domain, delt, u_cut, domain.numNode()) ;
 #if USE_MPI
 #ifdef SEDOV_SYNC_POS_VEL_EARLY
   fieldData[0] = &Domain::x ;
@@ -1258,10 +1413,14 @@ void LagrangeNodal(Domain& domain)
   fieldData[4] = &Domain::yd ;
   fieldData[5] = &Domain::zd ;
 
-   CommSend(domain, MSG_SYNC_POS_VEL, 6, fieldData,
-            domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
-            false, false) ;
-   CommSyncPosVel(domain) ;
+#pragma omp master
+   {
+      CommSend(domain, MSG_SYNC_POS_VEL, 6, fieldData,
+               domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
+               false, false) ;
+      CommSyncPosVel(domain) ;
+   }
+#pragma omp barrier
 #endif
 #endif
    
@@ -1501,14 +1660,18 @@ void CalcElemVelocityGradient( const Real_t* const xvel,
 
 /******************************************/
 
+template <typename Mesh>
 //static inline
-void CalcKinematicsForElems( Domain &domain,
+void CalcKinematicsForElems( Domain &domain, const Mesh &mesh,
                              Real_t deltaTime, Index_t numElem )
 {
 
   // loop over all elements
-#pragma omp parallel for firstprivate(numElem, deltaTime)
-  for( Index_t k=0 ; k<numElem ; ++k )
+  Index_t numPencil = mesh.numPencils() ;
+
+  OMP_FOR(OMP_FIRSTPRIVATE(numPencil, deltaTime))
+  for( Index_t p=0 ; p<numPencil ; ++p )
+  for( Index_t k=mesh.pencilBegin(p) ; k<mesh.pencilEnd(p) ; ++k )
   {
     Real_t B[3][8] ; /** shape function derivatives */
     Real_t D[6] ;
@@ -1522,7 +1685,8 @@ void CalcKinematicsForElems( Domain &domain,
 
     Real_t volume ;
     Real_t relativeVolume ;
-    const Index_t* const elemToNode = domain.nodelist(k) ;
+    Index_t nodes[8] ;
+    const Index_t* const elemToNode = mesh.elemNodes(p, k, nodes) ;
 
     // get nodal coordinates from global arrays and copy into local arrays.
     CollectDomainNodesToElemNodes(domain, elemToNode, x_local, y_local, z_local);
@@ -1565,6 +1729,12 @@ void CalcKinematicsForElems( Domain &domain,
     domain.dyy(k) = D[1];
     domain.dzz(k) = D[2];
   }
+
+  // Coordinates and velocities in per node, volo and v in and six
+  // results out per element.  Volume 90, characteristic length 249,
+  // half step 48, shape functions 141, velocity gradient 115, other 3.
+  TimerAddWork(INDEX_BYTES(8*numElem) + REAL_BYTES(8*numElem) +
+               REAL_BYTES(6*domain.numNode()), 646.0*numElem) ;
 }
 
 /******************************************/
@@ -1572,16 +1742,30 @@ void CalcKinematicsForElems( Domain &domain,
 static inline
 void CalcLagrangeElements(Domain& domain)
 {
+   SCOPED_TIMER(TimerCalcLagrangeElements) ;
+
    Index_t numElem = domain.numElem() ;
    if (numElem > 0) {
       const Real_t deltatime = domain.deltatime() ;
+      static ElemError err ;
 
-      domain.AllocateStrains(numElem);
+#pragma omp single
+      {
+         domain.AllocateStrains(numElem);
+         ClearElemError(err) ;
+      }
 
-      CalcKinematicsForElems(domain, deltatime, numElem) ;
+      if (domain.latticeNodes()) {
+         CalcKinematicsForElems(domain, LatticeNodes(domain),
+                                deltatime, numElem) ;
+      }
+      else {
+         CalcKinematicsForElems(domain, NodeList(domain),
+                                deltatime, numElem) ;
+      }
 
       // element loop to do some stuff not included in the elemlib function.
-#pragma omp parallel for firstprivate(numElem)
+      OMP_FOR(OMP_FIRSTPRIVATE(numElem) reduction(elemError : err))
       for ( Index_t k=0 ; k<numElem ; ++k )
       {
          // calc strain rate and apply as constraint (only done in FB element)
@@ -1597,13 +1781,12 @@ void CalcLagrangeElements(Domain& domain)
         // See if any volumes are negative, and take appropriate action.
          if (domain.vnew(k) <= Real_t(0.0))
         {
-#if USE_MPI           
-           MPI_Abort(MPI_COMM_WORLD, VolumeError) ;
-#else
-           exit(VolumeError);
-#endif
+           FlagElemError(err, VolumeError, k) ;
         }
       }
+      CheckElemError(domain, err, "CalcLagrangeElements") ;
+      TimerAddWork(REAL_BYTES(8*numElem), 6.0*numElem) ;
+#pragma omp single
       domain.DeallocateStrains();
    }
 }
@@ -1611,319 +1794,313 @@ void CalcLagrangeElements(Domain& domain)
 /******************************************/
 
 static inline
-void CalcMonotonicQGradientsForElems(Domain& domain)
+void CalcElemMonoQGradients(Domain& domain, Index_t i,
+                            const Index_t *elemToNode,
+                            Real_t delx[3], Real_t delv[3])
+{
+   const Real_t ptiny = Real_t(1.e-36) ;
+   Real_t ax,ay,az ;
+   Real_t dxv,dyv,dzv ;
+
+   Index_t n0 = elemToNode[0] ;
+   Index_t n1 = elemToNode[1] ;
+   Index_t n2 = elemToNode[2] ;
+   Index_t n3 = elemToNode[3] ;
+   Index_t n4 = elemToNode[4] ;
+   Index_t n5 = elemToNode[5] ;
+   Index_t n6 = elemToNode[6] ;
+   Index_t n7 = elemToNode[7] ;
+
+   Real_t x0 = domain.x(n0) ;
+   Real_t x1 = domain.x(n1) ;
+   Real_t x2 = domain.x(n2) ;
+   Real_t x3 = domain.x(n3) ;
+   Real_t x4 = domain.x(n4) ;
+   Real_t x5 = domain.x(n5) ;
+   Real_t x6 = domain.x(n6) ;
+   Real_t x7 = domain.x(n7) ;
+
+   Real_t y0 = domain.y(n0) ;
+   Real_t y1 = domain.y(n1) ;
+   Real_t y2 = domain.y(n2) ;
+   Real_t y3 = domain.y(n3) ;
+   Real_t y4 = domain.y(n4) ;
+   Real_t y5 = domain.y(n5) ;
+   Real_t y6 = domain.y(n6) ;
+   Real_t y7 = domain.y(n7) ;
+
+   Real_t z0 = domain.z(n0) ;
+   Real_t z1 = domain.z(n1) ;
+   Real_t z2 = domain.z(n2) ;
+   Real_t z3 = domain.z(n3) ;
+   Real_t z4 = domain.z(n4) ;
+   Real_t z5 = domain.z(n5) ;
+   Real_t z6 = domain.z(n6) ;
+   Real_t z7 = domain.z(n7) ;
+
+   Real_t xv0 = domain.xd(n0) ;
+   Real_t xv1 = domain.xd(n1) ;
+   Real_t xv2 = domain.xd(n2) ;
+   Real_t xv3 = domain.xd(n3) ;
+   Real_t xv4 = domain.xd(n4) ;
+   Real_t xv5 = domain.xd(n5) ;
+   Real_t xv6 = domain.xd(n6) ;
+   Real_t xv7 = domain.xd(n7) ;
+
+   Real_t yv0 = domain.yd(n0) ;
+   Real_t yv1 = domain.yd(n1) ;
+   Real_t yv2 = domain.yd(n2) ;
+   Real_t yv3 = domain.yd(n3) ;
+   Real_t yv4 = domain.yd(n4) ;
+   Real_t yv5 = domain.yd(n5) ;
+   Real_t yv6 = domain.yd(n6) ;
+   Real_t yv7 = domain.yd(n7) ;
+
+   Real_t zv0 = domain.zd(n0) ;
+   Real_t zv1 = domain.zd(n1) ;
+   Real_t zv2 = domain.zd(n2) ;
+   Real_t zv3 = domain.zd(n3) ;
+   Real_t zv4 = domain.zd(n4) ;
+   Real_t zv5 = domain.zd(n5) ;
+   Real_t zv6 = domain.zd(n6) ;
+   Real_t zv7 = domain.zd(n7) ;
+
+   Real_t vol = domain.volo(i)*domain.vnew(i) ;
+   Real_t norm = Real_t(1.0) / ( vol + ptiny ) ;
+
+   Real_t dxj = Real_t(-0.25)*((x0+x1+x5+x4) - (x3+x2+x6+x7)) ;
+   Real_t dyj = Real_t(-0.25)*((y0+y1+y5+y4) - (y3+y2+y6+y7)) ;
+   Real_t dzj = Real_t(-0.25)*((z0+z1+z5+z4) - (z3+z2+z6+z7)) ;
+
+   Real_t dxi = Real_t( 0.25)*((x1+x2+x6+x5) - (x0+x3+x7+x4)) ;
+   Real_t dyi = Real_t( 0.25)*((y1+y2+y6+y5) - (y0+y3+y7+y4)) ;
+   Real_t dzi = Real_t( 0.25)*((z1+z2+z6+z5) - (z0+z3+z7+z4)) ;
+
+   Real_t dxk = Real_t( 0.25)*((x4+x5+x6+x7) - (x0+x1+x2+x3)) ;
+   Real_t dyk = Real_t( 0.25)*((y4+y5+y6+y7) - (y0+y1+y2+y3)) ;
+   Real_t dzk = Real_t( 0.25)*((z4+z5+z6+z7) - (z0+z1+z2+z3)) ;
+
+   /* find delvk and delxk ( i cross j ) */
+
+   ax = dyi*dzj - dzi*dyj ;
+   ay = dzi*dxj - dxi*dzj ;
+   az = dxi*dyj - dyi*dxj ;
+
+   delx[2] = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
+
+   ax *= norm ;
+   ay *= norm ;
+   az *= norm ;
+
+   dxv = Real_t(0.25)*((xv4+xv5+xv6+xv7) - (xv0+xv1+xv2+xv3)) ;
+   dyv = Real_t(0.25)*((yv4+yv5+yv6+yv7) - (yv0+yv1+yv2+yv3)) ;
+   dzv = Real_t(0.25)*((zv4+zv5+zv6+zv7) - (zv0+zv1+zv2+zv3)) ;
+
+   delv[2] = ax*dxv + ay*dyv + az*dzv ;
+
+   /* find delxi and delvi ( j cross k ) */
+
+   ax = dyj*dzk - dzj*dyk ;
+   ay = dzj*dxk - dxj*dzk ;
+   az = dxj*dyk - dyj*dxk ;
+
+   delx[0] = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
+
+   ax *= norm ;
+   ay *= norm ;
+   az *= norm ;
+
+   dxv = Real_t(0.25)*((xv1+xv2+xv6+xv5) - (xv0+xv3+xv7+xv4)) ;
+   dyv = Real_t(0.25)*((yv1+yv2+yv6+yv5) - (yv0+yv3+yv7+yv4)) ;
+   dzv = Real_t(0.25)*((zv1+zv2+zv6+zv5) - (zv0+zv3+zv7+zv4)) ;
+
+   delv[0] = ax*dxv + ay*dyv + az*dzv ;
+
+   /* find delxj and delvj ( k cross i ) */
+
+   ax = dyk*dzi - dzk*dyi ;
+   ay = dzk*dxi - dxk*dzi ;
+   az = dxk*dyi - dyk*dxi ;
+
+   delx[1] = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
+
+   ax *= norm ;
+   ay *= norm ;
+   az *= norm ;
+
+   dxv = Real_t(-0.25)*((xv0+xv1+xv5+xv4) - (xv3+xv2+xv6+xv7)) ;
+   dyv = Real_t(-0.25)*((yv0+yv1+yv5+yv4) - (yv3+yv2+yv6+yv7)) ;
+   dzv = Real_t(-0.25)*((zv0+zv1+zv5+zv4) - (zv3+zv2+zv6+zv7)) ;
+
+   delv[1] = ax*dxv + ay*dyv + az*dzv ;
+}
+
+/******************************************/
+
+template <typename Mesh>
+static inline
+void CalcMonotonicQGradientsForElems(Domain& domain, const Mesh &mesh)
 {
    Index_t numElem = domain.numElem();
 
-#pragma omp parallel for firstprivate(numElem)
-   for (Index_t i = 0 ; i < numElem ; ++i ) {
-      const Real_t ptiny = Real_t(1.e-36) ;
-      Real_t ax,ay,az ;
-      Real_t dxv,dyv,dzv ;
-
-      const Index_t *elemToNode = domain.nodelist(i);
-      Index_t n0 = elemToNode[0] ;
-      Index_t n1 = elemToNode[1] ;
-      Index_t n2 = elemToNode[2] ;
-      Index_t n3 = elemToNode[3] ;
-      Index_t n4 = elemToNode[4] ;
-      Index_t n5 = elemToNode[5] ;
-      Index_t n6 = elemToNode[6] ;
-      Index_t n7 = elemToNode[7] ;
-
-      Real_t x0 = domain.x(n0) ;
-      Real_t x1 = domain.x(n1) ;
-      Real_t x2 = domain.x(n2) ;
-      Real_t x3 = domain.x(n3) ;
-      Real_t x4 = domain.x(n4) ;
-      Real_t x5 = domain.x(n5) ;
-      Real_t x6 = domain.x(n6) ;
-      Real_t x7 = domain.x(n7) ;
-
-      Real_t y0 = domain.y(n0) ;
-      Real_t y1 = domain.y(n1) ;
-      Real_t y2 = domain.y(n2) ;
-      Real_t y3 = domain.y(n3) ;
-      Real_t y4 = domain.y(n4) ;
-      Real_t y5 = domain.y(n5) ;
-      Real_t y6 = domain.y(n6) ;
-      Real_t y7 = domain.y(n7) ;
-
-      Real_t z0 = domain.z(n0) ;
-      Real_t z1 = domain.z(n1) ;
-      Real_t z2 = domain.z(n2) ;
-      Real_t z3 = domain.z(n3) ;
-      Real_t z4 = domain.z(n4) ;
-      Real_t z5 = domain.z(n5) ;
-      Real_t z6 = domain.z(n6) ;
-      Real_t z7 = domain.z(n7) ;
-
-      Real_t xv0 = domain.xd(n0) ;
-      Real_t xv1 = domain.xd(n1) ;
-      Real_t xv2 = domain.xd(n2) ;
-      Real_t xv3 = domain.xd(n3) ;
-      Real_t xv4 = domain.xd(n4) ;
-      Real_t xv5 = domain.xd(n5) ;
-      Real_t xv6 = domain.xd(n6) ;
-      Real_t xv7 = domain.xd(n7) ;
-
-      Real_t yv0 = domain.yd(n0) ;
-      Real_t yv1 = domain.yd(n1) ;
-      Real_t yv2 = domain.yd(n2) ;
-      Real_t yv3 = domain.yd(n3) ;
-      Real_t yv4 = domain.yd(n4) ;
-      Real_t yv5 = domain.yd(n5) ;
-      Real_t yv6 = domain.yd(n6) ;
-      Real_t yv7 = domain.yd(n7) ;
-
-      Real_t zv0 = domain.zd(n0) ;
-      Real_t zv1 = domain.zd(n1) ;
-      Real_t zv2 = domain.zd(n2) ;
-      Real_t zv3 = domain.zd(n3) ;
-      Real_t zv4 = domain.zd(n4) ;
-      Real_t zv5 = domain.zd(n5) ;
-      Real_t zv6 = domain.zd(n6) ;
-      Real_t zv7 = domain.zd(n7) ;
-
-      Real_t vol = domain.volo(i)*domain.vnew(i) ;
-      Real_t norm = Real_t(1.0) / ( vol + ptiny ) ;
-
-      Real_t dxj = Real_t(-0.25)*((x0+x1+x5+x4) - (x3+x2+x6+x7)) ;
-      Real_t dyj = Real_t(-0.25)*((y0+y1+y5+y4) - (y3+y2+y6+y7)) ;
-      Real_t dzj = Real_t(-0.25)*((z0+z1+z5+z4) - (z3+z2+z6+z7)) ;
-
-      Real_t dxi = Real_t( 0.25)*((x1+x2+x6+x5) - (x0+x3+x7+x4)) ;
-      Real_t dyi = Real_t( 0.25)*((y1+y2+y6+y5) - (y0+y3+y7+y4)) ;
-      Real_t dzi = Real_t( 0.25)*((z1+z2+z6+z5) - (z0+z3+z7+z4)) ;
-
-      Real_t dxk = Real_t( 0.25)*((x4+x5+x6+x7) - (x0+x1+x2+x3)) ;
-      Real_t dyk = Real_t( 0.25)*((y4+y5+y6+y7) - (y0+y1+y2+y3)) ;
-      Real_t dzk = Real_t( 0.25)*((z4+z5+z6+z7) - (z0+z1+z2+z3)) ;
-
-      /* find delvk and delxk ( i cross j ) */
-
-      ax = dyi*dzj - dzi*dyj ;
-      ay = dzi*dxj - dxi*dzj ;
-      az = dxi*dyj - dyi*dxj ;
-
-      domain.delx_zeta(i) = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
-
-      ax *= norm ;
-      ay *= norm ;
-      az *= norm ;
-
-      dxv = Real_t(0.25)*((xv4+xv5+xv6+xv7) - (xv0+xv1+xv2+xv3)) ;
-      dyv = Real_t(0.25)*((yv4+yv5+yv6+yv7) - (yv0+yv1+yv2+yv3)) ;
-      dzv = Real_t(0.25)*((zv4+zv5+zv6+zv7) - (zv0+zv1+zv2+zv3)) ;
-
-      domain.delv_zeta(i) = ax*dxv + ay*dyv + az*dzv ;
-
-      /* find delxi and delvi ( j cross k ) */
-
-      ax = dyj*dzk - dzj*dyk ;
-      ay = dzj*dxk - dxj*dzk ;
-      az = dxj*dyk - dyj*dxk ;
-
-      domain.delx_xi(i) = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
-
-      ax *= norm ;
-      ay *= norm ;
-      az *= norm ;
-
-      dxv = Real_t(0.25)*((xv1+xv2+xv6+xv5) - (xv0+xv3+xv7+xv4)) ;
-      dyv = Real_t(0.25)*((yv1+yv2+yv6+yv5) - (yv0+yv3+yv7+yv4)) ;
-      dzv = Real_t(0.25)*((zv1+zv2+zv6+zv5) - (zv0+zv3+zv7+zv4)) ;
-
-      domain.delv_xi(i) = ax*dxv + ay*dyv + az*dzv ;
-
-      /* find delxj and delvj ( k cross i ) */
-
-      ax = dyk*dzi - dzk*dyi ;
-      ay = dzk*dxi - dxk*dzi ;
-      az = dxk*dyi - dyk*dxi ;
-
-      domain.delx_eta(i) = vol / SQRT(ax*ax + ay*ay + az*az + ptiny) ;
+   Index_t numPencil = mesh.numPencils() ;
 
-      ax *= norm ;
-      ay *= norm ;
-      az *= norm ;
+   OMP_FOR(OMP_FIRSTPRIVATE(numPencil))
+   for (Index_t p = 0 ; p < numPencil ; ++p )
+   for (Index_t i = mesh.pencilBegin(p) ; i < mesh.pencilEnd(p) ; ++i ) {
+      Index_t nodes[8] ;
+      Real_t delx[3], delv[3] ;
 
-      dxv = Real_t(-0.25)*((xv0+xv1+xv5+xv4) - (xv3+xv2+xv6+xv7)) ;
-      dyv = Real_t(-0.25)*((yv0+yv1+yv5+yv4) - (yv3+yv2+yv6+yv7)) ;
-      dzv = Real_t(-0.25)*((zv0+zv1+zv5+zv4) - (zv3+zv2+zv6+zv7)) ;
+      CalcElemMonoQGradients(domain, i, mesh.elemNodes(p, i, nodes),
+                             delx, delv) ;
 
-      domain.delv_eta(i) = ax*dxv + ay*dyv + az*dzv ;
+      domain.delx_xi(i)   = delx[0] ;
+      domain.delx_eta(i)  = delx[1] ;
+      domain.delx_zeta(i) = delx[2] ;
+      domain.delv_xi(i)   = delv[0] ;
+      domain.delv_eta(i)  = delv[1] ;
+      domain.delv_zeta(i) = delv[2] ;
    }
+
+   // Coordinates and velocities in per node, volo and vnew in and six
+   // gradients out per element.  Differences 72, three directions 49
+   // each, volume and norm 3.
+   TimerAddWork(INDEX_BYTES(8*numElem) + REAL_BYTES(8*numElem) +
+                REAL_BYTES(6*domain.numNode()), 222.0*numElem) ;
 }
 
 /******************************************/
 
+/* Limiter of one direction from the element's own velocity gradient
+ * and the gradients seen across its minus and plus faces */
 static inline
-void CalcMonotonicQRegionForElems(Domain &domain, Int_t r,
-                                  Real_t ptiny)
+Real_t CalcMonoQPhi(Real_t delv, Real_t delvm, Real_t delvp, Real_t ptiny,
+                    Real_t monoq_limiter_mult, Real_t monoq_max_slope)
 {
-   Real_t monoq_limiter_mult = domain.monoq_limiter_mult();
-   Real_t monoq_max_slope = domain.monoq_max_slope();
-   Real_t qlc_monoq = domain.qlc_monoq();
-   Real_t qqc_monoq = domain.qqc_monoq();
+   Real_t norm = Real_t(1.) / ( delv + ptiny ) ;
 
-#pragma omp parallel for firstprivate(qlc_monoq, qqc_monoq, monoq_limiter_mult, monoq_max_slope, ptiny)
-   for ( Index_t i = 0 ; i < domain.regElemSize(r); ++i ) {
-      Index_t ielem = domain.regElemlist(r,i);
-      Real_t qlin, qquad ;
-      Real_t phixi, phieta, phizeta ;
-      Int_t bcMask = domain.elemBC(ielem) ;
-      Real_t delvm = 0.0, delvp =0.0;
-
-      /*  phixi     */
-      Real_t norm = Real_t(1.) / (domain.delv_xi(ielem)+ ptiny ) ;
-
-      switch (bcMask & XI_M) {
-         case XI_M_COMM: /* needs comm data */
-         case 0:         delvm = domain.delv_xi(domain.lxim(ielem)); break ;
-         case XI_M_SYMM: delvm = domain.delv_xi(ielem) ;       break ;
-         case XI_M_FREE: delvm = Real_t(0.0) ;      break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvm = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-      switch (bcMask & XI_P) {
-         case XI_P_COMM: /* needs comm data */
-         case 0:         delvp = domain.delv_xi(domain.lxip(ielem)) ; break ;
-         case XI_P_SYMM: delvp = domain.delv_xi(ielem) ;       break ;
-         case XI_P_FREE: delvp = Real_t(0.0) ;      break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvp = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-
-      delvm = delvm * norm ;
-      delvp = delvp * norm ;
-
-      phixi = Real_t(.5) * ( delvm + delvp ) ;
-
-      delvm *= monoq_limiter_mult ;
-      delvp *= monoq_limiter_mult ;
-
-      if ( delvm < phixi ) phixi = delvm ;
-      if ( delvp < phixi ) phixi = delvp ;
-      if ( phixi < Real_t(0.)) phixi = Real_t(0.) ;
-      if ( phixi > monoq_max_slope) phixi = monoq_max_slope;
-
-
-      /*  phieta     */
-      norm = Real_t(1.) / ( domain.delv_eta(ielem) + ptiny ) ;
-
-      switch (bcMask & ETA_M) {
-         case ETA_M_COMM: /* needs comm data */
-         case 0:          delvm = domain.delv_eta(domain.letam(ielem)) ; break ;
-         case ETA_M_SYMM: delvm = domain.delv_eta(ielem) ;        break ;
-         case ETA_M_FREE: delvm = Real_t(0.0) ;        break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvm = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-      switch (bcMask & ETA_P) {
-         case ETA_P_COMM: /* needs comm data */
-         case 0:          delvp = domain.delv_eta(domain.letap(ielem)) ; break ;
-         case ETA_P_SYMM: delvp = domain.delv_eta(ielem) ;        break ;
-         case ETA_P_FREE: delvp = Real_t(0.0) ;        break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvp = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-
-      delvm = delvm * norm ;
-      delvp = delvp * norm ;
-
-      phieta = Real_t(.5) * ( delvm + delvp ) ;
-
-      delvm *= monoq_limiter_mult ;
-      delvp *= monoq_limiter_mult ;
-
-      if ( delvm  < phieta ) phieta = delvm ;
-      if ( delvp  < phieta ) phieta = delvp ;
-      if ( phieta < Real_t(0.)) phieta = Real_t(0.) ;
-      if ( phieta > monoq_max_slope)  phieta = monoq_max_slope;
-
-      /*  phizeta     */
-      norm = Real_t(1.) / ( domain.delv_zeta(ielem) + ptiny ) ;
-
-      switch (bcMask & ZETA_M) {
-         case ZETA_M_COMM: /* needs comm data */
-         case 0:           delvm = domain.delv_zeta(domain.lzetam(ielem)) ; break ;
-         case ZETA_M_SYMM: delvm = domain.delv_zeta(ielem) ;         break ;
-         case ZETA_M_FREE: delvm = Real_t(0.0) ;          break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvm = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-      switch (bcMask & ZETA_P) {
-         case ZETA_P_COMM: /* needs comm data */
-         case 0:           delvp = domain.delv_zeta(domain.lzetap(ielem)) ; break ;
-         case ZETA_P_SYMM: delvp = domain.delv_zeta(ielem) ;         break ;
-         case ZETA_P_FREE: delvp = Real_t(0.0) ;          break ;
-         default:          fprintf(stderr, "Error in switch at %s line %d\n",
-                                   __FILE__, __LINE__);
-            delvp = 0; /* ERROR - but quiets the compiler */
-            break;
-      }
-
-      delvm = delvm * norm ;
-      delvp = delvp * norm ;
-
-      phizeta = Real_t(.5) * ( delvm + delvp ) ;
-
-      delvm *= monoq_limiter_mult ;
-      delvp *= monoq_limiter_mult ;
-
-      if ( delvm   < phizeta ) phizeta = delvm ;
-      if ( delvp   < phizeta ) phizeta = delvp ;
-      if ( phizeta < Real_t(0.)) phizeta = Real_t(0.);
-      if ( phizeta > monoq_max_slope  ) phizeta = monoq_max_slope;
+   delvm = delvm * norm ;
+   delvp = delvp * norm ;
 
-      /* Remove length scale */
-
-      if ( domain.vdov(ielem) > Real_t(0.) )  {
-         qlin  = Real_t(0.) ;
-         qquad = Real_t(0.) ;
-      }
-      else {
-         Real_t delvxxi   = domain.delv_xi(ielem)   * domain.delx_xi(ielem)   ;
-         Real_t delvxeta  = domain.delv_eta(ielem)  * domain.delx_eta(ielem)  ;
-         Real_t delvxzeta = domain.delv_zeta(ielem) * domain.delx_zeta(ielem) ;
+   Real_t phi = Real_t(.5) * ( delvm + delvp ) ;
+
+   delvm *= monoq_limiter_mult ;
+   delvp *= monoq_limiter_mult ;
 
-         if ( delvxxi   > Real_t(0.) ) delvxxi   = Real_t(0.) ;
-         if ( delvxeta  > Real_t(0.) ) delvxeta  = Real_t(0.) ;
-         if ( delvxzeta > Real_t(0.) ) delvxzeta = Real_t(0.) ;
+   if ( delvm < phi ) phi = delvm ;
+   if ( delvp < phi ) phi = delvp ;
+   if ( phi < Real_t(0.)) phi = Real_t(0.) ;
+   if ( phi > monoq_max_slope) phi = monoq_max_slope;
 
-         Real_t rho = domain.elemMass(ielem) / (domain.volo(ielem) * domain.vnew(ielem)) ;
+   return phi ;
+}
 
-         qlin = -qlc_monoq * rho *
-            (  delvxxi   * (Real_t(1.) - phixi) +
-               delvxeta  * (Real_t(1.) - phieta) +
-               delvxzeta * (Real_t(1.) - phizeta)  ) ;
+/******************************************/
 
-         qquad = qqc_monoq * rho *
-            (  delvxxi*delvxxi     * (Real_t(1.) - phixi*phixi) +
-               delvxeta*delvxeta   * (Real_t(1.) - phieta*phieta) +
-               delvxzeta*delvxzeta * (Real_t(1.) - phizeta*phizeta)  ) ;
-      }
+/* Linear and quadratic q of one element from its gradients (xi, eta,
+ * zeta order) and the gradients across its faces.  The q of the last
+ * cycle is checked against qstop on the way */
+static inline
+void CalcElemMonotonicQ(Domain &domain, Index_t ielem,
+                        const Real_t delv[3], const Real_t delvm[3],
+                        const Real_t delvp[3], const Real_t delx[3],
+                        Real_t ptiny, Real_t monoq_limiter_mult,
+                        Real_t monoq_max_slope, Real_t qlc_monoq,
+                        Real_t qqc_monoq, Real_t qstop, ElemError& err)
+{
+   Real_t qlin, qquad ;
+
+   Real_t phixi   = CalcMonoQPhi(delv[0], delvm[0], delvp[0], ptiny,
+                                 monoq_limiter_mult, monoq_max_slope) ;
+   Real_t phieta  = CalcMonoQPhi(delv[1], delvm[1], delvp[1], ptiny,
+                                 monoq_limiter_mult, monoq_max_slope) ;
+   Real_t phizeta = CalcMonoQPhi(delv[2], delvm[2], delvp[2], ptiny,
+                                 monoq_limiter_mult, monoq_max_slope) ;
+
+   /* Remove length scale.  Both terms are always evaluated and then
+    * dropped for expanding elements, so the loop has no branches */
+
+   Real_t delvxxi   = delv[0] * delx[0] ;
+   Real_t delvxeta  = delv[1] * delx[1] ;
+   Real_t delvxzeta = delv[2] * delx[2] ;
+
+   if ( delvxxi   > Real_t(0.) ) delvxxi   = Real_t(0.) ;
+   if ( delvxeta  > Real_t(0.) ) delvxeta  = Real_t(0.) ;
+   if ( delvxzeta > Real_t(0.) ) delvxzeta = Real_t(0.) ;
+
+   Real_t rho = domain.elemMass(ielem) / (domain.volo(ielem) * domain.vnew(ielem)) ;
+
+   qlin = -qlc_monoq * rho *
+      (  delvxxi   * (Real_t(1.) - phixi) +
+         delvxeta  * (Real_t(1.) - phieta) +
+         delvxzeta * (Real_t(1.) - phizeta)  ) ;
+
+   qquad = qqc_monoq * rho *
+      (  delvxxi*delvxxi     * (Real_t(1.) - phixi*phixi) +
+         delvxeta*delvxeta   * (Real_t(1.) - phieta*phieta) +
+         delvxzeta*delvxzeta * (Real_t(1.) - phizeta*phizeta)  ) ;
+
+   if ( domain.vdov(ielem) > Real_t(0.) )  {
+      qlin  = Real_t(0.) ;
+      qquad = Real_t(0.) ;
+   }
+
+   domain.qq(ielem) = qquad ;
+   domain.ql(ielem) = qlin  ;
+
+   /* Don't allow excessive artificial viscosity */
+   if ( domain.q(ielem) > qstop ) {
+      FlagElemError(err, QStopError, ielem) ;
+   }
+}
+
+/******************************************/
 
-      domain.qq(ielem) = qquad ;
-      domain.ql(ielem) = qlin  ;
+template <typename IndexSet>
+static inline
+void CalcMonotonicQRegionForElems(Domain &domain, Int_t r,
+                                  IndexSet regElemList, Real_t ptiny,
+                                  ElemError& err)
+{
+   Real_t monoq_limiter_mult = domain.monoq_limiter_mult();
+   Real_t monoq_max_slope = domain.monoq_max_slope();
+   Real_t qlc_monoq = domain.qlc_monoq();
+   Real_t qqc_monoq = domain.qqc_monoq();
+   Real_t qstop = domain.qstop() ;
+   Index_t numElemReg = domain.regElemSize(r) ;
+
+   // Boundary conditions are folded into delvNbr, so the body is
+   // straight-line gathers and arithmetic.  err is shared by the team
+   OMP_FOR(simd OMP_FIRSTPRIVATE(qlc_monoq, qqc_monoq, monoq_limiter_mult,
+                                 monoq_max_slope, ptiny, qstop, numElemReg)
+           reduction(elemError : err))
+   for ( Index_t i = 0 ; i < numElemReg ; ++i ) {
+      Index_t ielem = regElemList[i];
+      const Index_t *nbr = domain.delvNbr(ielem) ;
+
+      const Real_t delv[3]  = { domain.delv_xi(ielem),
+                                domain.delv_eta(ielem),
+                                domain.delv_zeta(ielem) } ;
+      const Real_t delvm[3] = { domain.delv_xi(nbr[0]),
+                                domain.delv_eta(nbr[2]),
+                                domain.delv_zeta(nbr[4]) } ;
+      const Real_t delvp[3] = { domain.delv_xi(nbr[1]),
+                                domain.delv_eta(nbr[3]),
+                                domain.delv_zeta(nbr[5]) } ;
+      const Real_t delx[3]  = { domain.delx_xi(ielem),
+                                domain.delx_eta(ielem),
+                                domain.delx_zeta(ielem) } ;
+
+      CalcElemMonotonicQ(domain, ielem, delv, delvm, delvp, delx, ptiny,
+                         monoq_limiter_mult, monoq_max_slope,
+                         qlc_monoq, qqc_monoq, qstop, err) ;
    }
 }
 
 /******************************************/
 
 static inline
-void CalcMonotonicQForElems(Domain& domain)
+void CalcMonotonicQForElems(Domain& domain, ElemError& err)
 {  
    //
    // initialize parameters
@@ -1935,144 +2112,567 @@ void CalcMonotonicQForElems(Domain& domain)
    //
    for (Index_t r=0 ; r<domain.numReg() ; ++r) {
       if (domain.regElemSize(r) > 0) {
-         CalcMonotonicQRegionForElems(domain, r, ptiny) ;
+         if (domain.regionSorted()) {
+            CalcMonotonicQRegionForElems(domain, r,
+                                         ElemRange(domain.regElemlist(r,0)),
+                                         ptiny, err) ;
+         }
+         else {
+            CalcMonotonicQRegionForElems(domain, r,
+                                         ElemList(domain.regElemlist(r)),
+                                         ptiny, err) ;
+         }
       }
    }
+
+   // Region list and six gradient slots, the three gradients and
+   // lengths, vdov, mass, volo, vnew and q in, qq and ql out.
+   // Limiters 8 per direction, q terms 31.
+   Index_t numElem = domain.numElem() ;
+   TimerAddWork(INDEX_BYTES(7*numElem) + REAL_BYTES(13*numElem), 55.0*numElem) ;
 }
 
 /******************************************/
 
+/* Lattice planes of the local box stream through a small per-thread
+ * ring of gradient planes, so the gradients are only materialized in
+ * Domain for the boundary layer that is exchanged with other ranks.
+ * A thread needs a few planes of its own for the redundant halo plane
+ * at the start of its slab to pay off. */
+#define MONOQ_STREAM_MIN_PLANES 4
+
 static inline
-void CalcQForElems(Domain& domain)
+bool UseMonoQStream(Domain& domain)
 {
-   //
-   // MONOTONIC Q option
-   //
-
-   Index_t numElem = domain.numElem() ;
-
-   if (numElem != 0) {
-      Int_t allElem = numElem +  /* local elem */
-            2*domain.sizeX()*domain.sizeY() + /* plane ghosts */
-            2*domain.sizeX()*domain.sizeZ() + /* row ghosts */
-            2*domain.sizeY()*domain.sizeZ() ; /* col ghosts */
-
-      domain.AllocateGradients(numElem, allElem);
-
-#if USE_MPI      
-      CommRecv(domain, MSG_MONOQ, 3,
-               domain.sizeX(), domain.sizeY(), domain.sizeZ(),
-               true, true) ;
-#endif      
-
-      /* Calculate velocity gradients */
-      CalcMonotonicQGradientsForElems(domain);
-
-#if USE_MPI      
-      Domain_member fieldData[3] ;
-      
-      /* Transfer veloctiy gradients in the first order elements */
-      /* problem->commElements->Transfer(CommElements::monoQ) ; */
-
-      fieldData[0] = &Domain::delv_xi ;
-      fieldData[1] = &Domain::delv_eta ;
-      fieldData[2] = &Domain::delv_zeta ;
-
-      CommSend(domain, MSG_MONOQ, 3, fieldData,
-               domain.sizeX(), domain.sizeY(), domain.sizeZ(),
-               true, true) ;
-
-      CommMonoQ(domain) ;
-#endif      
-
-      CalcMonotonicQForElems(domain);
-
-      // Free up memory
-      domain.DeallocateGradients();
-
-      /* Don't allow excessive artificial viscosity */
-      Index_t idx = -1; 
-      for (Index_t i=0; i<numElem; ++i) {
-         if ( domain.q(i) > domain.qstop() ) {
-            idx = i ;
-            break ;
-         }
-      }
-
-      if(idx >= 0) {
-#if USE_MPI         
-         MPI_Abort(MPI_COMM_WORLD, QStopError) ;
+#if _OPENMP
+   Index_t threads = omp_get_max_threads() ;
 #else
-         exit(QStopError);
+   Index_t threads = 1 ;
 #endif
-      }
-   }
+   // A file mesh has no planes to stream through
+   return !domain.unstructured() &&
+          (domain.sizeZ() >= MONOQ_STREAM_MIN_PLANES*threads) ;
 }
 
 /******************************************/
 
+/* Gradient seen across a face of the local box: the element's own for
+ * a symmetry plane, zero for a free surface, otherwise its ghost slot */
 static inline
-void CalcPressureForElems(Real_t* p_new, Real_t* bvc,
-                          Real_t* pbvc, Real_t* e_old,
-                          Real_t* compression, Real_t *vnewc,
-                          Real_t pmin,
-                          Real_t p_cut, Real_t eosvmax,
-                          Index_t length, Index_t *regElemList)
+Real_t MonoQFaceValue(Domain& domain, Domain_member field, Int_t faceBC,
+                      Int_t symmBC, Int_t freeBC, Real_t own, Index_t slot)
 {
-#pragma omp parallel for firstprivate(length)
-   for (Index_t i = 0; i < length ; ++i) {
-      Real_t c1s = Real_t(2.0)/Real_t(3.0) ;
-      bvc[i] = c1s * (compression[i] + Real_t(1.));
-      pbvc[i] = c1s;
+   if (faceBC == symmBC) {
+      return own ;
    }
-
-#pragma omp parallel for firstprivate(length, pmin, p_cut, eosvmax)
-   for (Index_t i = 0 ; i < length ; ++i){
-      Index_t ielem = regElemList[i];
-      
-      p_new[i] = bvc[i] * e_old[i] ;
-
-      if    (FABS(p_new[i]) <  p_cut   )
-         p_new[i] = Real_t(0.0) ;
-
-      if    ( vnewc[ielem] >= eosvmax ) /* impossible condition here? */
-         p_new[i] = Real_t(0.0) ;
-
-      if    (p_new[i]       <  pmin)
-         p_new[i]   = pmin ;
+   else if (faceBC == freeBC) {
+      return Real_t(0.0) ;
    }
+   return (domain.*field)(slot) ;
 }
 
 /******************************************/
 
+#if USE_MPI
+/* Velocity gradients of the elements on the faces that are sent to
+ * the neighboring ranks */
 static inline
-void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
-                        Real_t* bvc, Real_t* pbvc,
-                        Real_t* p_old, Real_t* e_old, Real_t* q_old,
-                        Real_t* compression, Real_t* compHalfStep,
-                        Real_t* vnewc, Real_t* work, Real_t* delvc, Real_t pmin,
-                        Real_t p_cut, Real_t  e_cut, Real_t q_cut, Real_t emin,
-                        Real_t* qq_old, Real_t* ql_old,
-                        Real_t rho0,
-                        Real_t eosvmax,
-                        Index_t length, Index_t *regElemList)
+void CalcMonotonicQGradientsForFaces(Domain& domain)
 {
-   Real_t *pHalfStep = Allocate<Real_t>(length) ;
-
-#pragma omp parallel for firstprivate(length, emin)
-   for (Index_t i = 0 ; i < length ; ++i) {
-      e_new[i] = e_old[i] - Real_t(0.5) * delvc[i] * (p_old[i] + q_old[i])
-         + Real_t(0.5) * work[i];
-
-      if (e_new[i]  < emin ) {
-         e_new[i] = emin ;
+   Index_t nx = domain.sizeX() ;
+   Index_t ny = domain.sizeY() ;
+   Index_t nz = domain.sizeZ() ;
+   Int_t bcMin = domain.elemBC(domain.spatialElem(0)) ;
+   Int_t bcMax = domain.elemBC(domain.spatialElem(nx*ny*nz - 1)) ;
+   Index_t numFaceElem = 0 ;
+
+   // Plane, row and column faces: lattice stride of the two in-face
+   // directions and of the normal, and whether each end is exchanged
+   const Index_t size[3][2] = { { nx, ny }, { nx, nz }, { ny, nz } } ;
+   const Index_t stride[3][3] = { { 1, nx, nx*ny },
+                                  { 1, nx*ny, nx },
+                                  { nx, nx*ny, 1 } } ;
+   const Index_t extent[3] = { nz, ny, nx } ;
+   const bool comm[3][2] = {
+      { (bcMin & ZETA_M) == ZETA_M_COMM, (bcMax & ZETA_P) == ZETA_P_COMM },
+      { (bcMin & ETA_M)  == ETA_M_COMM,  (bcMax & ETA_P)  == ETA_P_COMM },
+      { (bcMin & XI_M)   == XI_M_COMM,   (bcMax & XI_P)   == XI_P_COMM }
+   } ;
+
+   for (Int_t f=0 ; f<3 ; ++f) {
+      for (Int_t side=0 ; side<2 ; ++side) {
+         if (!comm[f][side]) {
+            continue ;
+         }
+         Index_t base = side*(extent[f] - 1)*stride[f][2] ;
+         Index_t na = size[f][0] ;
+         Index_t nb = size[f][1] ;
+         OMP_FOR(OMP_FIRSTPRIVATE(base, na, nb))
+         for (Index_t b=0 ; b<nb ; ++b) {
+            for (Index_t a=0 ; a<na ; ++a) {
+               Index_t ielem = domain.spatialElem(base + b*stride[f][1] +
+                                                  a*stride[f][0]) ;
+               Real_t delx[3], delv[3] ;
+               CalcElemMonoQGradients(domain, ielem, domain.nodelist(ielem),
+                                      delx, delv) ;
+               domain.delv_xi(ielem)   = delv[0] ;
+               domain.delv_eta(ielem)  = delv[1] ;
+               domain.delv_zeta(ielem) = delv[2] ;
+            }
+         }
+         numFaceElem += na*nb ;
       }
    }
 
-   CalcPressureForElems(pHalfStep, bvc, pbvc, e_new, compHalfStep, vnewc,
-                        pmin, p_cut, eosvmax, length, regElemList);
+   TimerAddWork(INDEX_BYTES(8*numFaceElem) + REAL_BYTES(5*numFaceElem) +
+                REAL_BYTES(6*8*numFaceElem), 222.0*numFaceElem) ;
+}
+#endif
+
+/******************************************/
+
+template <typename Mesh>
+static inline
+void CalcMonotonicQStreamForElems(Domain& domain, const Mesh &mesh,
+                                  ElemError& err)
+{
+   const Real_t ptiny = Real_t(1.e-36) ;
+   Real_t monoq_limiter_mult = domain.monoq_limiter_mult();
+   Real_t monoq_max_slope = domain.monoq_max_slope();
+   Real_t qlc_monoq = domain.qlc_monoq();
+   Real_t qqc_monoq = domain.qqc_monoq();
+   Real_t qstop = domain.qstop() ;
+
+   Index_t nx = domain.sizeX() ;
+   Index_t ny = domain.sizeY() ;
+   Index_t nz = domain.sizeZ() ;
+   Index_t hx = nx + 2 ;                  // row length with halo
+   Index_t planeSize = hx*(ny + 2) ;
+   Int_t bcMin = domain.elemBC(domain.spatialElem(0)) ;
+   Int_t bcMax = domain.elemBC(domain.spatialElem(nx*ny*nz - 1)) ;
+   Index_t ringSize = 3*6*planeSize ;
+   Real_t *rings ;
+
+   // One ring per thread, carved from a single block so that only one
+   // thread ever touches the scratch pool
+#pragma omp single copyprivate(rings)
+   {
+#if _OPENMP
+      Index_t slots = omp_in_parallel() ? omp_get_num_threads() :
+                                          omp_get_max_threads() ;
+#else
+      Index_t slots = 1 ;
+#endif
+      rings = Allocate<Real_t>(slots*ringSize) ;
+   }
+
+   OMP_PARALLEL(firstprivate(nx, ny, nz, hx, planeSize, bcMin, bcMax, ringSize))
+   {
+      ElemError streamErr = { 0, -1 } ;
+#if _OPENMP
+      Index_t threads = omp_get_num_threads() ;
+      Index_t t = omp_get_thread_num() ;
+#else
+      Index_t threads = 1 ;
+      Index_t t = 0 ;
+#endif
+      // Each thread limits a slab of planes and recomputes the planes
+      // on either side of it rather than waiting for its neighbors
+      Index_t kBegin = (nz*t)/threads ;
+      Index_t kEnd   = (nz*(t + 1))/threads ;
+
+      // Three planes of delv_xi, delv_eta, delv_zeta, delx_xi,
+      // delx_eta, delx_zeta; plane k lives in slot k mod 3
+      Real_t *ring = &rings[t*ringSize] ;
+
+      for (Index_t k=kBegin-1 ; k<=kEnd ; ++k) {
+         if ((k >= 0) && (k < nz)) {
+            Real_t *slot = &ring[(k % 3)*6*planeSize] ;
+            for (Index_t row=0 ; row<ny ; ++row) {
+               for (Index_t col=0 ; col<nx ; ++col) {
+                  Index_t h = (row + 1)*hx + col + 1 ;
+                  Index_t ielem = domain.spatialElem((k*ny + row)*nx + col) ;
+                  Index_t nodes[8] ;
+                  Real_t delx[3], delv[3] ;
+                  CalcElemMonoQGradients(domain, ielem,
+                                         mesh.elemNodes(k*ny + row, ielem, nodes),
+                                         delx, delv) ;
+                  for (Int_t f=0 ; f<3 ; ++f) {
+                     slot[f*planeSize + h]       = delv[f] ;
+                     slot[(3 + f)*planeSize + h] = delx[f] ;
+                  }
+               }
+            }
+
+            // Column halos only feed the xi limiter, row halos the eta one
+            Real_t *vxi  = slot ;
+            Real_t *veta = &slot[planeSize] ;
+            for (Index_t row=0 ; row<ny ; ++row) {
+               Index_t h = (row + 1)*hx + 1 ;
+               Index_t lo = domain.spatialElem((k*ny + row)*nx) ;
+               Index_t hi = domain.spatialElem((k*ny + row)*nx + nx - 1) ;
+               vxi[h - 1] = MonoQFaceValue(domain, &Domain::delv_xi,
+                                           bcMin & XI_M, XI_M_SYMM, XI_M_FREE,
+                                           vxi[h], domain.delvNbr(lo)[0]) ;
+               vxi[h + nx] = MonoQFaceValue(domain, &Domain::delv_xi,
+                                            bcMax & XI_P, XI_P_SYMM, XI_P_FREE,
+                                            vxi[h + nx - 1], domain.delvNbr(hi)[1]) ;
+            }
+            for (Index_t col=0 ; col<nx ; ++col) {
+               Index_t h = hx + col + 1 ;
+               Index_t lo = domain.spatialElem(k*ny*nx + col) ;
+               Index_t hi = domain.spatialElem((k*ny + ny - 1)*nx + col) ;
+               veta[h - hx] = MonoQFaceValue(domain, &Domain::delv_eta,
+                                             bcMin & ETA_M, ETA_M_SYMM, ETA_M_FREE,
+                                             veta[h], domain.delvNbr(lo)[2]) ;
+               veta[h + ny*hx] = MonoQFaceValue(domain, &Domain::delv_eta,
+                                                bcMax & ETA_P, ETA_P_SYMM, ETA_P_FREE,
+                                                veta[h + (ny - 1)*hx], domain.delvNbr(hi)[3]) ;
+            }
+         }
+
+         // Halo planes only feed the zeta limiter.  The one above the
+         // box reuses the slot of plane nz-3, which is no longer needed
+         if ((k == 0) || (k == nz)) {
+            Index_t kIn   = (k == 0) ? 0 : nz - 1 ;
+            Index_t kHalo = (k == 0) ? -1 : nz ;
+            Real_t *in   = &ring[(kIn % 3)*6*planeSize + 2*planeSize] ;
+            Real_t *halo = &ring[((kHalo + 3) % 3)*6*planeSize + 2*planeSize] ;
+            for (Index_t row=0 ; row<ny ; ++row) {
+               for (Index_t col=0 ; col<nx ; ++col) {
+                  Index_t h = (row + 1)*hx + col + 1 ;
+                  Index_t ielem = domain.spatialElem((kIn*ny + row)*nx + col) ;
+                  halo[h] = (k == 0) ?
+                     MonoQFaceValue(domain, &Domain::delv_zeta,
+                                    bcMin & ZETA_M, ZETA_M_SYMM, ZETA_M_FREE,
+                                    in[h], domain.delvNbr(ielem)[4]) :
+                     MonoQFaceValue(domain, &Domain::delv_zeta,
+                                    bcMax & ZETA_P, ZETA_P_SYMM, ZETA_P_FREE,
+                                    in[h], domain.delvNbr(ielem)[5]) ;
+               }
+            }
+         }
+
+         // Plane k-1 now has both of its zeta neighbors
+         Index_t kq = k - 1 ;
+         if (kq >= kBegin) {
+            const Real_t *cur = &ring[(kq % 3)*6*planeSize] ;
+            const Real_t *lo  = &ring[((kq + 2) % 3)*6*planeSize] ;
+            const Real_t *hi  = &ring[((kq + 1) % 3)*6*planeSize] ;
+            for (Index_t row=0 ; row<ny ; ++row) {
+               for (Index_t col=0 ; col<nx ; ++col) {
+                  Index_t h = (row + 1)*hx + col + 1 ;
+                  Index_t ielem = domain.spatialElem((kq*ny + row)*nx + col) ;
+
+                  const Real_t delv[3]  = { cur[h],
+                                            cur[planeSize + h],
+                                            cur[2*planeSize + h] } ;
+                  const Real_t delvm[3] = { cur[h - 1],
+                                            cur[planeSize + h - hx],
+                                            lo[2*planeSize + h] } ;
+                  const Real_t delvp[3] = { cur[h + 1],
+                                            cur[planeSize + h + hx],
+                                            hi[2*planeSize + h] } ;
+                  const Real_t delx[3]  = { cur[3*planeSize + h],
+                                            cur[4*planeSize + h],
+                                            cur[5*planeSize + h] } ;
+
+                  CalcElemMonotonicQ(domain, ielem, delv, delvm, delvp, delx,
+                                     ptiny, monoq_limiter_mult, monoq_max_slope,
+                                     qlc_monoq, qqc_monoq, qstop, streamErr) ;
+               }
+            }
+         }
+      }
+
+#pragma omp critical
+      MergeElemError(err, streamErr) ;
+   }
+#pragma omp barrier
+
+#pragma omp single
+   Release(&rings) ;
+
+   // Gradients as in CalcMonotonicQGradientsForElems without writing
+   // them out, plus the recomputed planes at slab edges; the limiter
+   // reads vdov, mass, volo, vnew and q and writes qq and ql
+   Index_t numElem = domain.numElem() ;
+   TimerAddWork(INDEX_BYTES(8*numElem) + REAL_BYTES(9*numElem) +
+                REAL_BYTES(6*domain.numNode()), (222.0 + 55.0)*numElem) ;
+}
+
+/******************************************/
+
+static inline
+void CalcQForElems(Domain& domain)
+{
+   SCOPED_TIMER(TimerCalcQForElems) ;
+
+   //
+   // MONOTONIC Q option
+   //
+
+   Index_t numElem = domain.numElem() ;
+
+   if (numElem != 0) {
+      bool stream = UseMonoQStream(domain) ;
+      static ElemError err ;
+
+      // The streamed limiter keeps gradients in per-thread planes and
+      // only needs Domain storage for the exchanged boundary layer
+#pragma omp single
+      {
+         ClearElemError(err) ;
+         if (!stream) {
+            domain.AllocateGradients(numElem, domain.allElem());
+         }
+#if USE_MPI      
+         else if (domain.numRanks() > 1) {
+            domain.AllocateVelocityGradients(domain.allElem());
+         }
+#endif      
+      }
+
+#if USE_MPI      
+#pragma omp master
+      CommRecv(domain, MSG_MONOQ, 3,
+               domain.sizeX(), domain.sizeY(), domain.sizeZ(),
+               true, true) ;
+#endif      
+
+      /* Calculate velocity gradients */
+      if (!stream) {
+         if (domain.latticeNodes()) {
+            CalcMonotonicQGradientsForElems(domain, LatticeNodes(domain));
+         }
+         else {
+            CalcMonotonicQGradientsForElems(domain, NodeList(domain));
+         }
+      }
+#if USE_MPI      
+      else if (domain.numRanks() > 1) {
+         CalcMonotonicQGradientsForFaces(domain);
+      }
+
+      Domain_member fieldData[3] ;
+      
+      /* Transfer veloctiy gradients in the first order elements */
+      /* problem->commElements->Transfer(CommElements::monoQ) ; */
+
+      fieldData[0] = &Domain::delv_xi ;
+      fieldData[1] = &Domain::delv_eta ;
+      fieldData[2] = &Domain::delv_zeta ;
+
+#pragma omp master
+      {
+         CommSend(domain, MSG_MONOQ, 3, fieldData,
+                  domain.sizeX(), domain.sizeY(), domain.sizeZ(),
+                  true, true) ;
+
+         CommMonoQ(domain) ;
+      }
+#pragma omp barrier
+#endif      
+
+      if (stream && domain.latticeNodes()) {
+         CalcMonotonicQStreamForElems(domain, LatticeNodes(domain), err);
+      }
+      else if (stream) {
+         CalcMonotonicQStreamForElems(domain, NodeList(domain), err);
+      }
+      else {
+         CalcMonotonicQForElems(domain, err);
+      }
+
+      // Free up memory
+#pragma omp single
+      domain.DeallocateGradients();
+
+      CheckElemError(domain, err, "CalcQForElems") ;
+   }
+}
+
+/******************************************/
+
+/* Elements whose table coordinates are computed together before the
+ * gather; small enough for the scratch to live on the stack */
+#define EOS_LOOKUP_BLOCK 64
+
+static inline
+void CubicWeights(const Real_t *node, const Real_t x, Real_t w[4])
+{
+   // Lagrange basis on the four (non-uniform) nodes around x
+   const Real_t d0 = x - node[0] ;
+   const Real_t d1 = x - node[1] ;
+   const Real_t d2 = x - node[2] ;
+   const Real_t d3 = x - node[3] ;
+   w[0] = d1*d2*d3 / ((node[0]-node[1])*(node[0]-node[2])*(node[0]-node[3])) ;
+   w[1] = d0*d2*d3 / ((node[1]-node[0])*(node[1]-node[2])*(node[1]-node[3])) ;
+   w[2] = d0*d1*d3 / ((node[2]-node[0])*(node[2]-node[1])*(node[2]-node[3])) ;
+   w[3] = d0*d1*d2 / ((node[3]-node[0])*(node[3]-node[1])*(node[3]-node[2])) ;
+}
+
+/******************************************/
+
+static inline
+void LookupEOSTableForElems(const EOSTable *table, Int_t order,
+                            Real_t *p_new, Real_t *c2,
+                            Real_t *e_old, Real_t *compression,
+                            Index_t length)
+{
+   const Int_t   numE       = table->numE ;
+   const Real_t  rhoFloor   = table->rho[0] ;
+   const Real_t  eFloor     = table->e[0] ;
+   const Real_t  logRhoMin  = table->logRhoMin ;
+   const Real_t  logEMin    = table->logEMin ;
+   const Real_t  invDLogRho = table->invDLogRho ;
+   const Real_t  invDLogE   = table->invDLogE ;
+   const Real_t *tRho       = table->rho ;
+   const Real_t *tE         = table->e ;
+   const Real_t *data       = table->data ;
+
+   // A cubic stencil needs one extra node on each side of the cell
+   const Index_t lo    = (order == EOSBicubic) ? 1 : 0 ;
+   const Index_t hiRho = table->numRho - ((order == EOSBicubic) ? 3 : 2) ;
+   const Index_t hiE   = table->numE   - ((order == EOSBicubic) ? 3 : 2) ;
+
+   OMP_FOR(OMP_FIRSTPRIVATE(length, order))
+   for (Index_t ib = 0 ; ib < length ; ib += EOS_LOOKUP_BLOCK) {
+      const Index_t len = std::min(Index_t(EOS_LOOKUP_BLOCK), Index_t(length - ib)) ;
+      Index_t cell[EOS_LOOKUP_BLOCK] ;
+
+      // Cell indices only depend on the logarithms, so this pass is
+      // branch free and vectorizes.  Values outside the table are
+      // extrapolated from the edge cells.
+      for (Index_t k = 0 ; k < len ; ++k) {
+         Real_t rho = std::max(compression[ib+k] + Real_t(1.), rhoFloor) ;
+         Real_t e   = std::max(e_old[ib+k], eFloor) ;
+         Index_t ir = Index_t((log(rho) - logRhoMin) * invDLogRho) ;
+         Index_t ie = Index_t((log(e)   - logEMin)   * invDLogE) ;
+         ir = std::min(std::max(ir, lo), hiRho) ;
+         ie = std::min(std::max(ie, lo), hiE) ;
+         cell[k] = ir*numE + ie ;
+      }
+
+      if (order == EOSBicubic) {
+         for (Index_t k = 0 ; k < len ; ++k) {
+            const Index_t ir = cell[k] / numE ;
+            const Index_t ie = cell[k] - ir*numE ;
+            Real_t wr[4], we[4] ;
+            CubicWeights(&tRho[ir-1], compression[ib+k] + Real_t(1.), wr) ;
+            CubicWeights(&tE[ie-1], e_old[ib+k], we) ;
+
+            const Real_t *node = &data[2*(cell[k] - numE - 1)] ;
+            Real_t p = Real_t(0.) ;
+            Real_t c = Real_t(0.) ;
+            for (Index_t a = 0 ; a < 4 ; ++a) {
+               const Real_t *row = &node[2*a*numE] ;
+               p += wr[a] * (we[0]*row[0] + we[1]*row[2] +
+                             we[2]*row[4] + we[3]*row[6]) ;
+               c += wr[a] * (we[0]*row[1] + we[1]*row[3] +
+                             we[2]*row[5] + we[3]*row[7]) ;
+            }
+            p_new[ib+k] = p ;
+            c2[ib+k] = c ;
+         }
+      }
+      else {
+         for (Index_t k = 0 ; k < len ; ++k) {
+            const Index_t ir = cell[k] / numE ;
+            const Index_t ie = cell[k] - ir*numE ;
+            // weights are linear in rho and e, not in the logs
+            const Real_t tr = (compression[ib+k] + Real_t(1.) - tRho[ir]) /
+                              (tRho[ir+1] - tRho[ir]) ;
+            const Real_t te = (e_old[ib+k] - tE[ie]) / (tE[ie+1] - tE[ie]) ;
+
+            const Real_t *n0 = &data[2*cell[k]] ;
+            const Real_t *n1 = n0 + 2*numE ;
+            p_new[ib+k] = (Real_t(1.)-tr)*((Real_t(1.)-te)*n0[0] + te*n0[2]) +
+                                      tr *((Real_t(1.)-te)*n1[0] + te*n1[2]) ;
+            c2[ib+k]    = (Real_t(1.)-tr)*((Real_t(1.)-te)*n0[1] + te*n0[3]) +
+                                      tr *((Real_t(1.)-te)*n1[1] + te*n1[3]) ;
+         }
+      }
+   }
+}
+
+/******************************************/
+
+template <typename IndexSet>
+static inline
+void CalcPressureForElems(Real_t* p_new, Real_t* bvc,
+                          Real_t* pbvc, Real_t* c2, Real_t* e_old,
+                          Real_t* compression, Real_t *vnewc,
+                          Real_t pmin,
+                          Real_t p_cut, Real_t eosvmax,
+                          Index_t length, IndexSet regElemList,
+                          const EOSTable *table, Int_t order)
+{
+   if (table != NULL) {
+      LookupEOSTableForElems(table, order, p_new, c2,
+                             e_old, compression, length) ;
+   }
+   else {
+      OMP_FOR(OMP_FIRSTPRIVATE(length))
+      for (Index_t i = 0; i < length ; ++i) {
+         Real_t c1s = Real_t(2.0)/Real_t(3.0) ;
+         bvc[i] = c1s * (compression[i] + Real_t(1.));
+         pbvc[i] = c1s;
+         p_new[i] = bvc[i] * e_old[i] ;
+      }
+   }
+
+   OMP_FOR(OMP_FIRSTPRIVATE(length, pmin, p_cut, eosvmax))
+   for (Index_t i = 0 ; i < length ; ++i){
+      Index_t ielem = regElemList[i];
+
+      if    (FABS(p_new[i]) <  p_cut   )
+         p_new[i] = Real_t(0.0) ;
+
+      if    ( vnewc[ielem] >= eosvmax ) /* impossible condition here? */
+         p_new[i] = Real_t(0.0) ;
+
+      if    (p_new[i]       <  pmin)
+         p_new[i]   = pmin ;
+   }
+}
+
+/******************************************/
+
+template <typename IndexSet>
+static inline
+void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
+                        Real_t* bvc, Real_t* pbvc, Real_t* c2,
+                        Real_t* p_old, Real_t* e_old, Real_t* q_old,
+                        Real_t* compression, Real_t* compHalfStep,
+                        Real_t* vnewc, Real_t* work, Real_t* delvc, Real_t pmin,
+                        Real_t p_cut, Real_t  e_cut, Real_t q_cut, Real_t emin,
+                        Real_t* qq_old, Real_t* ql_old,
+                        Real_t rho0,
+                        Real_t eosvmax,
+                        Index_t length, IndexSet regElemList,
+                        const EOSTable *table, Int_t order)
+{
+   Real_t *pHalfStep ;
+
+#pragma omp single copyprivate(pHalfStep)
+   pHalfStep = Allocate<Real_t>(length) ;
+
+   OMP_FOR(OMP_FIRSTPRIVATE(length, emin))
+   for (Index_t i = 0 ; i < length ; ++i) {
+      e_new[i] = e_old[i] - Real_t(0.5) * delvc[i] * (p_old[i] + q_old[i])
+         + Real_t(0.5) * work[i];
 
-#pragma omp parallel for firstprivate(length, rho0)
+      if (e_new[i]  < emin ) {
+         e_new[i] = emin ;
+      }
+   }
+
+   CalcPressureForElems(pHalfStep, bvc, pbvc, c2, e_new, compHalfStep, vnewc,
+                        pmin, p_cut, eosvmax, length, regElemList,
+                        table, order);
+
+   OMP_FOR(OMP_FIRSTPRIVATE(length, rho0))
    for (Index_t i = 0 ; i < length ; ++i) {
       Real_t vhalf = Real_t(1.) / (Real_t(1.) + compHalfStep[i]) ;
 
@@ -2080,7 +2680,8 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
          q_new[i] /* = qq_old[i] = ql_old[i] */ = Real_t(0.) ;
       }
       else {
-         Real_t ssc = ( pbvc[i] * e_new[i]
+         Real_t ssc = (c2 != NULL) ? c2[i] :
+                      ( pbvc[i] * e_new[i]
                  + vhalf * vhalf * bvc[i] * pHalfStep[i] ) / rho0 ;
 
          if ( ssc <= Real_t(.1111111e-36) ) {
@@ -2097,7 +2698,7 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
               - Real_t(4.0)*(pHalfStep[i] + q_new[i])) ;
    }
 
-#pragma omp parallel for firstprivate(length, emin, e_cut)
+   OMP_FOR(OMP_FIRSTPRIVATE(length, emin, e_cut))
    for (Index_t i = 0 ; i < length ; ++i) {
 
       e_new[i] += Real_t(0.5) * work[i];
@@ -2110,10 +2711,11 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
       }
    }
 
-   CalcPressureForElems(p_new, bvc, pbvc, e_new, compression, vnewc,
-                        pmin, p_cut, eosvmax, length, regElemList);
+   CalcPressureForElems(p_new, bvc, pbvc, c2, e_new, compression, vnewc,
+                        pmin, p_cut, eosvmax, length, regElemList,
+                        table, order);
 
-#pragma omp parallel for firstprivate(length, rho0, emin, e_cut)
+   OMP_FOR(OMP_FIRSTPRIVATE(length, rho0, emin, e_cut))
    for (Index_t i = 0 ; i < length ; ++i){
       const Real_t sixth = Real_t(1.0) / Real_t(6.0) ;
       Index_t ielem = regElemList[i];
@@ -2123,7 +2725,8 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
          q_tilde = Real_t(0.) ;
       }
       else {
-         Real_t ssc = ( pbvc[i] * e_new[i]
+         Real_t ssc = (c2 != NULL) ? c2[i] :
+                      ( pbvc[i] * e_new[i]
                  + vnewc[ielem] * vnewc[ielem] * bvc[i] * p_new[i] ) / rho0 ;
 
          if ( ssc <= Real_t(.1111111e-36) ) {
@@ -2147,15 +2750,17 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
       }
    }
 
-   CalcPressureForElems(p_new, bvc, pbvc, e_new, compression, vnewc,
-                        pmin, p_cut, eosvmax, length, regElemList);
+   CalcPressureForElems(p_new, bvc, pbvc, c2, e_new, compression, vnewc,
+                        pmin, p_cut, eosvmax, length, regElemList,
+                        table, order);
 
-#pragma omp parallel for firstprivate(length, rho0, q_cut)
+   OMP_FOR(OMP_FIRSTPRIVATE(length, rho0, q_cut))
    for (Index_t i = 0 ; i < length ; ++i){
       Index_t ielem = regElemList[i];
 
       if ( delvc[i] <= Real_t(0.) ) {
-         Real_t ssc = ( pbvc[i] * e_new[i]
+         Real_t ssc = (c2 != NULL) ? c2[i] :
+                      ( pbvc[i] * e_new[i]
                  + vnewc[ielem] * vnewc[ielem] * bvc[i] * p_new[i] ) / rho0 ;
 
          if ( ssc <= Real_t(.1111111e-36) ) {
@@ -2170,6 +2775,7 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
       }
    }
 
+#pragma omp single
    Release(&pHalfStep) ;
 
    return ;
@@ -2177,17 +2783,19 @@ void CalcEnergyForElems(Real_t* p_new, Real_t* e_new, Real_t* q_new,
 
 /******************************************/
 
+template <typename State, typename IndexSet>
 static inline
-void CalcSoundSpeedForElems(Domain &domain,
+void CalcSoundSpeedForElems(State &state,
                             Real_t *vnewc, Real_t rho0, Real_t *enewc,
                             Real_t *pnewc, Real_t *pbvc,
-                            Real_t *bvc, Real_t ss4o3,
-                            Index_t len, Index_t *regElemList)
+                            Real_t *bvc, Real_t *c2, Real_t ss4o3,
+                            Index_t len, IndexSet regElemList)
 {
-#pragma omp parallel for firstprivate(rho0, ss4o3)
+   OMP_FOR(OMP_FIRSTPRIVATE(rho0, ss4o3))
    for (Index_t i = 0; i < len ; ++i) {
       Index_t ielem = regElemList[i];
-      Real_t ssTmp = (pbvc[i] * enewc[i] + vnewc[ielem] * vnewc[ielem] *
+      Real_t ssTmp = (c2 != NULL) ? c2[i] :
+                     (pbvc[i] * enewc[i] + vnewc[ielem] * vnewc[ielem] *
                  bvc[i] * pnewc[i]) / rho0;
       if (ssTmp <= Real_t(.1111111e-36)) {
          ssTmp = Real_t(.3333333e-18);
@@ -2195,15 +2803,35 @@ void CalcSoundSpeedForElems(Domain &domain,
       else {
          ssTmp = SQRT(ssTmp);
       }
-      domain.ss(ielem) = ssTmp ;
+      state.ss(ielem) = ssTmp ;
+   }
+}
+
+/******************************************/
+
+/* Flops per element of EvalEOSForElems.  The analytic EOS is 71 flops
+ * per repetition and 7 for the sound speed; a table replaces 9 of those
+ * with three lookups of 34 (bilinear) or 152 (bicubic) and the square
+ * roots use c2 directly. */
+static inline
+double EOSFlopsPerElem(const EOSTable *table, Int_t rep, Int_t order)
+{
+   if (table != NULL) {
+      return rep*(43.0 + 3.0*((order == EOSBicubic) ? 152.0 : 34.0)) + 1.0 ;
    }
+   return rep*71.0 + 7.0 ;
 }
 
 /******************************************/
 
+/* The EOS reads the material parameters from the domain and the element
+ * state from "state", which is either the domain itself or a batch of
+ * elements evaluated on behalf of another rank (EOSWork). */
+template <typename State, typename IndexSet>
 static inline
-void EvalEOSForElems(Domain& domain, Real_t *vnewc,
-                     Int_t numElemReg, Index_t *regElemList, Int_t rep)
+void EvalEOSForElems(Domain& domain, State& state, Real_t *vnewc,
+                     Int_t numElemReg, IndexSet regElemList, Int_t rep,
+                     Int_t order)
 {
    Real_t  e_cut = domain.e_cut() ;
    Real_t  p_cut = domain.p_cut() ;
@@ -2215,42 +2843,53 @@ void EvalEOSForElems(Domain& domain, Real_t *vnewc,
    Real_t pmin    = domain.pmin() ;
    Real_t emin    = domain.emin() ;
    Real_t rho0    = domain.refdens() ;
+   const EOSTable *table = domain.eosTable() ;
 
    // These temporaries will be of different size for 
    // each call (due to different sized region element
    // lists)
-   Real_t *e_old = Allocate<Real_t>(numElemReg) ;
-   Real_t *delvc = Allocate<Real_t>(numElemReg) ;
-   Real_t *p_old = Allocate<Real_t>(numElemReg) ;
-   Real_t *q_old = Allocate<Real_t>(numElemReg) ;
-   Real_t *compression = Allocate<Real_t>(numElemReg) ;
-   Real_t *compHalfStep = Allocate<Real_t>(numElemReg) ;
-   Real_t *qq_old = Allocate<Real_t>(numElemReg) ;
-   Real_t *ql_old = Allocate<Real_t>(numElemReg) ;
-   Real_t *work = Allocate<Real_t>(numElemReg) ;
-   Real_t *p_new = Allocate<Real_t>(numElemReg) ;
-   Real_t *e_new = Allocate<Real_t>(numElemReg) ;
-   Real_t *q_new = Allocate<Real_t>(numElemReg) ;
-   Real_t *bvc = Allocate<Real_t>(numElemReg) ;
-   Real_t *pbvc = Allocate<Real_t>(numElemReg) ;
+   Real_t *e_old, *delvc, *p_old, *q_old, *compression, *compHalfStep ;
+   Real_t *qq_old, *ql_old, *work, *p_new, *e_new, *q_new ;
+   Real_t *bvc, *pbvc, *c2 ;
+
+#pragma omp single copyprivate(e_old, delvc, p_old, q_old, compression, \
+                               compHalfStep, qq_old, ql_old, work, p_new, \
+                               e_new, q_new, bvc, pbvc, c2)
+   {
+      e_old = Allocate<Real_t>(numElemReg) ;
+      delvc = Allocate<Real_t>(numElemReg) ;
+      p_old = Allocate<Real_t>(numElemReg) ;
+      q_old = Allocate<Real_t>(numElemReg) ;
+      compression = Allocate<Real_t>(numElemReg) ;
+      compHalfStep = Allocate<Real_t>(numElemReg) ;
+      qq_old = Allocate<Real_t>(numElemReg) ;
+      ql_old = Allocate<Real_t>(numElemReg) ;
+      work = Allocate<Real_t>(numElemReg) ;
+      p_new = Allocate<Real_t>(numElemReg) ;
+      e_new = Allocate<Real_t>(numElemReg) ;
+      q_new = Allocate<Real_t>(numElemReg) ;
+      bvc = Allocate<Real_t>(numElemReg) ;
+      pbvc = Allocate<Real_t>(numElemReg) ;
+      c2 = (table != NULL) ? Allocate<Real_t>(numElemReg) : NULL ;
+   }
  
    //loop to add load imbalance based on region number 
    for(Int_t j = 0; j < rep; j++) {
       /* compress data, minimal set */
-#pragma omp parallel
+      OMP_PARALLEL(firstprivate(numElemReg, eosvmin, eosvmax))
       {
-#pragma omp for nowait firstprivate(numElemReg)
+#pragma omp for nowait
          for (Index_t i=0; i<numElemReg; ++i) {
             Index_t ielem = regElemList[i];
-            e_old[i] = domain.e(ielem) ;
-            delvc[i] = domain.delv(ielem) ;
-            p_old[i] = domain.p(ielem) ;
-            q_old[i] = domain.q(ielem) ;
-            qq_old[i] = domain.qq(ielem) ;
-            ql_old[i] = domain.ql(ielem) ;
+            e_old[i] = state.e(ielem) ;
+            delvc[i] = state.delv(ielem) ;
+            p_old[i] = state.p(ielem) ;
+            q_old[i] = state.q(ielem) ;
+            qq_old[i] = state.qq(ielem) ;
+            ql_old[i] = state.ql(ielem) ;
          }
 
-#pragma omp for firstprivate(numElemReg)
+#pragma omp for
          for (Index_t i = 0; i < numElemReg ; ++i) {
             Index_t ielem = regElemList[i];
             Real_t vchalf ;
@@ -2261,7 +2900,7 @@ void EvalEOSForElems(Domain& domain, Real_t *vnewc,
 
       /* Check for v > eosvmax or v < eosvmin */
          if ( eosvmin != Real_t(0.) ) {
-#pragma omp for nowait firstprivate(numElemReg, eosvmin)
+#pragma omp for nowait
             for(Index_t i=0 ; i<numElemReg ; ++i) {
                Index_t ielem = regElemList[i];
                if (vnewc[ielem] <= eosvmin) { /* impossible due to calling func? */
@@ -2270,7 +2909,7 @@ void EvalEOSForElems(Domain& domain, Real_t *vnewc,
             }
          }
          if ( eosvmax != Real_t(0.) ) {
-#pragma omp for nowait firstprivate(numElemReg, eosvmax)
+#pragma omp for nowait
             for(Index_t i=0 ; i<numElemReg ; ++i) {
                Index_t ielem = regElemList[i];
                if (vnewc[ielem] >= eosvmax) { /* impossible due to calling func? */
@@ -2281,71 +2920,239 @@ void EvalEOSForElems(Domain& domain, Real_t *vnewc,
             }
          }
 
-#pragma omp for nowait firstprivate(numElemReg)
+#pragma omp for nowait
          for (Index_t i = 0 ; i < numElemReg ; ++i) {
             work[i] = Real_t(0.) ; 
          }
       }
-      CalcEnergyForElems(p_new, e_new, q_new, bvc, pbvc,
+#pragma omp barrier
+      CalcEnergyForElems(p_new, e_new, q_new, bvc, pbvc, c2,
                          p_old, e_old,  q_old, compression, compHalfStep,
                          vnewc, work,  delvc, pmin,
                          p_cut, e_cut, q_cut, emin,
                          qq_old, ql_old, rho0, eosvmax,
-                         numElemReg, regElemList);
+                         numElemReg, regElemList, table, order);
    }
 
-#pragma omp parallel for firstprivate(numElemReg)
+   OMP_FOR(OMP_FIRSTPRIVATE(numElemReg))
    for (Index_t i=0; i<numElemReg; ++i) {
       Index_t ielem = regElemList[i];
-      domain.p(ielem) = p_new[i] ;
-      domain.e(ielem) = e_new[i] ;
-      domain.q(ielem) = q_new[i] ;
+      state.p(ielem) = p_new[i] ;
+      state.e(ielem) = e_new[i] ;
+      state.q(ielem) = q_new[i] ;
    }
 
-   CalcSoundSpeedForElems(domain,
+   CalcSoundSpeedForElems(state,
                           vnewc, rho0, e_new, p_new,
-                          pbvc, bvc, ss4o3,
+                          pbvc, bvc, c2, ss4o3,
                           numElemReg, regElemList) ;
 
-   Release(&pbvc) ;
-   Release(&bvc) ;
-   Release(&q_new) ;
-   Release(&e_new) ;
-   Release(&p_new) ;
-   Release(&work) ;
-   Release(&ql_old) ;
-   Release(&qq_old) ;
-   Release(&compHalfStep) ;
-   Release(&compression) ;
-   Release(&q_old) ;
-   Release(&p_old) ;
-   Release(&delvc) ;
-   Release(&e_old) ;
+   // Each loop streams its arrays once: 85 reals and 8 list entries per
+   // element and repetition, plus 12 and 2 for the write back and sound
+   // speed
+   TimerAddWork(double(numElemReg)*(rep*(REAL_BYTES(85) + INDEX_BYTES(8)) +
+                                    REAL_BYTES(12) + INDEX_BYTES(2)),
+                double(numElemReg)*EOSFlopsPerElem(table, rep, order)) ;
+
+#pragma omp single
+   {
+      Release(&c2) ;
+      Release(&pbvc) ;
+      Release(&bvc) ;
+      Release(&q_new) ;
+      Release(&e_new) ;
+      Release(&p_new) ;
+      Release(&work) ;
+      Release(&ql_old) ;
+      Release(&qq_old) ;
+      Release(&compHalfStep) ;
+      Release(&compression) ;
+      Release(&q_old) ;
+      Release(&p_old) ;
+      Release(&delvc) ;
+      Release(&e_old) ;
+   }
+}
+
+/******************************************/
+
+static inline
+void CalcTimeConstraintsForElems(Domain& domain) {
+   SCOPED_TIMER(TimerCalcTimeConstraints) ;
+
+   Index_t numElem = domain.numElem() ;
+   Real_t  qqc2    = Real_t(64.0) * domain.qqc() * domain.qqc() ;
+   Real_t  dvovmax = domain.dvovmax() ;
+
+   static Real_t dtcourant ;
+   static Real_t dthydro ;
+
+   // Initialize conditions to a very large value
+#pragma omp single
+   {
+      dtcourant = Real_t(1.0e+20) ;
+      dthydro   = Real_t(1.0e+20) ;
+   }
+
+   // Regions partition the elements, so a single sweep over the whole
+   // domain yields the same minima as the per-region loops did
+   OMP_FOR(OMP_FIRSTPRIVATE(numElem, qqc2, dvovmax)
+           reduction(min : dtcourant, dthydro))
+   for (Index_t i = 0 ; i < numElem ; ++i) {
+      Real_t vdov = domain.vdov(i) ;
+
+      if (vdov != Real_t(0.)) {
+         Real_t arealg = domain.arealg(i) ;
+
+         /* evaluate time constraint */
+         Real_t dtf = domain.ss(i) * domain.ss(i) ;
+         if ( vdov < Real_t(0.) ) {
+            dtf = dtf + qqc2 * arealg * arealg * vdov * vdov ;
+         }
+         dtf = arealg / SQRT(dtf) ;
+
+         if ( dtf < dtcourant ) {
+            dtcourant = dtf ;
+         }
+
+         /* check hydro constraint */
+         Real_t dtdvov = dvovmax / (FABS(vdov)+Real_t(1.e-20)) ;
+
+         if ( dtdvov < dthydro ) {
+            dthydro = dtdvov ;
+         }
+      }
+   }
+
+#pragma omp single nowait
+   {
+      domain.dtcourant() = dtcourant ;
+      domain.dthydro()   = dthydro ;
+   }
+
+   // ss, arealg and vdov; 9 flops for the courant and 3 for the
+   // hydro constraint
+   TimerAddWork(REAL_BYTES(3*numElem), 12.0*numElem) ;
+}
+/******************************************/
+
+/* EOS cost of region r: the number of repetitions of the evaluation and
+ * the table interpolation order */
+static inline
+void RegionEOSCost(Domain& domain, Int_t r, Int_t *rep, Int_t *order)
+{
+   *order = EOSBilinear;
+   //Determine load imbalance for this region
+   //round down the number with lowest cost
+   if(r < domain.numReg()/2)
+      *rep = 1;
+   //you don't get an expensive region unless you at least have 5 regions
+   else if(r < (domain.numReg() - (domain.numReg()+15)/20))
+      *rep = 1 + domain.cost();
+   //very expensive regions
+   else
+      *rep = 10 * (1+ domain.cost());
+   //with a tabulated EOS the table lookups are the real cost, so
+   //the expensive regions use bicubic rather than bilinear lookups
+   //instead of repeating the evaluation
+   if (domain.eosTable() != NULL) {
+      *order = (*rep > 1) ? EOSBicubic : EOSBilinear;
+      *rep = 1;
+   }
+}
+
+/******************************************/
+
+#if USE_MPI
+/* Copy the EOS inputs of the elements a send ships into its buffer, and
+ * the returned results back to the elements.  The team splits each
+ * region's share; only the messages are left to the master thread */
+static inline
+void PackEOSWork(Domain& domain, EOSWork& work, const Real_t *vnewc)
+{
+   Int_t numReg = domain.numReg() ;
+
+   OMP_PARALLEL(firstprivate(numReg))
+   {
+      Index_t pos = 0 ;
+      for (Int_t r=0 ; r<numReg ; ++r) {
+         Index_t count = work.count[r] ;
+         const Index_t *list = domain.regElemlist(r) + work.first[r] ;
+#pragma omp for nowait
+         for (Index_t i=0 ; i<count ; ++i) {
+            Index_t ielem = list[i] ;
+            work.delv(pos+i) = domain.delv(ielem) ;
+            work.qq(pos+i)   = domain.qq(ielem) ;
+            work.ql(pos+i)   = domain.ql(ielem) ;
+            work.field(EOSVnew)[pos+i] = vnewc[ielem] ;
+            work.e(pos+i)    = domain.e(ielem) ;
+            work.p(pos+i)    = domain.p(ielem) ;
+            work.q(pos+i)    = domain.q(ielem) ;
+         }
+         pos += count ;
+      }
+   }
+#pragma omp barrier
+}
+
+static inline
+void UnpackEOSWork(Domain& domain, EOSWork& work)
+{
+   Int_t numReg = domain.numReg() ;
+
+   OMP_PARALLEL(firstprivate(numReg))
+   {
+      Index_t pos = 0 ;
+      for (Int_t r=0 ; r<numReg ; ++r) {
+         Index_t count = work.count[r] ;
+         const Index_t *list = domain.regElemlist(r) + work.first[r] ;
+#pragma omp for nowait
+         for (Index_t i=0 ; i<count ; ++i) {
+            Index_t ielem = list[i] ;
+            domain.e(ielem)  = work.e(pos+i) ;
+            domain.p(ielem)  = work.p(pos+i) ;
+            domain.q(ielem)  = work.q(pos+i) ;
+            domain.ss(ielem) = work.ss(pos+i) ;
+         }
+         pos += count ;
+      }
+   }
+#pragma omp barrier
 }
+#endif
 
 /******************************************/
 
 static inline
 void ApplyMaterialPropertiesForElems(Domain& domain)
 {
+   SCOPED_TIMER(TimerApplyMaterialProperties) ;
+
    Index_t numElem = domain.numElem() ;
 
   if (numElem != 0) {
     /* Expose all of the variables needed for material evaluation */
     Real_t eosvmin = domain.eosvmin() ;
     Real_t eosvmax = domain.eosvmax() ;
-    Real_t *vnewc = Allocate<Real_t>(numElem) ;
+    Real_t *vnewc ;
+    static ElemError err ;
 
-#pragma omp parallel
+#pragma omp single copyprivate(vnewc)
+    {
+       vnewc = Allocate<Real_t>(numElem) ;
+       ClearElemError(err) ;
+    }
+
+    OMP_PARALLEL(firstprivate(numElem, eosvmin, eosvmax))
     {
-#pragma omp for firstprivate(numElem)
+#pragma omp for
        for(Index_t i=0 ; i<numElem ; ++i) {
           vnewc[i] = domain.vnew(i) ;
        }
 
        // Bound the updated relative volumes with eosvmin/max
        if (eosvmin != Real_t(0.)) {
-#pragma omp for nowait firstprivate(numElem)
+#pragma omp for nowait
           for(Index_t i=0 ; i<numElem ; ++i) {
              if (vnewc[i] < eosvmin)
                 vnewc[i] = eosvmin ;
@@ -2353,7 +3160,7 @@ void ApplyMaterialPropertiesForElems(Domain& domain)
        }
 
        if (eosvmax != Real_t(0.)) {
-#pragma omp for nowait firstprivate(numElem)
+#pragma omp for nowait
           for(Index_t i=0 ; i<numElem ; ++i) {
              if (vnewc[i] > eosvmax)
                 vnewc[i] = eosvmax ;
@@ -2363,7 +3170,7 @@ void ApplyMaterialPropertiesForElems(Domain& domain)
        // This check may not make perfect sense in LULESH, but
        // it's representative of something in the full code -
        // just leave it in, please
-#pragma omp for nowait firstprivate(numElem)
+#pragma omp for nowait reduction(elemError : err)
        for (Index_t i=0; i<numElem; ++i) {
           Real_t vc = domain.v(i) ;
           if (eosvmin != Real_t(0.)) {
@@ -2375,34 +3182,122 @@ void ApplyMaterialPropertiesForElems(Domain& domain)
                 vc = eosvmax ;
           }
           if (vc <= 0.) {
-#if USE_MPI
-             MPI_Abort(MPI_COMM_WORLD, VolumeError) ;
-#else
-             exit(VolumeError);
-#endif
+             FlagElemError(err, VolumeError, i) ;
           }
        }
     }
+#pragma omp barrier
+    CheckElemError(domain, err, "ApplyMaterialPropertiesForElems") ;
+    TimerAddWork(REAL_BYTES(numElem)*(3 + ((eosvmin != Real_t(0.)) ? 2 : 0) +
+                                      ((eosvmax != Real_t(0.)) ? 2 : 0)), 0.0) ;
 
-    for (Int_t r=0 ; r<domain.numReg() ; r++) {
-       Index_t numElemReg = domain.regElemSize(r);
+#if USE_MPI
+    // Hand the tail of the expensive regions to ranks with less EOS work
+    // and evaluate what others handed here before the own elements, so
+    // their results are on the way back while this rank is busy.  The
+    // messages and the timing belong to the master thread
+    EOSBalance& balance = domain.eosBalance() ;
+    double eosStart = 0.0 ;
+    if (balance.interval > 0) {
+#pragma omp master
+       {
+          eosStart = MPI_Wtime() ;
+          if ((domain.cycle() > 0) && (domain.cycle() % balance.interval == 0)) {
+             std::vector<double> regionWeight(domain.numReg()) ;
+             for (Int_t r=0 ; r<domain.numReg() ; r++) {
+                Int_t rep, order ;
+                RegionEOSCost(domain, r, &rep, &order) ;
+                regionWeight[r] = EOSFlopsPerElem(domain.eosTable(), rep, order) ;
+             }
+             PlanEOSBalance(domain, &regionWeight[0]) ;
+             eosStart = MPI_Wtime() ;
+          }
+          PrepareEOSWork(domain) ;
+       }
+#pragma omp barrier
+       for (size_t k=0 ; k<balance.sends.size() ; ++k) {
+          PackEOSWork(domain, balance.sends[k], vnewc) ;
+       }
+#pragma omp master
+       SendEOSWork(domain) ;
+       for (size_t k=0 ; k<balance.serves.size() ; ++k) {
+#pragma omp master
+          ReceiveEOSWork(domain, k) ;
+#pragma omp barrier
+          EOSWork& work = balance.serves[k] ;
+          Index_t start = 0 ;
+          for (Int_t r=0 ; r<domain.numReg() ; r++) {
+             if (work.count[r] > 0) {
+                Int_t rep, order ;
+                RegionEOSCost(domain, r, &rep, &order) ;
+                SCOPED_TIMER(TimerEOSRegion + r) ;
+                EvalEOSForElems(domain, work, work.field(EOSVnew),
+                                work.count[r], ElemRange(start), rep, order) ;
+                start += work.count[r] ;
+             }
+          }
+#pragma omp master
+          ReturnEOSWork(domain, k) ;
+       }
+    }
+    double localStart = 0.0 ;
+#pragma omp master
+    localStart = MPI_Wtime() ;
+    double localUnits = 0.0 ;
+#endif
+
+    for (Int_t r=0 ; r<domain.numReg() ; r++) {
+       Index_t numElemReg = domain.regElemSize(r);
        Index_t *regElemList = domain.regElemlist(r);
-       Int_t rep;
-       //Determine load imbalance for this region
-       //round down the number with lowest cost
-       if(r < domain.numReg()/2)
-	 rep = 1;
-       //you don't get an expensive region unless you at least have 5 regions
-       else if(r < (domain.numReg() - (domain.numReg()+15)/20))
-         rep = 1 + domain.cost();
-       //very expensive regions
-       else
-	 rep = 10 * (1+ domain.cost());
-       EvalEOSForElems(domain, vnewc, numElemReg, regElemList, rep);
+       Int_t rep, order ;
+       RegionEOSCost(domain, r, &rep, &order) ;
+#if USE_MPI
+       // Shipped elements are the tail of the list, so the own ones
+       // are a prefix of it in either layout
+       if (balance.interval > 0) {
+          numElemReg -= balance.shipped[r] ;
+          localUnits += double(numElemReg)*
+                        EOSFlopsPerElem(domain.eosTable(), rep, order) ;
+       }
+#endif
+       SCOPED_TIMER(TimerEOSRegion + r) ;
+       if (domain.regionSorted()) {
+          EvalEOSForElems(domain, domain, vnewc, numElemReg,
+                          ElemRange((numElemReg > 0) ? regElemList[0] : 0),
+                          rep, order);
+       }
+       else {
+          EvalEOSForElems(domain, domain, vnewc, numElemReg,
+                          ElemList(regElemList), rep, order);
+       }
+    }
+
+#if USE_MPI
+    if (balance.interval > 0) {
+#pragma omp master
+       {
+          balance.localTime += MPI_Wtime() - localStart ;
+          balance.localUnits += localUnits ;
+          FinishEOSWork(domain) ;
+       }
+#pragma omp barrier
+       for (size_t k=0 ; k<balance.sends.size() ; ++k) {
+          UnpackEOSWork(domain, balance.sends[k]) ;
+       }
+       // A sender's EOS ends when its results are back, not when its
+       // own elements are done
+#pragma omp master
+       balance.eosTime += MPI_Wtime() - eosStart ;
     }
+#endif
 
+#pragma omp single
     Release(&vnewc) ;
   }
+
+  /* ss was just produced by the EOS and vdov/arealg by the kinematics,
+   * so reduce the time constraints while they are still in cache */
+  CalcTimeConstraintsForElems(domain) ;
 }
 
 /******************************************/
@@ -2411,8 +3306,10 @@ static inline
 void UpdateVolumesForElems(Domain &domain,
                            Real_t v_cut, Index_t length)
 {
+   SCOPED_TIMER(TimerUpdateVolumesForElems) ;
+
    if (length != 0) {
-#pragma omp parallel for firstprivate(length, v_cut)
+      OMP_FOR(OMP_FIRSTPRIVATE(length, v_cut))
       for(Index_t i=0 ; i<length ; ++i) {
          Real_t tmpV = domain.vnew(i) ;
 
@@ -2421,6 +3318,7 @@ void UpdateVolumesForElems(Domain &domain,
 
          domain.v(i) = tmpV ;
       }
+      TimerAddWork(REAL_BYTES(2*length), 1.0*length) ;
    }
 
    return ;
@@ -2445,205 +3343,446 @@ void LagrangeElements(Domain& domain, Index_t numElem)
 /******************************************/
 
 static inline
-void CalcCourantConstraintForElems(Domain &domain, Index_t length,
-                                   Index_t *regElemlist,
-                                   Real_t qqc, Real_t& dtcourant)
+uint64_t HashMix64(uint64_t x)
 {
-#if _OPENMP
-   const Index_t threads = omp_get_max_threads();
-   Index_t courant_elem_per_thread[threads];
-   Real_t dtcourant_per_thread[threads];
-#else
-   Index_t threads = 1;
-   Index_t courant_elem_per_thread[1];
-   Real_t  dtcourant_per_thread[1];
-#endif
+   // splitmix64 finalizer: a cheap counter-based hash
+   x += 0x9e3779b97f4a7c15ULL ;
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL ;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL ;
+   return x ^ (x >> 31) ;
+}
 
-#pragma omp parallel firstprivate(length, qqc)
-   {
-      Real_t   qqc2 = Real_t(64.0) * qqc * qqc ;
-      Real_t   dtcourant_tmp = dtcourant;
-      Index_t  courant_elem  = -1 ;
+/******************************************/
 
-#if _OPENMP
-      Index_t thread_num = omp_get_thread_num();
-#else
-      Index_t thread_num = 0;
-#endif      
+static inline
+Index_t GCD(Index_t a, Index_t b)
+{
+   while (b != 0) {
+      Index_t t = a % b ;
+      a = b ;
+      b = t ;
+   }
+   return a ;
+}
 
-#pragma omp for 
-      for (Index_t i = 0 ; i < length ; ++i) {
-         Index_t indx = regElemlist[i] ;
-         Real_t dtf = domain.ss(indx) * domain.ss(indx) ;
+/******************************************/
 
-         if ( domain.vdov(indx) < Real_t(0.) ) {
-            dtf = dtf
-                + qqc2 * domain.arealg(indx) * domain.arealg(indx)
-                * domain.vdov(indx) * domain.vdov(indx) ;
-         }
+static inline
+void MigrateRegionsForElems(Domain& domain)
+{
+   SCOPED_TIMER(TimerMigrateRegions) ;
 
-         dtf = SQRT(dtf) ;
-         dtf = domain.arealg(indx) / dtf ;
+   //
+   // Mimic ALE remap moving material interfaces: a sample of elements
+   // adopts the region of one of its face neighbors.  Region lists are
+   // updated in place (swap-with-last removal, append at the end) so
+   // the cost is O(moves), not O(numElem); a list is only reallocated
+   // when its region outgrows the room left for arrivals.
+   //
+   Index_t numElem = domain.numElem() ;
+   Index_t numReg  = domain.numReg() ;
+   Index_t numMove = domain.regMaxMoves() ;
+   Index_t *moves  = domain.regMoves() ;
+
+   // Every rank draws a different, reproducible sample each time
+   uint64_t seed = HashMix64((uint64_t(domain.planeLoc()*domain.tp() +
+                                       domain.rowLoc())*domain.tp() +
+                              domain.colLoc()) << 32 | uint64_t(domain.cycle())) ;
+
+   // Visiting offset + k*stride (mod numElem) with a stride coprime to
+   // numElem gives distinct elements without a duplicate check
+   Index_t offset = Index_t(seed % uint64_t(numElem)) ;
+   Index_t stride = Index_t((seed >> 32) % uint64_t(numElem)) | 1 ;
+   while (GCD(stride, numElem) != 1) {
+      stride += 2 ;
+   }
+
+   // Decide all moves against the old region assignment
+   OMP_FOR(OMP_FIRSTPRIVATE(numMove, numElem, offset, stride, seed))
+   for (Index_t k=0 ; k<numMove ; ++k) {
+      Index_t elem = Index_t((Int8_t(offset) + Int8_t(k)*stride) % numElem) ;
+      Index_t nbr ;
+      switch (HashMix64(seed ^ uint64_t(k)) % 6) {
+         case 0:  nbr = domain.lxim(elem) ;   break ;
+         case 1:  nbr = domain.lxip(elem) ;   break ;
+         case 2:  nbr = domain.letam(elem) ;  break ;
+         case 3:  nbr = domain.letap(elem) ;  break ;
+         case 4:  nbr = domain.lzetam(elem) ; break ;
+         default: nbr = domain.lzetap(elem) ; break ;
+      }
+      moves[3*k]   = elem ;
+      moves[3*k+1] = domain.regNumList(elem) - 1 ;
+      moves[3*k+2] = -1 ;
+      // ghost neighbors live on another rank and have no region here
+      if (nbr < numElem && domain.regNumList(nbr) != domain.regNumList(elem)) {
+         moves[3*k+2] = domain.regNumList(nbr) - 1 ;
+      }
+   }
 
-         if (domain.vdov(indx) != Real_t(0.)) {
-            if ( dtf < dtcourant_tmp ) {
-               dtcourant_tmp = dtf ;
-               courant_elem  = indx ;
+   OMP_PARALLEL(firstprivate(numReg, numMove))
+   {
+      // Each region's list is owned by one thread, first for removals...
+#pragma omp for schedule(dynamic, 1)
+      for (Index_t r=0 ; r<numReg ; ++r) {
+         for (Index_t k=0 ; k<numMove ; ++k) {
+            if (moves[3*k+1] == r && moves[3*k+2] >= 0) {
+               Index_t elem = moves[3*k] ;
+               Index_t pos  = domain.regElemPos(elem) ;
+               Index_t last = domain.regElemlist(r, --domain.regElemSize(r)) ;
+               domain.regElemlist(r, pos) = last ;
+               domain.regElemPos(last) = pos ;
             }
          }
       }
 
-      dtcourant_per_thread[thread_num]    = dtcourant_tmp ;
-      courant_elem_per_thread[thread_num] = courant_elem ;
+      // ...then for arrivals, so the owner can grow its list first
+#pragma omp for schedule(dynamic, 1)
+      for (Index_t r=0 ; r<numReg ; ++r) {
+         Index_t arrivals = 0 ;
+         for (Index_t k=0 ; k<numMove ; ++k) {
+            if (moves[3*k+2] == r) {
+               ++arrivals ;
+            }
+         }
+         domain.ReserveRegionElems(r, domain.regElemSize(r) + arrivals) ;
+
+         for (Index_t k=0 ; k<numMove ; ++k) {
+            if (moves[3*k+2] == r) {
+               Index_t elem = moves[3*k] ;
+               Index_t pos  = domain.regElemSize(r)++ ;
+               domain.regElemlist(r, pos) = elem ;
+               domain.regElemPos(elem) = pos ;
+               domain.regNumList(elem) = r + 1 ;
+            }
+         }
+      }
    }
+}
 
-   for (Index_t i = 1; i < threads; ++i) {
-      if (dtcourant_per_thread[i] < dtcourant_per_thread[0] ) {
-         dtcourant_per_thread[0]    = dtcourant_per_thread[i];
-         courant_elem_per_thread[0] = courant_elem_per_thread[i];
+/******************************************/
+
+static inline
+void LagrangeLeapFrog(Domain& domain)
+{
+#ifdef SEDOV_SYNC_POS_VEL_LATE
+   Domain_member fieldData[6] ;
+#endif
+
+   /* one team for the whole step; the kernels below share it */
+#if LULESH_PERSISTENT_OMP
+#pragma omp parallel
+#endif
+   {
+      /* time-varying region membership, as an ALE code would produce */
+      if ((domain.regMigrateInterval() > 0) &&
+          (domain.cycle() % domain.regMigrateInterval() == 0)) {
+         MigrateRegionsForElems(domain) ;
       }
-   }
 
-   if (courant_elem_per_thread[0] != -1) {
-      dtcourant = dtcourant_per_thread[0] ;
-   }
+      /* calculate nodal forces, accelerations, velocities, positions, with
+       * applied boundary conditions and slide surface considerations */
+      LagrangeNodal(domain);
 
-   return ;
+      /* calculate element quantities (i.e. velocity gradient & q), update
+       * material states and evaluate the time constraints */
+      LagrangeElements(domain, domain.numElem());
 
+#if USE_MPI   
+#ifdef SEDOV_SYNC_POS_VEL_LATE
+#pragma omp master
+      {
+         CommRecv(domain, MSG_SYNC_POS_VEL, 6,
+                  domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
+                  false, false) ;
+
+         fieldData[0] = &Domain::x ;
+         fieldData[1] = &Domain::y ;
+         fieldData[2] = &Domain::z ;
+         fieldData[3] = &Domain::xd ;
+         fieldData[4] = &Domain::yd ;
+         fieldData[5] = &Domain::zd ;
+   
+         CommSend(domain, MSG_SYNC_POS_VEL, 6, fieldData,
+                  domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
+                  false, false) ;
+
+         CommSyncPosVel(domain) ;
+      }
+#endif
+#endif   
+   }
 }
 
+
 /******************************************/
 
-static inline
-void CalcHydroConstraintForElems(Domain &domain, Index_t length,
-                                 Index_t *regElemlist, Real_t dvovmax, Real_t& dthydro)
+static Domain *BuildDomain(struct cmdLineOpts& opts, Int_t numRanks, Int_t myRank,
+                           Int_t col, Int_t row, Int_t plane, Int_t side)
 {
-#if _OPENMP
-   const Index_t threads = omp_get_max_threads();
-   Index_t hydro_elem_per_thread[threads];
-   Real_t dthydro_per_thread[threads];
-#else
-   Index_t threads = 1;
-   Index_t hydro_elem_per_thread[1];
-   Real_t  dthydro_per_thread[1];
+#if USE_MPI   
+   Domain_member fieldData ;
 #endif
 
-#pragma omp parallel firstprivate(length, dvovmax)
-   {
-      Real_t dthydro_tmp = dthydro ;
-      Index_t hydro_elem = -1 ;
+   // A file mesh replaces the built-in cube; each rank keeps the whole
+   // mesh only until its part is built
+   HexMesh mesh ;
+   if (opts.meshFile != NULL) {
+      ReadHexMesh(opts.meshFile, &mesh, myRank) ;
+   }
 
-#if _OPENMP
-      Index_t thread_num = omp_get_thread_num();
-#else      
-      Index_t thread_num = 0;
-#endif      
+   Domain *domain = new Domain(numRanks, col, row, plane, opts.nx,
+                               side, opts.numReg, opts.balance, opts.cost,
+                               opts.sortRegions, opts.migrateInterval,
+                               opts.migrateFraction,
+                               (opts.meshFile != NULL) ? &mesh : NULL) ;
 
-#pragma omp for
-      for (Index_t i = 0 ; i < length ; ++i) {
-         Index_t indx = regElemlist[i] ;
+   if (opts.meshOut != NULL) {
+      WriteHexMesh(*domain, opts.meshOut) ;
+   }
 
-         if (domain.vdov(indx) != Real_t(0.)) {
-            Real_t dtdvov = dvovmax / (FABS(domain.vdov(indx))+Real_t(1.e-20)) ;
+   SetupEOSBalance(*domain, opts.eosBalanceInterval) ;
 
-            if ( dthydro_tmp > dtdvov ) {
-                  dthydro_tmp = dtdvov ;
-                  hydro_elem = indx ;
-            }
-         }
-      }
+   // A/B switch for the implicit lattice connectivity of the kernels
+   if (opts.nodelist != 0) {
+      domain->latticeNodes() = false ;
+   }
 
-      dthydro_per_thread[thread_num]    = dthydro_tmp ;
-      hydro_elem_per_thread[thread_num] = hydro_elem ;
+   // Tabulated EOS, if requested, replaces the analytic ideal gas
+   if (opts.eosFile != NULL) {
+      domain->eosTable() = ReadEOSTable(opts.eosFile, myRank) ;
+   }
+   else if (opts.eosOut != NULL) {
+      domain->eosTable() = CreateIdealGasEOSTable(128, 128, Real_t(5.0)/Real_t(3.0)) ;
    }
 
-   for (Index_t i = 1; i < threads; ++i) {
-      if(dthydro_per_thread[i] < dthydro_per_thread[0]) {
-         dthydro_per_thread[0]    = dthydro_per_thread[i];
-         hydro_elem_per_thread[0] =  hydro_elem_per_thread[i];
-      }
+#if USE_MPI   
+   fieldData = &Domain::nodalMass ;
+
+   // Initial domain boundary communication 
+   CommRecv(*domain, MSG_COMM_SBN, 1,
+            domain->sizeX() + 1, domain->sizeY() + 1, domain->sizeZ() + 1,
+            true, false) ;
+   CommSend(*domain, MSG_COMM_SBN, 1, &fieldData,
+            domain->sizeX() + 1, domain->sizeY() + 1, domain->sizeZ() +  1,
+            true, false) ;
+   CommSBN(*domain, 1, &fieldData) ;
+
+   // End initialization
+   MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+   // Restart replaces the evolving state of the freshly built domain
+   if (opts.restartFile != NULL) {
+      ReadCheckpoint(*domain, opts.restartFile, myRank, numRanks,
+                     (opts.quiet == 0)) ;
    }
 
-   if (hydro_elem_per_thread[0] != -1) {
-      dthydro =  dthydro_per_thread[0] ;
+   return domain ;
+}
+
+/******************************************/
+
+/* lulesh-bench.cc includes this file for the kernels and has its own main */
+#if !LULESH_BENCH
+
+/******************************************/
+
+/* Output about the built domain that is wanted once per run, not for
+ * every domain an A/B run or a sweep builds */
+static void ReportDomainSetup(Domain& domain, struct cmdLineOpts& opts,
+                              Int_t myRank)
+{
+   if (opts.placement != 0) {
+      ReportFieldPlacement(domain, myRank) ;
    }
 
-   return ;
+   if ((opts.eosFile == NULL) && (opts.eosOut != NULL) && (myRank == 0)) {
+      WriteEOSTable(domain.eosTable(), opts.eosOut) ;
+   }
 }
 
 /******************************************/
 
-static inline
-void CalcTimeConstraintsForElems(Domain& domain) {
+// Periodic VTK dumps go to a background writer so the timestep loop
+// only pays for the snapshot; SILO dumps are written in place
+static void WriteVizOutput(Domain& domain, struct cmdLineOpts& opts,
+                           Int_t myRank, bool periodic)
+{
+   SCOPED_TIMER(TimerVizOutput) ;
 
-   // Initialize conditions to a very large value
-   domain.dtcourant() = 1.0e+20;
-   domain.dthydro() = 1.0e+20;
-
-   for (Index_t r=0 ; r < domain.numReg() ; ++r) {
-      /* evaluate time constraint */
-      CalcCourantConstraintForElems(domain, domain.regElemSize(r),
-                                    domain.regElemlist(r),
-                                    domain.qqc(),
-                                    domain.dtcourant()) ;
-
-      /* check hydro constraint */
-      CalcHydroConstraintForElems(domain, domain.regElemSize(r),
-                                  domain.regElemlist(r),
-                                  domain.dvovmax(),
-                                  domain.dthydro()) ;
+   if (opts.viz == VizSilo) {
+      DumpToVisit(domain, opts.numFiles, myRank, domain.numRanks()) ;
+   }
+   else if (opts.viz == VizVTK) {
+      DumpToVTK(domain, myRank, domain.numRanks(), opts.vizStride, periodic) ;
    }
 }
 
 /******************************************/
 
-static inline
-void LagrangeLeapFrog(Domain& domain)
+static double RunToCompletion(Domain& domain, struct cmdLineOpts& opts, Int_t myRank,
+                              std::vector<TimeStepRecord>& history)
 {
-#ifdef SEDOV_SYNC_POS_VEL_LATE
-   Domain_member fieldData[6] ;
+   // Phase timers only cover the timestep loop
+   TimerReset() ;
+   history.clear() ;
+
+   // BEGIN timestep to solution */
+#if USE_MPI   
+   double start = MPI_Wtime();
+#else
+   timeval start;
+   gettimeofday(&start, NULL) ;
 #endif
+//debug to see region sizes
+//   for(Int_t i = 0; i < domain.numReg(); i++)
+//      std::cout << "region" << i + 1<< "size" << domain.regElemSize(i) <<std::endl;
+   while((domain.time() < domain.stoptime()) && (domain.cycle() < opts.its)) {
 
-   /* calculate nodal forces, accelerations, velocities, positions, with
-    * applied boundary conditions and slide surface considerations */
-   LagrangeNodal(domain);
+      TimeIncrement(domain) ;
+      LagrangeLeapFrog(domain) ;
 
+      TimeStepRecord step = { domain.time(), domain.deltatime() } ;
+      history.push_back(step) ;
 
-#ifdef SEDOV_SYNC_POS_VEL_LATE
-#endif
+      if ((opts.checkpointInterval > 0) &&
+          (domain.cycle() % opts.checkpointInterval == 0)) {
+         WriteCheckpoint(domain, opts.checkpointFile, myRank, domain.numRanks(),
+                         (opts.checkpointAsync != 0)) ;
+      }
 
-   /* calculate element quantities (i.e. velocity gradient & q), and update
-    * material states */
-   LagrangeElements(domain, domain.numElem());
+      if ((opts.vizInterval > 0) &&
+          (domain.cycle() % opts.vizInterval == 0)) {
+         WriteVizOutput(domain, opts, myRank, true) ;
+      }
 
+      if ((opts.showProg != 0) && (opts.quiet == 0) && (myRank == 0)) {
+         std::cout << "cycle = " << domain.cycle()       << ", "
+                   << std::scientific
+                   << "time = " << double(domain.time()) << ", "
+                   << "dt="     << double(domain.deltatime()) << "\n";
+         std::cout.unsetf(std::ios_base::floatfield);
+      }
+   }
+
+   // Use reduced max elapsed time
+   double elapsed_time;
 #if USE_MPI   
-#ifdef SEDOV_SYNC_POS_VEL_LATE
-   CommRecv(domain, MSG_SYNC_POS_VEL, 6,
-            domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
-            false, false) ;
+   elapsed_time = MPI_Wtime() - start;
+#else
+   timeval end;
+   gettimeofday(&end, NULL) ;
+   elapsed_time = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_usec - start.tv_usec))/1000000 ;
+#endif
+   double elapsed_timeG;
+#if USE_MPI   
+   MPI_Reduce(&elapsed_time, &elapsed_timeG, 1, MPI_DOUBLE,
+              MPI_MAX, 0, MPI_COMM_WORLD);
+#else
+   elapsed_timeG = elapsed_time;
+#endif
 
-   fieldData[0] = &Domain::x ;
-   fieldData[1] = &Domain::y ;
-   fieldData[2] = &Domain::z ;
-   fieldData[3] = &Domain::xd ;
-   fieldData[4] = &Domain::yd ;
-   fieldData[5] = &Domain::zd ;
-   
-   CommSend(domain, MSG_SYNC_POS_VEL, 6, fieldData,
-            domain.sizeX() + 1, domain.sizeY() + 1, domain.sizeZ() + 1,
-            false, false) ;
+   return elapsed_timeG ;
+}
+
+/******************************************/
+
+// Scaling sweep: every (size, threads) point gets a freshly built domain,
+// a short warm-up, then a fixed number of timed cycles
+static void RunSweep(struct cmdLineOpts& opts, Int_t numRanks, Int_t myRank,
+                     Int_t col, Int_t row, Int_t plane, Int_t side)
+{
+   const Int_t warmupCycles = 10 ;
+   const Int_t timedCycles = (opts.its == 9999999) ? 100 : opts.its ;
+
+   std::vector<Int_t> threads = opts.sweepThreads ;
+   std::vector<Int_t> sizes = opts.sweepSizes ;
+   if (threads.empty()) {
+#if _OPENMP
+      threads.push_back(omp_get_max_threads()) ;
+#else
+      threads.push_back(1) ;
 #endif
-#endif   
+   }
+   if (sizes.empty()) {
+      sizes.push_back(opts.nx) ;
+   }
 
-   CalcTimeConstraintsForElems(domain);
+   struct cmdLineOpts pointOpts = opts ;
+   pointOpts.showProg = 0 ;
+   pointOpts.checkpointFile = NULL ;
+   pointOpts.checkpointInterval = 0 ;
+   pointOpts.restartFile = NULL ;
+   pointOpts.vizInterval = 0 ;
+   std::vector<TimeStepRecord> history ;
+
+   SetFieldMemPolicy(opts.memPolicy) ;
+
+   if (myRank == 0) {
+      printf("Scaling sweep: %d ranks, %d warm-up + %d timed cycles per point\n\n",
+             numRanks, warmupCycles, timedCycles) ;
+      printf("%6s %7s %12s %6s %10s %10s %12s %8s %8s %8s\n",
+             "size", "threads", "elements", "cycles", "time(s)",
+             "us/z/c", "zones/s", "speedup", "strong", "weak") ;
+   }
 
-#if USE_MPI   
-#ifdef SEDOV_SYNC_POS_VEL_LATE
-   CommSyncPosVel(domain) ;
+   // Efficiency is throughput per thread: strong scaling against the
+   // first thread count of the same size, weak against the first point
+   double firstRate = 0.0 ;
+   for (size_t si = 0 ; si < sizes.size() ; ++si) {
+      double sizeRate = 0.0 ;
+      Int_t sizeThreads = threads[0] ;
+      for (size_t ti = 0 ; ti < threads.size() ; ++ti) {
+#if _OPENMP
+         omp_set_num_threads(threads[ti]) ;
 #endif
-#endif   
-}
+         pointOpts.nx = sizes[si] ;
+         Domain *locDom = BuildDomain(pointOpts, numRanks, myRank,
+                                      col, row, plane, side) ;
+         if ((si == 0) && (ti == 0)) {
+            ReportDomainSetup(*locDom, pointOpts, myRank) ;
+         }
+
+         pointOpts.its = warmupCycles ;
+         RunToCompletion(*locDom, pointOpts, myRank, history) ;
+         Int_t startCycle = locDom->cycle() ;
+         pointOpts.its = startCycle + timedCycles ;
+         double elapsed = RunToCompletion(*locDom, pointOpts, myRank, history) ;
+         Int_t cycles = locDom->cycle() - startCycle ;
 
+         delete locDom ;
+         ReleaseScratchPool() ;
+
+         if (myRank != 0) {
+            continue ;
+         }
+
+         Int8_t elems = (Int8_t)numRanks*sizes[si]*sizes[si]*sizes[si] ;
+         if ((cycles == 0) || (elapsed <= 0.0)) {
+            printf("%6d %7d %12lld %6d  (stop time reached during warm-up)\n",
+                   sizes[si], threads[ti], (long long)elems, cycles) ;
+            continue ;
+         }
+         double rate = double(elems)*cycles/elapsed ;
+         double grind = elapsed*1.0e6/(double(sizes[si])*sizes[si]*sizes[si]*cycles) ;
+         if (sizeRate == 0.0) {
+            sizeRate = rate ;
+            sizeThreads = threads[ti] ;
+         }
+         if (firstRate == 0.0) {
+            firstRate = rate/threads[ti] ;
+         }
+         printf("%6d %7d %12lld %6d %10.4f %10.4f %12.4e %8.3f %8.3f %8.3f\n",
+                sizes[si], threads[ti], (long long)elems, cycles, elapsed,
+                grind, rate, rate/sizeRate,
+                (rate/threads[ti])/(sizeRate/sizeThreads),
+                (rate/threads[ti])/firstRate) ;
+      }
+   }
+   if (myRank == 0) {
+      printf("\n") ;
+   }
+}
 
 /******************************************/
 
@@ -2655,8 +3794,6 @@ int main(int argc, char *argv[])
    struct cmdLineOpts opts;
 
 #if USE_MPI   
-   Domain_member fieldData ;
-   
 #ifdef _OPENMP
    int thread_support;
 
@@ -2679,25 +3816,29 @@ int main(int argc, char *argv[])
 #endif   
 
    /* Set defaults that can be overridden by command line opts */
-   opts.its = 9999999;
-   opts.nx  = 30;
-   opts.numReg = 11;
-   opts.numFiles = (int)(numRanks+10)/9;
-   opts.showProg = 0;
-   opts.quiet = 0;
-   opts.viz = 0;
-   opts.balance = 1;
-   opts.cost = 1;
+   InitCmdLineOpts(&opts, numRanks) ;
 
    ParseCommandLineOptions(argc, argv, myRank, &opts);
 
-   if ((myRank == 0) && (opts.quiet == 0)) {
-      std::cout << "Running problem size " << opts.nx << "^3 per domain until completion\n";
+   bool sweep = !opts.sweepThreads.empty() || !opts.sweepSizes.empty() ;
+
+   if ((myRank == 0) && (opts.quiet == 0) && !sweep) {
+      if (opts.meshFile != NULL) {
+         std::cout << "Running hex mesh " << opts.meshFile << " until completion\n";
+      }
+      else {
+         std::cout << "Running problem size " << opts.nx << "^3 per domain until completion\n";
+      }
       std::cout << "Num processors: "      << numRanks << "\n";
 #if _OPENMP
       std::cout << "Num threads: " << omp_get_max_threads() << "\n";
 #endif
-      std::cout << "Total number of elements: " << ((Int8_t)numRanks*opts.nx*opts.nx*opts.nx) << " \n\n";
+      if (opts.meshFile == NULL) {
+         std::cout << "Total number of elements: " << ((Int8_t)numRanks*opts.nx*opts.nx*opts.nx) << " \n\n";
+      }
+      else {
+         std::cout << "\n";
+      }
       std::cout << "To run other sizes, use -s <integer>.\n";
       std::cout << "To run a fixed number of iterations, use -i <integer>.\n";
       std::cout << "To run a more or less balanced region set, use -b <integer>.\n";
@@ -2707,82 +3848,123 @@ int main(int argc, char *argv[])
       std::cout << "See help (-h) for more options\n\n";
    }
 
-   // Set up the mesh and decompose. Assumes regular cubes for now
-   Int_t col, row, plane, side;
-   InitMeshDecomp(numRanks, myRank, &col, &row, &plane, &side);
-
-   // Build the main data structure and initialize it
-   locDom = new Domain(numRanks, col, row, plane, opts.nx,
-                       side, opts.numReg, opts.balance, opts.cost) ;
-
-
-#if USE_MPI   
-   fieldData = &Domain::nodalMass ;
+   // The written mesh is the whole cube, so it comes from one domain
+   if ((opts.meshOut != NULL) && (numRanks != 1)) {
+      if (myRank == 0) {
+         printf("Option --mesh-out requires a single rank\n") ;
+      }
+#if USE_MPI
+      MPI_Abort(MPI_COMM_WORLD, -1) ;
+#else
+      exit(-1) ;
+#endif
+   }
 
-   // Initial domain boundary communication 
-   CommRecv(*locDom, MSG_COMM_SBN, 1,
-            locDom->sizeX() + 1, locDom->sizeY() + 1, locDom->sizeZ() + 1,
-            true, false) ;
-   CommSend(*locDom, MSG_COMM_SBN, 1, &fieldData,
-            locDom->sizeX() + 1, locDom->sizeY() + 1, locDom->sizeZ() +  1,
-            true, false) ;
-   CommSBN(*locDom, 1, &fieldData) ;
+   // Set up the mesh and decompose. Assumes regular cubes for now; a
+   // file mesh is partitioned by the Domain itself and only needs the rank
+   Int_t col, row, plane, side;
+   if (opts.meshFile != NULL) {
+      col = myRank ;
+      row = 0 ;
+      plane = 0 ;
+      side = 1 ;
+   }
+   else {
+      InitMeshDecomp(numRanks, myRank, &col, &row, &plane, &side);
+   }
 
-   // End initialization
-   MPI_Barrier(MPI_COMM_WORLD);
-#endif   
-   
-   // BEGIN timestep to solution */
-#if USE_MPI   
-   double start = MPI_Wtime();
-#else
-   timeval start;
-   gettimeofday(&start, NULL) ;
+   // Sweeps change the thread count, so per-thread counters stay off
+   if (sweep) {
+      TimerInit(opts.numReg, false, myRank) ;
+      RunSweep(opts, numRanks, myRank, col, row, plane, side) ;
+#if USE_MPI
+      MPI_Finalize() ;
 #endif
-//debug to see region sizes
-//   for(Int_t i = 0; i < locDom->numReg(); i++)
-//      std::cout << "region" << i + 1<< "size" << locDom->regElemSize(i) <<std::endl;
-   while((locDom->time() < locDom->stoptime()) && (locDom->cycle() < opts.its)) {
+      return 0 ;
+   }
 
-      TimeIncrement(*locDom) ;
-      LagrangeLeapFrog(*locDom) ;
+   TimerInit(opts.numReg, (opts.perfCounters != 0), myRank) ;
+
+   // A/B page policy comparison: the problem is run once with default
+   // pages here, then again below with the -H policy
+   std::vector<TimeStepRecord> history ;
+   double elapsedDefault = 0.0 ;
+   if (opts.pageAB != 0) {
+      SetFieldMemPolicy(FieldMemDefault) ;
+      locDom = BuildDomain(opts, numRanks, myRank, col, row, plane, side) ;
+      elapsedDefault = RunToCompletion(*locDom, opts, myRank, history) ;
+      delete locDom ;
+      ReleaseScratchPool() ;
+   }
 
-      if ((opts.showProg != 0) && (opts.quiet == 0) && (myRank == 0)) {
-         std::cout << "cycle = " << locDom->cycle()       << ", "
-                   << std::scientific
-                   << "time = " << double(locDom->time()) << ", "
-                   << "dt="     << double(locDom->deltatime()) << "\n";
-         std::cout.unsetf(std::ios_base::floatfield);
-      }
+   // Build the main data structure and initialize it
+   SetFieldMemPolicy(opts.memPolicy) ;
+   locDom = BuildDomain(opts, numRanks, myRank, col, row, plane, side) ;
+   ReportDomainSetup(*locDom, opts, myRank) ;
+
+   // After a restart the elapsed time only covers the cycles run here
+   Int_t startCycle = locDom->cycle() ;
+   double elapsed_timeG = RunToCompletion(*locDom, opts, myRank, history) ;
+   Int_t cycles = locDom->cycle() - startCycle ;
+
+   if ((opts.pageAB != 0) && (myRank == 0)) {
+      printf("Page policy A/B: none %.4f s, %s %.4f s, speedup %.3f\n\n",
+             elapsedDefault, FieldMemPolicyName(opts.memPolicy),
+             elapsed_timeG, elapsedDefault/elapsed_timeG) ;
    }
 
-   // Use reduced max elapsed time
-   double elapsed_time;
-#if USE_MPI   
-   elapsed_time = MPI_Wtime() - start;
-#else
-   timeval end;
-   gettimeofday(&end, NULL) ;
-   elapsed_time = (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_usec - start.tv_usec))/1000000 ;
-#endif
-   double elapsed_timeG;
-#if USE_MPI   
-   MPI_Reduce(&elapsed_time, &elapsed_timeG, 1, MPI_DOUBLE,
-              MPI_MAX, 0, MPI_COMM_WORLD);
-#else
-   elapsed_timeG = elapsed_time;
-#endif
+   // Final checkpoint, unless the last cycle already wrote one
+   if ((opts.checkpointFile != NULL) &&
+       ((opts.checkpointInterval == 0) ||
+        (locDom->cycle() % opts.checkpointInterval != 0))) {
+      WriteCheckpoint(*locDom, opts.checkpointFile, myRank, numRanks,
+                      (opts.checkpointAsync != 0)) ;
+   }
+   if (opts.checkpointFile != NULL) {
+      FinishCheckpoints(myRank, numRanks, (opts.quiet == 0)) ;
+   }
+   ReportEOSBalance(*locDom, myRank, (opts.quiet == 0)) ;
 
    // Write out final viz file */
-   if (opts.viz) {
-      DumpToVisit(*locDom, opts.numFiles, myRank, numRanks) ;
+   if ((opts.viz != VizNone) &&
+       ((opts.vizInterval == 0) ||
+        (locDom->cycle() % opts.vizInterval != 0))) {
+      WriteVizOutput(*locDom, opts, myRank, false) ;
    }
+   FinishVTK() ;
    
+   // Machine peaks are probed after the run so they do not disturb it
+   MachinePeaks peaks = { 0.0, 0.0 } ;
+   if (opts.roofline != 0) {
+      MeasureMachinePeaks(&peaks) ;
+   }
+
+   std::vector<PhaseStats> phases ;
+   Int_t numCounters = 0 ;
+   if ((opts.quiet == 0) || (opts.outputFormat != OutputNone)) {
+      numCounters = TimerGather(myRank, numRanks, phases) ;
+   }
+
    if ((myRank == 0) && (opts.quiet == 0)) {
-      VerifyAndWriteFinalOutput(elapsed_timeG, *locDom, opts.nx, numRanks);
+      if (opts.phaseTimers != 0) {
+         TimerReport(phases, numCounters) ;
+      }
+      if (opts.roofline != 0) {
+         RooflineReport(phases, peaks) ;
+      }
+      VerifyAndWriteFinalOutput(elapsed_timeG, cycles, *locDom, opts.nx, numRanks);
+   }
+
+   if ((myRank == 0) && (opts.outputFormat != OutputNone)) {
+      RunResults results ;
+      ComputeRunResults(elapsed_timeG, cycles, *locDom, opts.nx, numRanks, &results) ;
+      results.peakBandwidth = peaks.bandwidth ;
+      results.peakFlops = peaks.flops ;
+      WriteRunResults(opts, results, history, phases, numCounters, numRanks) ;
    }
 
    delete locDom; 
+   ReleaseScratchPool() ;
 
 #if USE_MPI
    MPI_Finalize() ;
@@ -2790,3 +3972,5 @@ int main(int argc, char *argv[])
 
    return 0 ;
 }
+
+#endif
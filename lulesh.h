@@ -17,6 +17,7 @@
 #endif
 
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <vector>
@@ -26,6 +27,7 @@
 //**************************************************
 
 #define MAX(a, b) ( ((a) > (b)) ? (a) : (b))
+#define MIN(a, b) ( ((a) < (b)) ? (a) : (b))
 
 
 // Precision specification
@@ -41,6 +43,14 @@ typedef Int4_t  Int_t ;   // integer representation
 
 enum { VolumeError = -1, QStopError = -2 } ;
 
+// Element that failed a kernel's sanity check.  Kernels gather it with
+// the elemError OpenMP reduction (lulesh.cc), which keeps the lowest
+// failing element, and abort through ReportElemError afterwards
+struct ElemError {
+   Int_t   code ;   // 0, VolumeError or QStopError
+   Index_t elem ;
+} ;
+
 inline real4  SQRT(real4  arg) { return sqrtf(arg) ; }
 inline real8  SQRT(real8  arg) { return sqrt(arg) ; }
 inline real10 SQRT(real10 arg) { return sqrtl(arg) ; }
@@ -86,10 +96,18 @@ inline real10 FABS(real10 arg) { return fabsl(arg) ; }
 #define ZETA_P_FREE 0x10000
 #define ZETA_P_COMM 0x20000
 
+// Symmetry planes a node lies on; the acceleration normal to each
+// plane is zero
+#define NODE_SYMM_X 0x1
+#define NODE_SYMM_Y 0x2
+#define NODE_SYMM_Z 0x4
+
 // MPI Message Tags
 #define MSG_COMM_SBN      1024
 #define MSG_SYNC_POS_VEL  2048
 #define MSG_MONOQ         3072
+#define MSG_EOS_WORK      4096
+#define MSG_EOS_RESULT    5120
 
 #define MAX_FIELDS_PER_MPI_COMM 6
 
@@ -107,21 +125,221 @@ inline real10 FABS(real10 arg) { return fabsl(arg) ; }
 /* might want to add access methods so that memory can be */
 /* better managed, as in luleshFT */
 
+// Page policy for field and scratch arrays (lulesh-memory.cc).  With
+// FieldMemDefault everything comes from the C library as before; the
+// huge page policies back large arrays with 2MB pages, either
+// transparently (madvise) or from the hugetlbfs pool (MAP_HUGETLB),
+// falling back to transparent huge pages when the pool is empty.
+enum FieldMemPolicy { FieldMemDefault = 0, FieldMemTHP = 1, FieldMemHugeTLB = 2 } ;
+
+void  SetFieldMemPolicy(Int_t policy) ;
+const char *FieldMemPolicyName(Int_t policy) ;
+void *FieldAlloc(size_t bytes) ;
+void  FieldFree(void *ptr, size_t bytes) ;
+void *ScratchAlloc(size_t bytes) ;
+void  ScratchFree(void *ptr) ;
+void  ReleaseScratchPool() ;
+
 template <typename T>
 T *Allocate(size_t size)
 {
-   return static_cast<T *>(malloc(sizeof(T)*size)) ;
+   return static_cast<T *>(ScratchAlloc(sizeof(T)*size)) ;
 }
 
 template <typename T>
 void Release(T **ptr)
 {
    if (*ptr != NULL) {
-      free(*ptr) ;
+      ScratchFree(*ptr) ;
       *ptr = NULL ;
    }
 }
 
+//////////////////////////////////////////////////////
+// Placement-aware storage for persistent Domain fields
+//////////////////////////////////////////////////////
+
+/*
+ * std::vector allocator that leaves elements uninitialized on resize().
+ * Memory is therefore not touched at allocation time, and each page is
+ * placed (first touch) on the NUMA node of the thread that initializes
+ * it, see Domain::AllocateNodePersistent/AllocateElemPersistent.
+ */
+template <typename T>
+class FieldAllocator {
+public:
+   typedef T         value_type ;
+   typedef T*        pointer ;
+   typedef const T*  const_pointer ;
+   typedef T&        reference ;
+   typedef const T&  const_reference ;
+   typedef size_t    size_type ;
+   typedef ptrdiff_t difference_type ;
+
+   template <typename U> struct rebind { typedef FieldAllocator<U> other ; } ;
+
+   FieldAllocator() {}
+   template <typename U> FieldAllocator(const FieldAllocator<U>&) {}
+
+   T *allocate(size_t n, const void * = 0)
+   { return static_cast<T *>(FieldAlloc(n*sizeof(T))) ; }
+   void deallocate(T *ptr, size_t n)
+   { FieldFree(ptr, n*sizeof(T)) ; }
+
+   // default-initialize: no value is written for scalar types
+   template <typename U> void construct(U *ptr)
+   { ::new(static_cast<void *>(ptr)) U ; }
+   template <typename U, typename V> void construct(U *ptr, const V& val)
+   { ::new(static_cast<void *>(ptr)) U(val) ; }
+   template <typename U> void destroy(U *ptr) { ptr->~U() ; }
+
+   size_t max_size() const { return size_t(-1) / sizeof(T) ; }
+   pointer address(reference x) const { return &x ; }
+   const_pointer address(const_reference x) const { return &x ; }
+} ;
+
+template <typename T, typename U>
+inline bool operator==(const FieldAllocator<T>&, const FieldAllocator<U>&)
+{ return true ; }
+template <typename T, typename U>
+inline bool operator!=(const FieldAllocator<T>&, const FieldAllocator<U>&)
+{ return false ; }
+
+typedef std::vector<Real_t,  FieldAllocator<Real_t> >  RealField ;
+typedef std::vector<Index_t, FieldAllocator<Index_t> > IndexField ;
+typedef std::vector<Int_t,   FieldAllocator<Int_t> >   IntField ;
+typedef std::vector<unsigned char, FieldAllocator<unsigned char> > FlagField ;
+
+//////////////////////////////////////////////////////
+// Tabulated equation of state
+//////////////////////////////////////////////////////
+
+/*
+ * p(rho,e) and c^2(rho,e) sampled on a grid that is log-spaced in
+ * relative density and specific internal energy.  The two values for
+ * a node are interleaved, energy varies fastest:
+ *
+ *    data[2*(i*numE + j)    ] = p (rho[i], e[j])
+ *    data[2*(i*numE + j) + 1] = c2(rho[i], e[j])
+ */
+struct EOSTable {
+   Int_t   numRho ;
+   Int_t   numE ;
+   Real_t  logRhoMin, logRhoMax ;
+   Real_t  logEMin, logEMax ;
+   Real_t  invDLogRho ;  // 1/(grid spacing) in log(rho)
+   Real_t  invDLogE ;    // 1/(grid spacing) in log(e)
+   Real_t *rho ;         // node densities
+   Real_t *e ;           // node energies
+   Real_t *data ;        // interleaved {p, c2}
+} ;
+
+// Interpolation order used for a region's table lookups
+enum { EOSBilinear = 1, EOSBicubic = 3 } ;
+
+//////////////////////////////////////////////////////
+// Unstructured hexahedral mesh
+//////////////////////////////////////////////////////
+
+/*
+ * Whole mesh as read from a file (lulesh-mesh.cc).  Every rank holds
+ * it while its Domain is built from the rank's part; corners are in
+ * the same order as the elements of BuildMesh.
+ */
+struct HexMesh {
+   Index_t numNode ;
+   Index_t numElem ;
+   Index_t originElem ;     // element that receives the initial energy
+   Real_t  originEnergy ;
+   std::vector<Real_t> x, y, z ;
+   std::vector<unsigned char> nodeBC ;  // NODE_SYMM_* flags
+   std::vector<Index_t> nodelist ;      // 8 corners per element
+} ;
+
+//////////////////////////////////////////////////////
+// Region index sets
+//////////////////////////////////////////////////////
+
+/*
+ * Region kernels are written against "regElemList[i]" and are
+ * instantiated for either an explicit element list (the default
+ * layout, where region members are scattered through the mesh) or a
+ * contiguous range (when elements are stored sorted by region), in
+ * which case the gather disappears and loops are unit stride.
+ */
+struct ElemList {
+   ElemList(const Index_t *list) : m_list(list) {}
+   Index_t operator[](Index_t i) const { return m_list[i] ; }
+   const Index_t *m_list ;
+} ;
+
+struct ElemRange {
+   ElemRange(Index_t start) : m_start(start) {}
+   Index_t operator[](Index_t i) const { return m_start + i ; }
+   Index_t m_start ;
+} ;
+
+//////////////////////////////////////////////////////
+// EOS work shared between ranks
+//////////////////////////////////////////////////////
+
+/*
+ * A batch of elements whose EOS one rank evaluates for another (see
+ * lulesh-balance.cc).  The values are stored field-major in buf so the
+ * seven inputs travel as one message and the four results (e, p, q and
+ * ss) come back as another.  The element accessors match the Domain
+ * ones, which lets EvalEOSForElems run on a batch unchanged.
+ */
+enum EOSWorkField {
+   EOSDelv = 0, EOSQQ, EOSQL, EOSVnew,   // inputs only
+   EOSE, EOSP, EOSQ,                     // inputs and results
+   EOSSS,                                // result only
+   EOSNumFields
+} ;
+
+#define EOS_WORK_IN     EOSSS            // fields sent with the work
+#define EOS_WORK_OUT    (EOSNumFields - EOSE)
+
+struct EOSWork {
+   Int_t rank ;                    // peer rank
+   std::vector<Index_t> plan ;     // elements per region at the last plan
+   std::vector<Index_t> count ;    // elements per region this cycle
+   std::vector<Index_t> first ;    // and where they start in each region
+                                   // list, for sends
+   std::vector<Real_t>  buf ;      // EOSNumFields values per element
+   Index_t size ;                  // elements in buf
+#if USE_MPI
+   MPI_Request req[2] ;            // work (count, values) or count, results
+#endif
+
+   Real_t *field(Int_t f) { return &buf[f*size] ; }
+
+   Real_t& e(Index_t idx)    { return buf[EOSE*size + idx] ; }
+   Real_t& p(Index_t idx)    { return buf[EOSP*size + idx] ; }
+   Real_t& q(Index_t idx)    { return buf[EOSQ*size + idx] ; }
+   Real_t& qq(Index_t idx)   { return buf[EOSQQ*size + idx] ; }
+   Real_t& ql(Index_t idx)   { return buf[EOSQL*size + idx] ; }
+   Real_t& delv(Index_t idx) { return buf[EOSDelv*size + idx] ; }
+   Real_t& ss(Index_t idx)   { return buf[EOSSS*size + idx] ; }
+} ;
+
+struct EOSBalance {
+   Int_t interval ;                // cycles between plans, 0 = off
+   std::vector<EOSWork> sends ;    // work this rank hands out
+   std::vector<EOSWork> serves ;   // work this rank evaluates for others
+   std::vector<Index_t> shipped ;  // elements per region sent this cycle
+   double localTime ;              // own EOS time and weighted elements
+   double localUnits ;             // since the last plan
+   double eosTime ;                // all EOS time since the last plan
+   Int_t  plans ;
+   double imbalanceFirst ;         // max/mean EOS time, first interval
+   double imbalanceLast ;          // and the last complete one
+
+   EOSBalance() : interval(0), localTime(0.0), localUnits(0.0),
+                  eosTime(0.0), plans(0),
+                  imbalanceFirst(1.0), imbalanceLast(1.0) {}
+} ;
+
 //////////////////////////////////////////////////////
 // Primary data structure
 //////////////////////////////////////////////////////
@@ -149,10 +367,14 @@ class Domain {
 
    public:
 
-   // Constructor
+   // Constructor.  With a file mesh the domain is the part of rank
+   // colLoc and the lattice arguments (rowLoc, planeLoc, nx, tp) are
+   // not used
    Domain(Int_t numRanks, Index_t colLoc,
           Index_t rowLoc, Index_t planeLoc,
-          Index_t nx, Int_t tp, Int_t nr, Int_t balance, Int_t cost);
+          Index_t nx, Int_t tp, Int_t nr, Int_t balance, Int_t cost,
+          Int_t sortRegions, Int_t migrateInterval, Real_t migrateFraction,
+          const HexMesh *mesh = NULL);
 
    // Destructor
    ~Domain();
@@ -171,15 +393,23 @@ class Domain {
       m_yd.resize(numNode);
       m_zd.resize(numNode);
 
-      m_xdd.resize(numNode); // accelerations
-      m_ydd.resize(numNode);
-      m_zdd.resize(numNode);
-
       m_fx.resize(numNode);  // forces
       m_fy.resize(numNode);
       m_fz.resize(numNode);
 
       m_nodalMass.resize(numNode);  // mass
+
+      m_nodeBC.resize(numNode);  // symmetry plane flags
+
+      // First touch with the static partition of the node loops
+#pragma omp parallel for firstprivate(numNode)
+      for (Index_t i=0; i<numNode; ++i) {
+         m_x[i] = m_y[i] = m_z[i] = Real_t(0.0) ;
+         m_xd[i] = m_yd[i] = m_zd[i] = Real_t(0.0) ;
+         m_fx[i] = m_fy[i] = m_fz[i] = Real_t(0.0) ;
+         m_nodalMass[i] = Real_t(0.0) ;
+         m_nodeBC[i] = 0 ;
+      }
    }
 
    void AllocateElemPersistent(Int_t numElem) // Elem-centered
@@ -196,6 +426,8 @@ class Domain {
 
       m_elemBC.resize(numElem);
 
+      m_delvNbr.resize(6*numElem);
+
       m_e.resize(numElem);
       m_p.resize(numElem);
 
@@ -216,6 +448,25 @@ class Domain {
       m_elemMass.resize(numElem);
 
       m_vnew.resize(numElem) ;
+
+      // First touch with the static partition of the element loops
+#pragma omp parallel for firstprivate(numElem)
+      for (Index_t i=0; i<numElem; ++i) {
+         for (Index_t j=0; j<8; ++j) {
+            m_nodelist[8*i+j] = 0 ;
+         }
+         m_lxim[i] = m_lxip[i] = 0 ;
+         m_letam[i] = m_letap[i] = 0 ;
+         m_lzetam[i] = m_lzetap[i] = 0 ;
+         m_elemBC[i] = 0 ;
+         for (Index_t j=0; j<6; ++j) {
+            m_delvNbr[6*i+j] = 0 ;
+         }
+         m_e[i] = m_p[i] = Real_t(0.0) ;
+         m_q[i] = m_ql[i] = m_qq[i] = Real_t(0.0) ;
+         m_v[i] = m_volo[i] = m_delv[i] = m_vdov[i] = Real_t(0.0) ;
+         m_arealg[i] = m_ss[i] = m_elemMass[i] = m_vnew[i] = Real_t(0.0) ;
+      }
    }
 
    void AllocateGradients(Int_t numElem, Int_t allElem)
@@ -225,10 +476,17 @@ class Domain {
       m_delx_eta  = Allocate<Real_t>(numElem) ;
       m_delx_zeta = Allocate<Real_t>(numElem) ;
 
-      // Velocity gradients
-      m_delv_xi   = Allocate<Real_t>(allElem) ;
-      m_delv_eta  = Allocate<Real_t>(allElem);
-      m_delv_zeta = Allocate<Real_t>(allElem) ;
+      AllocateVelocityGradients(allElem) ;
+   }
+
+   void AllocateVelocityGradients(Int_t allElem)
+   {
+      // Velocity gradients, with a zero slot past the ghosts that
+      // free surfaces read (see SetupMonoQNeighbors)
+      m_delv_xi   = Allocate<Real_t>(allElem+1) ;
+      m_delv_eta  = Allocate<Real_t>(allElem+1);
+      m_delv_zeta = Allocate<Real_t>(allElem+1) ;
+      m_delv_xi[allElem] = m_delv_eta[allElem] = m_delv_zeta[allElem] = Real_t(0.0) ;
    }
 
    void DeallocateGradients()
@@ -272,11 +530,6 @@ class Domain {
    Real_t& yd(Index_t idx)   { return m_yd[idx] ; }
    Real_t& zd(Index_t idx)   { return m_zd[idx] ; }
 
-   // Nodal accelerations
-   Real_t& xdd(Index_t idx)  { return m_xdd[idx] ; }
-   Real_t& ydd(Index_t idx)  { return m_ydd[idx] ; }
-   Real_t& zdd(Index_t idx)  { return m_zdd[idx] ; }
-
    // Nodal forces
    Real_t& fx(Index_t idx)   { return m_fx[idx] ; }
    Real_t& fy(Index_t idx)   { return m_fy[idx] ; }
@@ -285,13 +538,8 @@ class Domain {
    // Nodal mass
    Real_t& nodalMass(Index_t idx) { return m_nodalMass[idx] ; }
 
-   // Nodes on symmertry planes
-   Index_t symmX(Index_t idx) { return m_symmX[idx] ; }
-   Index_t symmY(Index_t idx) { return m_symmY[idx] ; }
-   Index_t symmZ(Index_t idx) { return m_symmZ[idx] ; }
-   bool symmXempty()          { return m_symmX.empty(); }
-   bool symmYempty()          { return m_symmY.empty(); }
-   bool symmZempty()          { return m_symmZ.empty(); }
+   // Symmetry plane flags, NODE_SYMM_*
+   unsigned char& nodeBC(Index_t idx) { return m_nodeBC[idx] ; }
 
    //
    // Element-centered
@@ -302,7 +550,35 @@ class Domain {
    Index_t*  regElemlist(Int_t r)    { return m_regElemlist[r] ; }
    Index_t&  regElemlist(Int_t r, Index_t idx) { return m_regElemlist[r][idx] ; }
 
+   // Dynamic region reassignment (see SetupRegionMigration)
+   Int_t&    regMigrateInterval()     { return m_regMigrateInterval ; }
+   Index_t&  regMaxMoves()            { return m_regMaxMoves ; }
+   Index_t&  regElemPos(Index_t idx)  { return m_regElemPos[idx] ; }
+   Index_t*  regMoves()               { return m_regMoves ; }
+   void      ReserveRegionElems(Int_t r, Index_t count) ;
+
+   // EOS work shared with other ranks (see lulesh-balance.cc)
+   EOSBalance& eosBalance()         { return m_eosBalance ; }
+
+   // Elements stored contiguously by region (see SortElementsByRegion)
+   bool      regionSorted()          { return !m_spatialElem.empty() ; }
+   // Storage index of the element at lattice position idx
+   Index_t   spatialElem(Index_t idx)
+   { return m_spatialElem.empty() ? idx : m_spatialElem[idx] ; }
+
    Index_t*  nodelist(Index_t idx)    { return &m_nodelist[Index_t(8)*idx] ; }
+   // nodelist is the BuildMesh lattice, see LatticeNodes
+   bool&     latticeNodes()          { return m_latticeNodes ; }
+
+   // Domain built from a file mesh rather than the Sedov cube
+   bool      unstructured()          { return !m_meshElem.empty() ; }
+   // Id in the mesh file of local element idx (storage order)
+   Index_t   meshElem(Index_t idx)   { return m_meshElem[idx] ; }
+   // Elements of the whole file mesh
+   Index_t&  meshNumElem()           { return m_meshNumElem ; }
+   // Storage index of the element holding the initial energy deposit,
+   // -1 on ranks of a file mesh that do not own it
+   Index_t&  originElem()            { return m_originElem ; }
 
    // elem connectivities through face
    Index_t&  lxim(Index_t idx) { return m_lxim[idx] ; }
@@ -315,6 +591,10 @@ class Domain {
    // elem face symm/free-surface flag
    Int_t&  elemBC(Index_t idx) { return m_elemBC[idx] ; }
 
+   // velocity gradient slots read across the six faces by the monotonic
+   // q limiter, in xi-, xi+, eta-, eta+, zeta-, zeta+ order
+   Index_t*  delvNbr(Index_t idx) { return &m_delvNbr[Index_t(6)*idx] ; }
+
    // Principal strains - temporary
    Real_t& dxx(Index_t idx)  { return m_dxx[idx] ; }
    Real_t& dyy(Index_t idx)  { return m_dyy[idx] ; }
@@ -366,6 +646,9 @@ class Domain {
    // Element mass
    Real_t& elemMass(Index_t idx)  { return m_elemMass[idx] ; }
 
+   // Tabulated EOS (NULL selects the analytic ideal gas)
+   EOSTable*& eosTable()          { return m_eosTable ; }
+
    Index_t nodeElemCount(Index_t idx)
    { return m_nodeElemStart[idx+1] - m_nodeElemStart[idx] ; }
 
@@ -424,6 +707,8 @@ class Domain {
    Int_t&  cost()             { return m_cost ; }
    Index_t&  numElem()            { return m_numElem ; }
    Index_t&  numNode()            { return m_numNode ; }
+   // local elements plus the ghost element slots of all faces
+   Index_t   allElem()              { return numElem() + m_numGhostElem ; }
    
    Index_t&  maxPlaneSize()       { return m_maxPlaneSize ; }
    Index_t&  maxEdgeSize()        { return m_maxEdgeSize ; }
@@ -440,6 +725,18 @@ class Domain {
    // Maximum number of block neighbors 
    MPI_Request recvRequest[26] ; // 6 faces + 12 edges + 8 corners 
    MPI_Request sendRequest[26] ; // 6 faces + 12 edges + 8 corners 
+
+   // Halos of a file mesh (see BuildHexMesh), used by CommSBN and
+   // CommMonoQ instead of the lattice messages.  Lists are per neighbor
+   // rank, in ascending rank order, and ordered by mesh id so that both
+   // sides of a message agree on it
+   std::vector<Int_t>   haloRanks ;
+   std::vector<Index_t> haloNodes ;      // local nodes shared with any neighbor
+   std::vector<Index_t> haloNodeStart ;  // per neighbor, into haloNodePos
+   std::vector<Index_t> haloNodePos ;    // positions in haloNodes
+   std::vector<Index_t> haloSendStart ;  // per neighbor, into haloSendElem
+   std::vector<Index_t> haloSendElem ;   // local elements a neighbor reads
+   std::vector<Index_t> haloRecvStart ;  // per neighbor, ghost slot past numElem
 #endif
 
   private:
@@ -447,37 +744,38 @@ class Domain {
    void BuildMesh(Int_t nx, Int_t edgeNodes, Int_t edgeElems);
    void SetupThreadSupportStructures();
    void CreateRegionIndexSets(Int_t nreg, Int_t balance);
-   void SetupCommBuffers(Int_t edgeNodes);
+   void SetupRegionMigration(Int_t interval, Real_t fraction);
+   void SetupCommBuffers();
    void SetupSymmetryPlanes(Int_t edgeNodes);
    void SetupElementConnectivities(Int_t edgeElems);
    void SetupBoundaryConditions(Int_t edgeElems);
+   void SortElementsByRegion();
+   void SetupMonoQNeighbors();
+   void PartitionHexMesh(const HexMesh& mesh, Int_t myRank,
+                         std::vector<Int_t>& part);
+   void BuildHexMesh(const HexMesh& mesh, Int_t myRank,
+                     const std::vector<Int_t>& part);
 
    //
    // IMPLEMENTATION
    //
 
    /* Node-centered */
-   std::vector<Real_t> m_x ;  /* coordinates */
-   std::vector<Real_t> m_y ;
-   std::vector<Real_t> m_z ;
-
-   std::vector<Real_t> m_xd ; /* velocities */
-   std::vector<Real_t> m_yd ;
-   std::vector<Real_t> m_zd ;
+   RealField m_x ;  /* coordinates */
+   RealField m_y ;
+   RealField m_z ;
 
-   std::vector<Real_t> m_xdd ; /* accelerations */
-   std::vector<Real_t> m_ydd ;
-   std::vector<Real_t> m_zdd ;
+   RealField m_xd ; /* velocities */
+   RealField m_yd ;
+   RealField m_zd ;
 
-   std::vector<Real_t> m_fx ;  /* forces */
-   std::vector<Real_t> m_fy ;
-   std::vector<Real_t> m_fz ;
+   RealField m_fx ;  /* forces */
+   RealField m_fy ;
+   RealField m_fz ;
 
-   std::vector<Real_t> m_nodalMass ;  /* mass */
+   RealField m_nodalMass ;  /* mass */
 
-   std::vector<Index_t> m_symmX ;  /* symmetry plane nodesets */
-   std::vector<Index_t> m_symmY ;
-   std::vector<Index_t> m_symmZ ;
+   FlagField m_nodeBC ;  /* symmetry plane flags, NODE_SYMM_* */
 
    // Element-centered
 
@@ -488,16 +786,40 @@ class Domain {
    Index_t *m_regNumList ;    // Region number per domain element
    Index_t **m_regElemlist ;  // region indexset 
 
-   std::vector<Index_t>  m_nodelist ;     /* elemToNode connectivity */
+   // Region migration: region lists have spare room for the elements
+   // one migration can bring in and grow when a region outgrows it
+   Index_t *m_regElemCap ;         // allocated length of each region list
+   Int_t    m_regMigrateInterval ; // cycles between migrations, 0 = off
+   Index_t  m_regMaxMoves ;        // moves attempted per migration
+   Index_t *m_regElemPos ;         // position of each elem in its region list
+   Index_t *m_regMoves ;           // scratch, {elem, from, to} per move
+
+   EOSBalance m_eosBalance ;
+
+   EOSTable *m_eosTable ;     // tabulated EOS, owned by the domain
+
+   std::vector<Index_t> m_spatialElem ; /* lattice -> storage elem index,
+                                           empty unless region-sorted */
 
-   std::vector<Index_t>  m_lxim ;  /* element connectivity across each face */
-   std::vector<Index_t>  m_lxip ;
-   std::vector<Index_t>  m_letam ;
-   std::vector<Index_t>  m_letap ;
-   std::vector<Index_t>  m_lzetam ;
-   std::vector<Index_t>  m_lzetap ;
+   IndexField m_nodelist ;     /* elemToNode connectivity */
+   bool       m_latticeNodes ; /* m_nodelist follows the node lattice */
 
-   std::vector<Int_t>    m_elemBC ;  /* symmetry/free-surface flags for each elem face */
+   std::vector<Index_t> m_meshElem ; /* file mesh id of each element,
+                                        empty for the built-in cube */
+   Index_t m_meshNumElem ;
+   Index_t m_originElem ;
+   Index_t m_numGhostElem ;    /* ghost element slots past numElem */
+
+   IndexField m_lxim ;  /* element connectivity across each face */
+   IndexField m_lxip ;
+   IndexField m_letam ;
+   IndexField m_letap ;
+   IndexField m_lzetam ;
+   IndexField m_lzetap ;
+
+   IntField m_elemBC ;  /* symmetry/free-surface flags for each elem face */
+
+   IndexField m_delvNbr ; /* monotonic q gradient slot across each face */
 
    Real_t             *m_dxx ;  /* principal strains -- temporary */
    Real_t             *m_dyy ;
@@ -511,24 +833,24 @@ class Domain {
    Real_t             *m_delx_eta ;
    Real_t             *m_delx_zeta ;
    
-   std::vector<Real_t> m_e ;   /* energy */
+   RealField m_e ;   /* energy */
 
-   std::vector<Real_t> m_p ;   /* pressure */
-   std::vector<Real_t> m_q ;   /* q */
-   std::vector<Real_t> m_ql ;  /* linear term for q */
-   std::vector<Real_t> m_qq ;  /* quadratic term for q */
+   RealField m_p ;   /* pressure */
+   RealField m_q ;   /* q */
+   RealField m_ql ;  /* linear term for q */
+   RealField m_qq ;  /* quadratic term for q */
 
-   std::vector<Real_t> m_v ;     /* relative volume */
-   std::vector<Real_t> m_volo ;  /* reference volume */
-   std::vector<Real_t> m_vnew ;  /* new relative volume -- temporary */
-   std::vector<Real_t> m_delv ;  /* m_vnew - m_v */
-   std::vector<Real_t> m_vdov ;  /* volume derivative over volume */
+   RealField m_v ;     /* relative volume */
+   RealField m_volo ;  /* reference volume */
+   RealField m_vnew ;  /* new relative volume -- temporary */
+   RealField m_delv ;  /* m_vnew - m_v */
+   RealField m_vdov ;  /* volume derivative over volume */
 
-   std::vector<Real_t> m_arealg ;  /* characteristic length of an element */
+   RealField m_arealg ;  /* characteristic length of an element */
    
-   std::vector<Real_t> m_ss ;      /* "sound speed" */
+   RealField m_ss ;      /* "sound speed" */
 
-   std::vector<Real_t> m_elemMass ;  /* mass */
+   RealField m_elemMass ;  /* mass */
 
    // Cutoffs (treat as constants)
    const Real_t  m_e_cut ;             // energy tolerance 
@@ -596,6 +918,64 @@ class Domain {
 
 typedef Real_t &(Domain::* Domain_member )(Index_t) ;
 
+//////////////////////////////////////////////////////
+// Element to node connectivity
+//////////////////////////////////////////////////////
+
+/*
+ * Element kernels walk the mesh pencil by pencil and fetch the eight
+ * corners of element k in pencil p through elemNodes(p, k, nodes).
+ * NodeList reads them from the nodelist of a general mesh and hands
+ * back a pointer into it.  LatticeNodes is for the box built by
+ * BuildMesh in its original numbering: a pencil is one x row of
+ * elements, so the corners are the first node of the row plus k and
+ * fixed offsets.  No connectivity is read, and the only division is
+ * per pencil, where it is hoisted out of the loop over k.
+ */
+#define NODELIST_PENCIL 64
+
+struct NodeList {
+   NodeList(Domain& domain)
+      : m_nodelist(domain.nodelist(0)), m_numElem(domain.numElem()) {}
+   Index_t numPencils() const
+   { return (m_numElem + NODELIST_PENCIL - 1)/NODELIST_PENCIL ; }
+   Index_t pencilBegin(Index_t p) const { return p*NODELIST_PENCIL ; }
+   Index_t pencilEnd(Index_t p) const
+   { return MIN((p + 1)*NODELIST_PENCIL, m_numElem) ; }
+   const Index_t *elemNodes(Index_t, Index_t k, Index_t *) const
+   { return &m_nodelist[Index_t(8)*k] ; }
+   const Index_t *m_nodelist ;
+   Index_t m_numElem ;
+} ;
+
+struct LatticeNodes {
+   LatticeNodes(Domain& domain)
+      : m_nx(domain.sizeX()), m_ny(domain.sizeY()), m_nz(domain.sizeZ()),
+        m_rowNodes(domain.sizeX() + 1),
+        m_planeNodes((domain.sizeX() + 1)*(domain.sizeY() + 1)) {}
+   Index_t numPencils() const { return m_ny*m_nz ; }
+   Index_t pencilBegin(Index_t p) const { return p*m_nx ; }
+   Index_t pencilEnd(Index_t p) const { return (p + 1)*m_nx ; }
+   const Index_t *elemNodes(Index_t p, Index_t k, Index_t *nodes) const
+   {
+      // element (col, row, plane) starts at node (col, row, plane); the
+      // extra node per row and row per plane add p and the plane count
+      Index_t n0 = k + p + (p/m_ny)*m_rowNodes ;
+      nodes[0] = n0 ;
+      nodes[1] = n0 + 1 ;
+      nodes[2] = n0 + m_rowNodes + 1 ;
+      nodes[3] = n0 + m_rowNodes ;
+      nodes[4] = n0 + m_planeNodes ;
+      nodes[5] = n0 + m_planeNodes + 1 ;
+      nodes[6] = n0 + m_planeNodes + m_rowNodes + 1 ;
+      nodes[7] = n0 + m_planeNodes + m_rowNodes ;
+      return nodes ;
+   }
+   Index_t m_nx, m_ny, m_nz ;
+   Index_t m_rowNodes ;
+   Index_t m_planeNodes ;
+} ;
+
 struct cmdLineOpts {
    Int_t its; // -i 
    Int_t nx;  // -s 
@@ -603,11 +983,82 @@ struct cmdLineOpts {
    Int_t numFiles; // -f
    Int_t showProg; // -p
    Int_t quiet; // -q
-   Int_t viz; // -v 
+   Int_t viz; // -v, --vtk
+   Int_t vizInterval; // -v <cycles>, --vtk <cycles>
+   Int_t vizStride;   // --viz-stride
    Int_t cost; // -c
    Int_t balance; // -b
+   Int_t sortRegions; // -R
+   Int_t nodelist; // --nodelist
+   char *meshFile; // --mesh
+   char *meshOut;  // --mesh-out
+   Int_t migrateInterval; // -a
+   Real_t migrateFraction; // -A
+   Int_t eosBalanceInterval; // -L
+   char *eosFile; // -t
+   char *eosOut;  // -T
+   Int_t memPolicy; // -H
+   Int_t pageAB; // -B
+   Int_t phaseTimers; // --timers
+   Int_t perfCounters; // -P
+   Int_t placement; // -N
+   Int_t outputFormat; // --output
+   char *outputFile;   // --output
+   Int_t roofline;     // --roofline
+   std::vector<Int_t> sweepThreads; // --sweep-threads
+   std::vector<Int_t> sweepSizes;   // --sweep-size
+   char *checkpointFile;       // --checkpoint
+   Int_t checkpointInterval;   // --checkpoint
+   Int_t checkpointAsync;      // --checkpoint-async
+   char *restartFile;          // --restart
 };
 
+enum OutputFormat { OutputNone = 0, OutputJSON = 1, OutputCSV = 2 } ;
+
+enum VizFormat { VizNone = 0, VizSilo = 1, VizVTK = 2 } ;
+
+// Figures of merit and verification values of a finished run
+struct RunResults {
+   Real_t elapsedTime ;   // wall time of the timed loop in s
+   Real_t grindTime1 ;    // us per zone per cycle, one domain
+   Real_t grindTime2 ;    // us per zone per cycle, whole problem
+   Real_t fom ;           // zones per second, whole problem
+   Real_t originEnergy ;
+   Real_t maxAbsDiff ;    // symmetry of e on the z = 0 plane
+   Real_t totalAbsDiff ;
+   Real_t maxRelDiff ;
+   bool   symmetryChecked ; // false on a file mesh, which has no such plane
+   Int_t  cycles ;        // run in this invocation, not since a restart
+   Real_t time ;
+   double peakBandwidth ; // --roofline machine peaks, 0 if not measured
+   double peakFlops ;
+} ;
+
+// One entry of the per-cycle time step history
+struct TimeStepRecord {
+   Real_t time ;
+   Real_t dt ;
+} ;
+
+// Phase timer summary over all ranks, see lulesh-timers
+#define MAX_PERF_COUNTERS 4
+
+enum PerfCounter { PerfCycles = 0, PerfInstructions, PerfLLCMisses, PerfFlops } ;
+
+struct PhaseStats {
+   char   name[32] ;
+   Int8_t calls ;
+   double tmin, tavg, tmax ;           // exclusive wall time in s
+   double count[MAX_PERF_COUNTERS] ;   // summed over threads and ranks
+   double bytes, flops ;               // analytic work, summed over ranks
+} ;
+
+// Measured machine peaks, summed over ranks (bytes/s, flop/s)
+struct MachinePeaks {
+   double bandwidth ;
+   double flops ;
+} ;
+
 
 
 // Function Prototypes
@@ -618,15 +1069,26 @@ Real_t CalcElemVolume( const Real_t x[8],
                        const Real_t z[8]);
 
 // lulesh-util
+void InitCmdLineOpts(struct cmdLineOpts *opts, Int_t numRanks);
 void ParseCommandLineOptions(int argc, char *argv[],
                              Int_t myRank, struct cmdLineOpts *opts);
 void VerifyAndWriteFinalOutput(Real_t elapsed_time,
+                               Int_t cycles,
                                Domain& locDom,
                                Int_t nx,
                                Int_t numRanks);
+void ComputeRunResults(Real_t elapsed_time, Int_t cycles, Domain& locDom,
+                       Int_t nx, Int_t numRanks, RunResults *results);
+void WriteRunResults(const cmdLineOpts& opts, const RunResults& results,
+                     const std::vector<TimeStepRecord>& history,
+                     const std::vector<PhaseStats>& phases,
+                     Int_t numCounters, Int_t numRanks);
+void ReportElemError(Domain& domain, const ElemError& err, const char *where);
 
 // lulesh-viz
 void DumpToVisit(Domain& domain, int numFiles, int myRank, int numRanks);
+void DumpToVTK(Domain& domain, int myRank, int numRanks, int stride, bool async);
+void FinishVTK();
 
 // lulesh-comm
 void CommRecv(Domain& domain, Int_t msgType, Index_t xferFields,
@@ -639,6 +1101,105 @@ void CommSend(Domain& domain, Int_t msgType,
 void CommSBN(Domain& domain, Int_t xferFields, Domain_member *fieldData);
 void CommSyncPosVel(Domain& domain);
 void CommMonoQ(Domain& domain);
+void CommPackFace(Domain& domain, Index_t xferFields,
+                  Domain_member *fieldData, Real_t *destAddr,
+                  Index_t base, Index_t n0, Index_t stride0,
+                  Index_t n1, Index_t stride1, bool elemData);
+void CommUnpackFaceSum(Domain& domain, Index_t xferFields,
+                       Domain_member *fieldData, const Real_t *srcAddr,
+                       Index_t base, Index_t n0, Index_t stride0,
+                       Index_t n1, Index_t stride1);
+
+// lulesh-mesh
+void ReadHexMesh(const char *fname, HexMesh *mesh, Int_t myRank);
+void WriteHexMesh(Domain& domain, const char *fname);
+
+// lulesh-eos
+EOSTable *CreateIdealGasEOSTable(Int_t numRho, Int_t numE, Real_t gamma);
+EOSTable *ReadEOSTable(const char *fname, Int_t myRank);
+void WriteEOSTable(const EOSTable *table, const char *fname);
+void ReleaseEOSTable(EOSTable **table);
+
+// lulesh-checkpoint
+void WriteCheckpoint(Domain& domain, const char *base, Int_t myRank,
+                     Int_t numRanks, bool async);
+void FinishCheckpoints(Int_t myRank, Int_t numRanks, bool report);
+void ReadCheckpoint(Domain& domain, const char *base, Int_t myRank, Int_t numRanks,
+                    bool report);
+
+// lulesh-balance
+void SetupEOSBalance(Domain& domain, Int_t interval) ;
+void ReportEOSBalance(Domain& domain, Int_t myRank, bool report) ;
+#if USE_MPI
+void PlanEOSBalance(Domain& domain, const double *regionWeight) ;
+void PrepareEOSWork(Domain& domain) ;
+void SendEOSWork(Domain& domain) ;
+void ReceiveEOSWork(Domain& domain, size_t k) ;
+void ReturnEOSWork(Domain& domain, size_t k) ;
+void FinishEOSWork(Domain& domain) ;
+#endif
+
+// lulesh-memory
+void ReportFieldPlacement(Domain& domain, Int_t myRank);
+
+// lulesh-timers
+#if LULESH_TIMERS
+enum TimerPhase {
+   TimerTimeIncrement = 0,
+   TimerCalcForceForNodes,
+   TimerIntegrateNodes,
+   TimerCalcLagrangeElements,
+   TimerCalcQForElems,
+   TimerApplyMaterialProperties,
+   TimerUpdateVolumesForElems,
+   TimerCalcTimeConstraints,
+   TimerMigrateRegions,
+   TimerCommRecv,
+   TimerCommSend,
+   TimerCommSBN,
+   TimerCommSyncPosVel,
+   TimerCommMonoQ,
+   TimerCheckpoint,
+   TimerVizOutput,
+   TimerEOSRegion       // EvalEOSForElems of region r is TimerEOSRegion + r
+} ;
+
+void TimerInit(Int_t numReg, bool perfCounters, Int_t myRank);
+void TimerReset();
+void TimerStart(Int_t phase);
+void TimerStop();
+Int_t TimerGather(Int_t myRank, Int_t numRanks, std::vector<PhaseStats>& stats);
+void TimerReport(const std::vector<PhaseStats>& stats, Int_t numCounters);
+void TimerAddWork(double bytes, double flops);
+void MeasureMachinePeaks(MachinePeaks *peaks);
+void RooflineReport(const std::vector<PhaseStats>& stats,
+                    const MachinePeaks& peaks);
+
+// Times the rest of the enclosing scope as the given phase
+class ScopedTimer {
+public:
+   ScopedTimer(Int_t phase) { TimerStart(phase) ; }
+   ~ScopedTimer() { TimerStop() ; }
+} ;
+#define SCOPED_TIMER(phase) ScopedTimer scopedTimer(phase)
+
+// Compulsory traffic of n reals or indices, for TimerAddWork
+#define REAL_BYTES(n)  (double(n)*sizeof(Real_t))
+#define INDEX_BYTES(n) (double(n)*sizeof(Index_t))
+#else
+inline void TimerInit(Int_t, bool, Int_t) {}
+inline void TimerReset() {}
+inline Int_t TimerGather(Int_t, Int_t, std::vector<PhaseStats>& stats)
+{ stats.clear() ; return 0 ; }
+inline void TimerReport(const std::vector<PhaseStats>&, Int_t) {}
+inline void TimerAddWork(double, double) {}
+inline void MeasureMachinePeaks(MachinePeaks *peaks)
+{ peaks->bandwidth = peaks->flops = 0.0 ; }
+inline void RooflineReport(const std::vector<PhaseStats>&, const MachinePeaks&) {}
+#define SCOPED_TIMER(phase)
+#define REAL_BYTES(n)  0.0
+#define INDEX_BYTES(n) 0.0
+#endif
 
 // lulesh-init
 void InitMeshDecomp(Int_t numRanks, Int_t myRank,